@@ -128,8 +128,18 @@ void ic_style_close(void);
 
 /// Enable history. 
 /// Use a \a NULL filename to not persist the history. Use -1 for max_entries to get the default (200).
+/// Beyond the 256 most recent entries, older entries are kept compressed in memory.
+/// Large entries (of 4KiB or more) are stored once in the `<fname>.blobs` directory
+/// and only referenced from the history file.
 void ic_set_history(const char* fname, long max_entries );
 
+/// Enable a draft journal that persists the current input while editing.
+/// If the process or session dies during editing, the next ic_readline() 
+/// restores the unfinished input from this file (and ctrl-z discards it).
+/// The journal is removed once the input is accepted.
+/// Use a \a NULL filename to disable (disabled by default).
+void ic_set_draft_file(const char* fname);
+
 /// Remove the last entry in the history. 
 /// The last returned input from ic_readline() is automatically added to the history; this function removes it.
 void ic_history_remove_last(void);
@@ -196,6 +206,21 @@ bool ic_add_completion_ex( ic_completion_env_t* cenv, const char* completion, co
 /// If `false` is returned, the callback should try to return and not add more completions (for improved latency).
 bool ic_add_completions(ic_completion_env_t* cenv, const char* prefix, const char** completions);
 
+/// A callback that computes the display (if `help` is `false`) or help (if `help` is `true`) string of
+/// a `completion` on demand, where `arg` is the argument given to `ic_add_completion_lazy`.
+/// Returns NULL if there is no such string; the result is copied by isocline right away.
+typedef const char* (ic_completion_info_fun_t)(const char* completion, void* arg, bool help);
+
+/// In a completion callback (usually from ic_complete_word()), use this function to add a completion
+/// whose `display` and `help` are only computed by `info` when needed, that is, when the completion
+/// becomes visible in the completion menu or is used as a hint. This avoids for example expensive
+/// documentation lookups for the many completions that are never shown. The results are kept
+/// until the next completion, and the `arg` should remain valid until then too.
+///
+/// Returns `true` if the callback should continue trying to find more possible completions.
+/// If `false` is returned, the callback should try to return and not add more completions (for improved latency).
+bool ic_add_completion_lazy(ic_completion_env_t* cenv, const char* completion, ic_completion_info_fun_t* info, void* arg);
+
 /// Complete a filename.
 /// Complete a filename given a semi-colon separated list of root directories `roots` and 
 /// semi-colon separated list of possible extensions (excluding directories). 
@@ -212,6 +237,12 @@ bool ic_add_completions(ic_completion_env_t* cenv, const char* prefix, const cha
 /// (This already uses ic_complete_quoted_word() so do not call it from inside a word handler).
 void ic_complete_filename( ic_completion_env_t* cenv, const char* prefix, char dir_separator, const char* roots, const char* extensions );
 
+/// Complete the current word (like a host name, table name, or file path) from the words in the history,
+/// where the words used most often and most recently come first.
+/// The words are kept in an index that is created on the first use, so this is fast even for a large history.
+/// (This already uses ic_complete_word() so do not call it from inside a word handler).
+void ic_complete_history_word( ic_completion_env_t* cenv, const char* prefix );
+
 
 
 /// Function that returns whether a (utf8) character (of length `len`) is in a certain character class
@@ -283,6 +314,11 @@ void ic_set_default_highlighter(ic_highlight_fun_t* highlighter, void* arg);
 /// Set the style of characters starting at position `pos`.
 void ic_highlight(ic_highlight_env_t* henv, long pos, long count, const char* style );
 
+/// Show virtual `text` with the given `style` (can be NULL) just before position `pos` in the input.
+/// The text is displayed but not part of the input, for example to show type hints or error markers. 
+/// Can be called in a `ic_highlight_fun_t` callback; multiple annotations can be shown at once.
+void ic_highlight_annotate(ic_highlight_env_t* henv, long pos, const char* text, const char* style);
+
 /// Experimental: Convenience callback for a function that highlights `s` using bbcode's.
 /// The returned string should be allocated and is free'd by the caller.
 typedef char* (ic_highlight_format_fun_t)(const char* s, void* arg);
@@ -347,6 +383,13 @@ bool ic_enable_color( bool enable );
 /// Returns the previous setting.
 bool ic_enable_history_duplicates( bool enable );
 
+/// Disable or enable fuzzy history search (disabled by default).
+/// When enabled, `ctrl-r` shows a list of the best matching history entries,
+/// where the input only needs to occur as a subsequence in an entry. 
+/// Consecutive characters, starts of words, and recent entries rank higher.
+/// Returns the previous setting.
+bool ic_enable_history_fuzzy_search( bool enable );
+
 /// Disable or enable automatic tab completion after a completion 
 /// to expand as far as possible if the completions are unique. (disabled by default).
 /// Returns the previous setting.
@@ -374,17 +417,79 @@ bool ic_enable_hint(bool enable);
 /// Set millisecond delay before a hint is displayed. Can be zero. (500ms by default).
 long ic_set_hint_delay(long delay_ms);
 
+/// Get the number of hints that were computed (each calls the completer), and the number of
+/// hint computations that were avoided. After an insert, a hint is only computed once typing pauses
+/// for a bit longer than the average interval between keys; this pause is shortened to keep the hint
+/// ready within the hint delay given the average cost of computing a hint.
+/// The current pause in milliseconds is returned in `pause_ms`. All arguments can be NULL.
+void ic_get_hint_stats(long* computed, long* avoided, long* pause_ms);
+
 /// Disable or enable syntax highlighting (enabled by default).
 /// This applies regardless whether a syntax highlighter callback was set (`ic_set_highlighter`)
 /// Returns the previous setting.
 bool ic_enable_highlight(bool enable);
 
+/// Highlighting levels. When highlighting the input repeatedly takes longer than the 
+/// budget (see `ic_set_highlight_budget`), cheaper levels are used until the input shrinks again.
+typedef enum ic_highlight_level_e {
+  IC_HIGHLIGHT_FULL     = 0,   ///< highlight the full input
+  IC_HIGHLIGHT_VIEWPORT = 1,   ///< only highlight the lines that can be visible
+  IC_HIGHLIGHT_BRACES   = 2,   ///< only brace matching
+  IC_HIGHLIGHT_PLAIN    = 3    ///< no highlighting
+} ic_highlight_level_t;
+
+/// Set the time budget in milliseconds for highlighting the input on each refresh
+/// (25ms by default, 0 for no limit). Returns the previous setting.
+long ic_set_highlight_budget(long budget_ms);
+
+/// Get the current highlighting level, and the duration of the last highlighting in micro-seconds (if `last_us` is not NULL).
+ic_highlight_level_t ic_get_highlight_stats(long* last_us);
+
+/// Rendering levels. On a slow link (like a serial line or a congested ssh connection) 
+/// rendering is degraded progressively, and restored as the link recovers.
+typedef enum ic_render_level_e {
+  IC_RENDER_FULL    = 0,   ///< full fidelity
+  IC_RENDER_NOHINT  = 1,   ///< no hints and no line-wrap markers
+  IC_RENDER_NOCOLOR = 2,   ///< also no colors (but still bold, underline, etc.)
+  IC_RENDER_MINIMAL = 3    ///< also display the completion menu on a single line
+} ic_render_level_t;
+
+/// Disable or enable rendering that adapts to the output bandwidth (enabled by default). 
+/// The bandwidth is estimated from the duration of writes and the output still queued.
+/// @returns the previous setting.
+bool ic_enable_adaptive_rendering(bool enable);
+
+/// Get the current rendering level, and the estimated output bandwidth in bytes per second 
+/// (if `bytes_per_sec` is not NULL; 0 if unknown).
+ic_render_level_t ic_get_render_stats(long* bytes_per_sec);
+
+/// Disable or enable scrolling the terminal with scroll margins (DECSTBM) instead of
+/// repainting, when an input taller than the terminal moves by one row. Enabled by default
+/// if the terminal supports it (but disabled by `ic_headless_init`).
+/// @returns the previous setting.
+bool ic_enable_scroll_regions(bool enable);
+
 
 /// Set millisecond delay for reading escape sequences in order to distinguish
 /// a lone ESC from the start of a escape sequence. The defaults are 100ms and 10ms, 
 /// but it may be increased if working with very slow terminals.
 void ic_set_tty_esc_delay(long initial_delay_ms, long followup_delay_ms);
 
+/// Disable or enable typeahead mode (disabled by default).
+/// In typeahead mode, keys typed while the application is busy between
+/// two `ic_readline` calls are preserved, and the next `ic_readline` starts
+/// with them already in the input. 
+/// If `noecho` is set, the terminal does not echo such keys between calls either.
+/// @returns the previous setting.
+bool ic_enable_typeahead(bool enable, bool noecho);
+
+/// Disable or enable decoding keys in a separate input thread (disabled by default).
+/// The input thread waits for the rest of escape sequences so the editor only 
+/// handles complete keys and is never blocked on partial input.
+/// Not supported on Windows (or when compiled with `IC_NO_THREADS`).
+/// @returns the previous setting.
+bool ic_enable_input_thread(bool enable);
+
 /// Enable highlighting of matching braces (and error highlight unmatched braces).`
 bool ic_enable_brace_matching(bool enable);
 
@@ -437,6 +542,34 @@ bool ic_add_completion_prim( ic_completion_env_t* cenv, const char* completion,
                               const char* display, const char* help, 
                                long delete_before, long delete_after);
 
+/// Add the completions that were cached with `ic_completion_cache_put` for completer `id`
+/// and `prefix` (if they have not expired yet).
+/// Returns `true` if a cached entry was found; the completer can return right away in that case.
+/// Use this for completers that query slow backends.
+bool ic_completion_cache_get( ic_completion_env_t* cenv, const char* id, const char* prefix );
+
+/// Cache the completions for completer `id` and `prefix` for `ttl_ms` milliseconds.
+/// The `completions` array should be terminated with a NULL element; `displays` and `helps`
+/// can be NULL, or otherwise have an element for each completion (which can be NULL).
+/// All strings are copied. A previous entry for the same `id` and `prefix` is replaced,
+/// and with a `ttl_ms <= 0` (or NULL `completions`) it is just removed.
+/// The cache is shared by all edits in the process and, unlike the rest of isocline, can be
+/// used from any thread: lookups are lock-free and never wait on a concurrent `ic_completion_cache_put`
+/// (which can for example be called from a background thread that queries a slow backend).
+/// Returns `true` if successful.
+bool ic_completion_cache_put( const char* id, const char* prefix, const char** completions,
+                               const char** displays, const char** helps, long ttl_ms );
+
+/// Set the maximal memory used by the completion cache (1MiB by default).
+/// Expired and then the oldest entries are evicted to stay within the limit.
+void ic_set_completion_cache_limit( long max_bytes );
+
+/// Cache the completions of `ic_complete_filename` for `ttl_ms` milliseconds (0 by default,
+/// which disables caching). This helps with slow (network) file systems but
+/// recently created files may not show up until the entry expires.
+/// Returns the previous setting.
+long ic_set_filename_cache_ttl( long ttl_ms );
+
 /// \}
 
 //--------------------------------------------------------------
@@ -489,6 +622,29 @@ bool ic_char_is_idletter(const char* s, long len);
 bool ic_char_is_filename_letter(const char* s, long len);
 
 
+/// Character classes for ic_scan_while() and ic_scan_until(). 
+/// These can be combined, e.g. `IC_CHAR_LETTER | IC_CHAR_DIGIT`.
+typedef enum ic_char_class_e {
+  IC_CHAR_WHITE           = 0x01,  ///< `[ \t\r\n]`
+  IC_CHAR_SEPARATOR       = 0x02,  ///< ``[ \t\r\n,.;:/\\(){}\[\]]``
+  IC_CHAR_LETTER          = 0x04,  ///< `[A-Za-z]` and any unicode > 0x80
+  IC_CHAR_DIGIT           = 0x08,  ///< `[0-9]`
+  IC_CHAR_HEXDIGIT        = 0x10,  ///< `[A-Fa-f0-9]`
+  IC_CHAR_IDLETTER        = 0x20,  ///< `[A-Za-z0-9_-]` and any unicode > 0x80
+  IC_CHAR_FILENAME_LETTER = 0x40   ///< _not in_ " \t\r\n`@$><=;|&\{\}\(\)\[\]]"
+} ic_char_class_t;
+
+/// Convenience: scan forward from `pos` over all characters that are in any of the 
+/// character `classes` and return the position just after them (or `pos` if there are none).
+/// This uses a table lookup per byte and is much faster than calling a character 
+/// class function for each character, e.g. `ic_scan_while(s,pos,IC_CHAR_IDLETTER) - pos`
+/// is the length of an identifier at `pos`.
+long ic_scan_while(const char* s, long pos, int classes);
+
+/// Convenience: scan forward from `pos` until a character is in any of the 
+/// character `classes` (or the end of the string) and return that position.
+long ic_scan_until(const char* s, long pos, int classes);
+
 /// Convenience: If this is a token start, return the length. Otherwise return 0.
 long ic_is_token(const char* s, long pos, ic_is_char_class_fun_t* is_token_char);
 
@@ -542,6 +698,15 @@ void ic_term_writef(const char* fmt, ...);
 /// Write a formatted string to the console.
 void ic_term_vwritef(const char* fmt, va_list args);
 
+/// Start writing text that is already colored with ANSI SGR escape sequences
+/// (like tool logs or `ls` output). Until the matching `ic_term_end_passthrough()`, 
+/// SGR sequences are written as-is without tracking the text attributes; these
+/// are recomputed once at the end. Calls can be nested.
+void ic_term_start_passthrough(void);
+
+/// End writing pre-colored text (see `ic_term_start_passthrough()`).
+void ic_term_end_passthrough(void);
+
 /// Set text attributes from a style.
 void ic_term_style( const char* style );
 
@@ -596,6 +761,71 @@ bool ic_async_stop(void);
 
 /// \}
 
+//--------------------------------------------------------------
+/// \defgroup headless Headless
+/// Drive the editor without a terminal, for example for testing and benchmarking.
+/// \{
+
+/// Switch to headless mode: input is only read from keys fed with
+/// `ic_headless_feed` or `ic_headless_feed_bytes`, and all output is captured
+/// in a buffer (`ic_headless_output`) instead of written to the terminal.
+/// The terminal has a fixed `width` and `height` (use 0 for the default 80x25), 
+/// supports true color, and does not use scroll regions, so the output is deterministic.
+/// All editing, completion, highlighting and rendering is as usual; once all fed input
+/// is consumed, `ic_readline` returns NULL (as if `ctrl-C` was pressed) after which more
+/// keys can be fed for the next call.
+/// There is no way to switch back to the terminal.
+/// Returns `true` if successful.
+bool ic_headless_init(long width, long height);
+
+/// Feed `count` keys as unicode code points. Use control characters for
+/// keys like enter (`'\r'`), tab (`'\t'`), or `ctrl-A` (`1`).
+/// Returns `true` if successful.
+bool ic_headless_feed(const uint32_t* codes, long count);
+
+/// Feed raw input bytes of length `len` (or until the first 0 if `len < 0`). 
+/// Use ANSI escape sequences for special keys, for example `"\x1B[A"` for cursor up.
+/// Returns `true` if successful.
+bool ic_headless_feed_bytes(const char* bytes, long len);
+
+/// Return the output captured since the last `ic_headless_clear_output`,
+/// and its length in `len` (if not NULL). The result is valid until the next call into isocline.
+/// Returns NULL if not in headless mode.
+const char* ic_headless_output(long* len);
+
+/// Clear the captured output.
+void ic_headless_clear_output(void);
+
+/// Record all keyboard input with its timing to the file `fname`, together
+/// with the processing time and output size of each key; use NULL to stop recording.
+/// The trace contains everything that is typed (and is only readable by the user).
+/// Returns `true` if successful.
+bool ic_set_trace_file(const char* fname);
+
+/// Replay the input of a trace file (recorded with `ic_set_trace_file`) with its original timing:
+/// the bytes are fed as in `ic_headless_feed_bytes` but each becomes available at the time it was recorded
+/// (relative to this call). Switches to headless mode with the recorded terminal size if needed.
+/// Returns `true` if successful.
+bool ic_headless_replay(const char* fname);
+
+/// Render model callback: receives a model of length `len` (see `ic_set_render_model`).
+typedef void (ic_render_fun_t)(const char* model, long len, void* arg);
+
+/// Send the edit area as a structured render model to `render` instead of writing 
+/// escape sequences (use NULL to render to the terminal again), for GUI and web front-ends.
+/// Each model is a JSON object `{"rows":N,"cursor":[row,col],"set":[[row,keep,[span,...]],...]}` describing
+/// only what changed since the previous model: `rows` and `cursor` are left out if they are the same, and
+/// `set` contains the changed rows, each keeping the first `keep` characters (code points) of the previous
+/// row (`keep` is left out if 0) followed by the new spans. A span is either `["text"]` or `["text",{attributes}]`.
+/// The attributes are `"fg"` and `"bg"` colors (a palette index 0-15 for ANSI colors, or `"#rrggbb"`) and the flags `"b"` (bold), `"i"` (italic),
+/// `"u"` (underline), and `"r"` (reverse). The cursor column is in cells (including the prompt). 
+/// When the edit is done, `{"done":true}` is sent and the next model is complete again.
+/// Other output (like `ic_print` or the full help) is still written to the terminal.
+/// Returns `true` if successful.
+bool ic_set_render_model(ic_render_fun_t* render, void* arg);
+
+/// \}
+
 //--------------------------------------------------------------
 /// \defgroup alloc Custom Allocation
 /// Register allocation functions for custom allocators
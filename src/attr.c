@@ -261,7 +261,7 @@ ic_private void attrbuf_update_at( attrbuf_t* ab, ssize_t pos, ssize_t count, at
 }
 
 ic_private void attrbuf_insert_at( attrbuf_t* ab, ssize_t pos, ssize_t count, attr_t attr ) {
-  if (pos < 0 || pos > ab->count || count <= 0) return;
+  if (ab==NULL || pos < 0 || pos > ab->count || count <= 0) return;
   if (!attrbuf_ensure_extra(ab,count)) return;  
   ic_memmove( ab->attrs + pos + count, ab->attrs + pos, (ab->count - pos)*ssizeof(attr_t) );
   ab->count += count;
@@ -279,6 +279,18 @@ ic_private ssize_t attrbuf_append_n( stringbuf_t* sb, attrbuf_t* ab, const char*
   return sbuf_append_n(sb,s,len);
 }
 
+// append with an attribute per character (`attrs` can be NULL); must allow ab == NULL
+ic_private ssize_t attrbuf_append_attrs_n( stringbuf_t* sb, attrbuf_t* ab, const char* s, const attr_t* attrs, ssize_t len ) {
+  if (s == NULL || len <= 0) return sbuf_len(sb);
+  if (attrs == NULL) return attrbuf_append_n(sb, ab, s, len, attr_none());
+  if (ab != NULL) {
+    if (!attrbuf_ensure_extra(ab,len)) return sbuf_len(sb);
+    ic_memcpy(ab->attrs + ab->count, attrs, len*ssizeof(attr_t));
+    ab->count += len;
+  }
+  return sbuf_append_n(sb,s,len);
+}
+
 ic_private attr_t attrbuf_attr_at( attrbuf_t* ab, ssize_t pos ) {
   if (ab==NULL || pos < 0 || pos > ab->count) return attr_none();
   return ab->attrs[pos];
@@ -59,6 +59,7 @@ ic_private void           attrbuf_clear( attrbuf_t* ab ); // ab can be NULL
 ic_private ssize_t        attrbuf_len( attrbuf_t* ab);    // ab can be NULL
 ic_private const attr_t*  attrbuf_attrs( attrbuf_t* ab, ssize_t expected_len );
 ic_private ssize_t        attrbuf_append_n( stringbuf_t* sb, attrbuf_t* ab, const char* s, ssize_t len, attr_t attr );
+ic_private ssize_t        attrbuf_append_attrs_n( stringbuf_t* sb, attrbuf_t* ab, const char* s, const attr_t* attrs, ssize_t len );
 
 ic_private void           attrbuf_set_at( attrbuf_t* ab, ssize_t pos, ssize_t count, attr_t attr );
 ic_private void           attrbuf_update_at( attrbuf_t* ab, ssize_t pos, ssize_t count, attr_t attr );
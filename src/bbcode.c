@@ -404,6 +404,27 @@ static const style_t builtin_styles[] = {
   { NULL, { { IC_COLOR_NONE, IC_NONE, IC_NONE, IC_COLOR_NONE, IC_NONE, IC_NONE } } }
 };
 
+// The default theme; these can be redefined by the user (through `bbcode_style_def`).
+// (defined as constants so no style definitions need to be parsed at startup)
+static const style_t default_styles[] = {
+  { "ic-prompt",    { { IC_ANSI_GREEN,       IC_NONE, IC_NONE, IC_COLOR_NONE, IC_NONE, IC_NONE } } },
+  { "ic-info",      { { IC_ANSI_DARKGRAY,    IC_NONE, IC_NONE, IC_COLOR_NONE, IC_NONE, IC_NONE } } },
+  { "ic-diminish",  { { IC_ANSI_LIGHTGRAY,   IC_NONE, IC_NONE, IC_COLOR_NONE, IC_NONE, IC_NONE } } },
+  { "ic-emphasis",  { { IC_RGB(0xffffd7),    IC_NONE, IC_NONE, IC_COLOR_NONE, IC_NONE, IC_NONE } } },
+  { "ic-hint",      { { IC_ANSI_DARKGRAY,    IC_NONE, IC_NONE, IC_COLOR_NONE, IC_NONE, IC_NONE } } },
+  { "ic-error",     { { IC_RGB(0xd70000),    IC_NONE, IC_NONE, IC_COLOR_NONE, IC_NONE, IC_NONE } } },
+  { "ic-bracematch",{ { IC_ANSI_WHITE,       IC_NONE, IC_NONE, IC_COLOR_NONE, IC_NONE, IC_NONE } } }, // color = #F7DC6F
+  { "ic-find",      { { IC_COLOR_NONE,       IC_NONE, IC_ON  , IC_COLOR_NONE, IC_NONE, IC_NONE } } },
+  { "keyword",      { { IC_RGB(0x569cd6),    IC_NONE, IC_NONE, IC_COLOR_NONE, IC_NONE, IC_NONE } } },
+  { "control",      { { IC_RGB(0xc586c0),    IC_NONE, IC_NONE, IC_COLOR_NONE, IC_NONE, IC_NONE } } },
+  { "number",       { { IC_RGB(0xb5cea8),    IC_NONE, IC_NONE, IC_COLOR_NONE, IC_NONE, IC_NONE } } },
+  { "string",       { { IC_RGB(0xce9178),    IC_NONE, IC_NONE, IC_COLOR_NONE, IC_NONE, IC_NONE } } },
+  { "comment",      { { IC_RGB(0x6a9955),    IC_NONE, IC_NONE, IC_COLOR_NONE, IC_NONE, IC_NONE } } },
+  { "type",         { { IC_RGB(0x008b8b),    IC_NONE, IC_NONE, IC_COLOR_NONE, IC_NONE, IC_NONE } } }, // darkcyan
+  { "constant",     { { IC_RGB(0x569cd6),    IC_NONE, IC_NONE, IC_COLOR_NONE, IC_NONE, IC_NONE } } },
+  { NULL,           { { IC_COLOR_NONE,       IC_NONE, IC_NONE, IC_COLOR_NONE, IC_NONE, IC_NONE } } }
+};
+
 static void attr_update_with_styles( tag_t* tag, const char* attr_name, const char* value, 
                                              bool usebgcolor, const style_t* styles, ssize_t count ) 
 {
@@ -427,7 +448,14 @@ static void attr_update_with_styles( tag_t* tag, const char* attr_name, const ch
       return;
     }    
   }
-  // check builtin styles; todo: binary search?
+  // then the default theme and builtin styles; todo: binary search?
+  for( const style_t* style = default_styles; style->name != NULL; style++) {
+    if (strcmp(style->name,attr_name) == 0) {
+      tag->attr = attr_update_with(tag->attr,style->attr);
+      if (tag->name != NULL) tag->name = style->name;
+      return;
+    }
+  }
   for( const style_t* style = builtin_styles; style->name != NULL; style++) {
     if (strcmp(style->name,attr_name) == 0) {
       tag->attr = attr_update_with(tag->attr,style->attr);
@@ -768,15 +796,14 @@ ic_private void bbcode_append( bbcode_t* bb, const char* s, stringbuf_t* out, at
   const ssize_t base = bb->tags_nesting; // base; will not be popped
   ssize_t i = 0;
   while( s[i] != 0 ) {
-    // handle no tags in bulk
+    // handle no tags in bulk (`strcspn` is usually vectorized)
     ssize_t nobb = 0;
-    char c;
-    while( (c = s[i+nobb]) != 0) {
-      if (c == '[' || c == '\\') { break; }
-      if (c == '\x1B' && s[i+nobb+1] == '[') {
+    while(true) {
+      nobb += (ssize_t)strcspn(s+i+nobb, "[\\");
+      if (s[i+nobb] == '[' && nobb > 0 && s[i+nobb-1] == '\x1B') {
         nobb++; // don't count 'ESC[' as a tag opener
       }
-      nobb++;
+      else break;
     }
     if (nobb > 0) { attrbuf_append_n(out, attr_out, s+i, nobb, attr); }
     i += nobb;
@@ -805,6 +832,19 @@ ic_private void bbcode_append( bbcode_t* bb, const char* s, stringbuf_t* out, at
 ic_private void bbcode_print( bbcode_t* bb, const char* s ) {
   if (bb->out == NULL || bb->out_attrs == NULL || s == NULL) return;
   assert(sbuf_len(bb->out) == 0 && attrbuf_len(bb->out_attrs) == 0);
+  if (term_is_plain(bb->term)) {
+    // fast path when attributes are ignored anyways (no color, or redirected output):
+    // only emit the text content without tracking attributes.
+    if (strpbrk(s, "[\\") == NULL) {
+      term_write(bb->term, s);
+    }
+    else {
+      bbcode_append( bb, s, bb->out, NULL );
+      term_write_n( bb->term, sbuf_string(bb->out), sbuf_len(bb->out) );
+      sbuf_clear(bb->out);
+    }
+    return;
+  }
   bbcode_append( bb, s, bb->out, bb->out_attrs );
   term_write_formatted( bb->term, sbuf_string(bb->out), attrbuf_attrs(bb->out_attrs,sbuf_len(bb->out)) );
   attrbuf_clear(bb->out_attrs);
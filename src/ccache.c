@@ -0,0 +1,443 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2021, Daan Leijen
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+-----------------------------------------------------------------------------*/
+#include <string.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+#include "../include/isocline.h"
+#include "common.h"
+#include "env.h"
+#include "completions.h"
+#include "ccache.h"
+
+//-------------------------------------------------------------
+// Entries are kept in a small hash table (chained on collisions)
+// and in a list ordered by insertion for eviction. An entry
+// owns copies of all its completion strings.
+//
+// Lookups are lock-free and can run on any thread: an entry is
+// immutable once published, and the bucket chains are only
+// updated with atomic stores. Writers (put, remove, and evict)
+// are serialized with a small spin lock. An unlinked entry keeps
+// its `next` pointer for lookups that are still traversing it and
+// is put on a retired list that is only freed once there are
+// no lookups in progress.
+//-------------------------------------------------------------
+
+#define IC_CCACHE_BUCKETS  (64)
+
+typedef struct ccache_item_s {
+  const char* replacement;
+  const char* display;
+  const char* help;
+  long        delete_before;
+  long        delete_after;
+} ccache_item_t;
+
+struct ccache_entry_s {
+  ccache_entry_t* next;      // next entry in the same bucket (atomic)
+  ccache_entry_t* older;     // insertion order (or the next retired entry)
+  ccache_entry_t* newer;
+  uint64_t        hash;      // hash of the key
+  const char*     key;       // id, 0, prefix
+  ssize_t         key_len;   // including the middle 0
+  int64_t         expires;   // in micro-seconds (see `ic_time_usecs`)
+  ssize_t         size;      // approximate memory in use
+  ssize_t         count;
+  ssize_t         len;
+  ccache_item_t*  items;
+};
+
+struct ccache_s {
+  ccache_entry_t* buckets[IC_CCACHE_BUCKETS];  // (atomic)
+  ccache_entry_t* oldest;
+  ccache_entry_t* newest;
+  ccache_entry_t* retired;   // unlinked entries that may still be in use by a lookup
+  ssize_t         size;      // total size of all entries
+  ssize_t         max_size;
+  long            readers;   // lookups in progress (atomic)
+  long            lock;      // held by a writer (atomic)
+  alloc_t*        mem;
+};
+
+
+//-------------------------------------------------------------
+// Atomics (sequentially consistent so a writer that sees no
+// readers after unlinking an entry knows no lookup can reach it)
+//-------------------------------------------------------------
+
+#if defined(__GNUC__) || defined(__clang__)
+static inline ccache_entry_t* ccache_load(ccache_entry_t** p) { return __atomic_load_n(p, __ATOMIC_SEQ_CST); }
+static inline void ccache_store(ccache_entry_t** p, ccache_entry_t* e) { __atomic_store_n(p, e, __ATOMIC_SEQ_CST); }
+static inline long ccache_add(long* p, long n) { return __atomic_add_fetch(p, n, __ATOMIC_SEQ_CST); }
+static inline long ccache_swap(long* p, long x) { return __atomic_exchange_n(p, x, __ATOMIC_SEQ_CST); }
+#elif defined(_MSC_VER)
+static inline ccache_entry_t* ccache_load(ccache_entry_t** p) { return (ccache_entry_t*)_InterlockedCompareExchangePointer((void* volatile*)p, NULL, NULL); }
+static inline void ccache_store(ccache_entry_t** p, ccache_entry_t* e) { _InterlockedExchangePointer((void* volatile*)p, e); }
+static inline long ccache_add(long* p, long n) { return _InterlockedExchangeAdd((volatile long*)p, n) + n; }
+static inline long ccache_swap(long* p, long x) { return _InterlockedExchange((volatile long*)p, x); }
+#else
+// no atomics: only safe to use from a single thread
+static inline ccache_entry_t* ccache_load(ccache_entry_t** p) { return *p; }
+static inline void ccache_store(ccache_entry_t** p, ccache_entry_t* e) { *p = e; }
+static inline long ccache_add(long* p, long n) { *p += n; return *p; }
+static inline long ccache_swap(long* p, long x) { const long prev = *p; *p = x; return prev; }
+#endif
+
+static void ccache_lock(ccache_t* cc) {
+  // writers are rare (once per completion that missed the cache), so just back off
+  while (ccache_swap(&cc->lock, 1) != 0) { ic_sleep_usecs(50); }
+}
+
+static void ccache_unlock(ccache_t* cc) {
+  ccache_swap(&cc->lock, 0);
+}
+
+ic_private ccache_t* ccache_new(alloc_t* mem) {
+  ccache_t* cc = mem_zalloc_tp(mem, ccache_t);
+  if (cc == NULL) return NULL;
+  cc->mem = mem;
+  cc->max_size = IC_CCACHE_MAX_BYTES;
+  return cc;
+}
+
+ic_private void ccache_entry_free(ccache_t* cc, ccache_entry_t* e) {
+  if (e == NULL) return;
+  for (ssize_t i = 0; i < e->count; i++) {
+    mem_free(cc->mem, e->items[i].replacement);
+    mem_free(cc->mem, e->items[i].display);
+    mem_free(cc->mem, e->items[i].help);
+  }
+  mem_free(cc->mem, e->items);
+  mem_free(cc->mem, e->key);
+  mem_free(cc->mem, e);
+}
+
+// free the retired entries if no lookup is in progress (called by a writer)
+static void ccache_reclaim(ccache_t* cc) {
+  if (cc->retired == NULL || ccache_add(&cc->readers, 0) != 0) return;
+  ccache_entry_t* e = cc->retired;
+  cc->retired = NULL;
+  while (e != NULL) {
+    ccache_entry_t* older = e->older;
+    ccache_entry_free(cc, e);
+    e = older;
+  }
+}
+
+static void ccache_clear(ccache_t* cc) {
+  ccache_entry_t* e = cc->oldest;
+  while (e != NULL) {
+    ccache_entry_t* newer = e->newer;
+    ccache_entry_free(cc, e);
+    e = newer;
+  }
+  e = cc->retired;
+  while (e != NULL) {
+    ccache_entry_t* older = e->older;
+    ccache_entry_free(cc, e);
+    e = older;
+  }
+  cc->retired = NULL;
+  memset(cc->buckets, 0, sizeof(cc->buckets));
+  cc->oldest = cc->newest = NULL;
+  cc->size = 0;
+}
+
+ic_private void ccache_free(ccache_t* cc) {
+  if (cc == NULL) return;
+  ccache_clear(cc);
+  mem_free(cc->mem, cc);
+}
+
+
+//-------------------------------------------------------------
+// Lookup
+//-------------------------------------------------------------
+
+// FNV-1a
+static uint64_t ccache_hash(const char* key, ssize_t len) {
+  uint64_t h = 0xCBF29CE484222325ULL;
+  for (ssize_t i = 0; i < len; i++) {
+    h ^= (uint8_t)key[i];
+    h *= 0x100000001B3ULL;
+  }
+  return h;
+}
+
+// build the key `id \0 prefix` in `buf` (or allocate if it is too small)
+static char* ccache_key(ccache_t* cc, const char* id, const char* prefix, char* buf, ssize_t buflen, ssize_t* len) {
+  if (id == NULL) id = "";
+  if (prefix == NULL) prefix = "";
+  const ssize_t idlen = ic_strlen(id);
+  const ssize_t plen  = ic_strlen(prefix);
+  *len = idlen + 1 + plen;
+  char* key = (*len < buflen ? buf : mem_malloc_tp_n(cc->mem, char, *len + 1));
+  if (key == NULL) return NULL;
+  ic_memcpy(key, id, idlen + 1);
+  ic_memcpy(key + idlen + 1, prefix, plen + 1);
+  return key;
+}
+
+static bool ccache_entry_is(const ccache_entry_t* e, const char* key, ssize_t len, uint64_t hash) {
+  return (e->hash == hash && e->key_len == len && memcmp(e->key, key, to_size_t(len)) == 0);
+}
+
+// find the bucket slot that points to the entry (only used by a writer)
+static ccache_entry_t** ccache_find(ccache_t* cc, const char* key, ssize_t len, uint64_t hash) {
+  ccache_entry_t** pe = &cc->buckets[hash % IC_CCACHE_BUCKETS];
+  while (*pe != NULL && !ccache_entry_is(*pe, key, len, hash)) {
+    pe = &(*pe)->next;
+  }
+  return pe;
+}
+
+// unlink the entry at `pe` and retire it
+static void ccache_delete(ccache_t* cc, ccache_entry_t** pe) {
+  ccache_entry_t* e = *pe;
+  ccache_store(pe, e->next);
+  if (e->older != NULL) { e->older->newer = e->newer; } else { cc->oldest = e->newer; }
+  if (e->newer != NULL) { e->newer->older = e->older; } else { cc->newest = e->older; }
+  cc->size -= e->size;
+  e->older = cc->retired;
+  e->newer = NULL;
+  cc->retired = e;
+}
+
+static void ccache_delete_entry(ccache_t* cc, ccache_entry_t* e) {
+  ccache_entry_t** pe = &cc->buckets[e->hash % IC_CCACHE_BUCKETS];
+  while (*pe != e) { pe = &(*pe)->next; }
+  ccache_delete(cc, pe);
+}
+
+// evict expired entries, and then the oldest ones, until `extra` bytes fit
+static void ccache_evict(ccache_t* cc, ssize_t extra) {
+  if (cc->size + extra <= cc->max_size) return;
+  const int64_t now = ic_time_usecs();
+  ccache_entry_t* e = cc->oldest;
+  while (e != NULL) {
+    ccache_entry_t* newer = e->newer;
+    if (e->expires <= now) { ccache_delete_entry(cc, e); }
+    e = newer;
+  }
+  while (cc->oldest != NULL && cc->size + extra > cc->max_size) {
+    ccache_delete_entry(cc, cc->oldest);
+  }
+}
+
+ic_private void ccache_set_limit(ccache_t* cc, ssize_t max_bytes) {
+  if (cc == NULL) return;
+  ccache_lock(cc);
+  cc->max_size = (max_bytes < 0 ? 0 : max_bytes);
+  ccache_evict(cc, 0);
+  ccache_reclaim(cc);
+  ccache_unlock(cc);
+}
+
+// lock-free; an expired entry is skipped and left to the writers to evict
+ic_private bool ccache_get(ccache_t* cc, ic_completion_env_t* cenv, const char* id, const char* prefix) {
+  if (cc == NULL) return false;
+  char buf[256];
+  ssize_t len;
+  char* key = ccache_key(cc, id, prefix, buf, ssizeof(buf), &len);
+  if (key == NULL) return false;
+  const uint64_t hash = ccache_hash(key, len);
+  ccache_add(&cc->readers, 1);
+  ccache_entry_t* e = ccache_load(&cc->buckets[hash % IC_CCACHE_BUCKETS]);
+  while (e != NULL && !ccache_entry_is(e, key, len, hash)) {
+    e = ccache_load(&e->next);
+  }
+  const bool found = (e != NULL && e->expires > ic_time_usecs());
+  if (found) {
+    for (ssize_t i = 0; i < e->count; i++) {
+      const ccache_item_t* item = &e->items[i];
+      if (!ic_add_completion_prim(cenv, item->replacement, item->display, item->help, item->delete_before, item->delete_after)) break;
+    }
+  }
+  ccache_add(&cc->readers, -1);
+  if (key != buf) { mem_free(cc->mem, key); }
+  return found;
+}
+
+ic_private void ccache_remove(ccache_t* cc, const char* id, const char* prefix) {
+  if (cc == NULL) return;
+  char buf[256];
+  ssize_t len;
+  char* key = ccache_key(cc, id, prefix, buf, ssizeof(buf), &len);
+  if (key == NULL) return;
+  ccache_lock(cc);
+  ccache_entry_t** pe = ccache_find(cc, key, len, ccache_hash(key, len));
+  if (*pe != NULL) { ccache_delete(cc, pe); }
+  ccache_reclaim(cc);
+  ccache_unlock(cc);
+  if (key != buf) { mem_free(cc->mem, key); }
+}
+
+
+//-------------------------------------------------------------
+// Adding entries
+//-------------------------------------------------------------
+
+ic_private ccache_entry_t* ccache_entry_new(ccache_t* cc, const char* id, const char* prefix, long ttl_ms) {
+  if (cc == NULL || ttl_ms <= 0) return NULL;
+  ccache_entry_t* e = mem_zalloc_tp(cc->mem, ccache_entry_t);
+  if (e == NULL) return NULL;
+  char* key = ccache_key(cc, id, prefix, NULL, 0, &e->key_len);
+  if (key == NULL) {
+    mem_free(cc->mem, e);
+    return NULL;
+  }
+  e->key     = key;
+  e->hash    = ccache_hash(key, e->key_len);
+  e->expires = ic_time_usecs() + 1000*(int64_t)ttl_ms;
+  e->size    = ssizeof(ccache_entry_t) + e->key_len + 1;
+  return e;
+}
+
+ic_private bool ccache_entry_add(ccache_t* cc, ccache_entry_t* e, const char* replacement, const char* display, const char* help, long delete_before, long delete_after) {
+  if (e == NULL || replacement == NULL) return false;
+  if (e->count >= e->len) {
+    const ssize_t newlen = (e->len <= 0 ? 16 : 2*e->len);
+    ccache_item_t* newitems = mem_realloc_tp(cc->mem, ccache_item_t, e->items, newlen);
+    if (newitems == NULL) return false;
+    e->size += (newlen - e->len) * ssizeof(ccache_item_t);
+    e->items = newitems;
+    e->len = newlen;
+  }
+  ccache_item_t* item = &e->items[e->count];
+  item->replacement   = mem_strdup(cc->mem, replacement);
+  item->display       = (display != NULL ? mem_strdup(cc->mem, display) : NULL);
+  item->help          = (help != NULL ? mem_strdup(cc->mem, help) : NULL);
+  item->delete_before = delete_before;
+  item->delete_after  = delete_after;
+  e->count++;  // count first so the strings are freed with the entry even on failure
+  if (item->replacement == NULL || (display != NULL && item->display == NULL) || (help != NULL && item->help == NULL)) return false;
+  e->size += ic_strlen(replacement) + 1 + (display != NULL ? ic_strlen(display) + 1 : 0) + (help != NULL ? ic_strlen(help) + 1 : 0);
+  return true;
+}
+
+// publish the entry (and take ownership); an entry larger than the limit is dropped
+ic_private void ccache_put(ccache_t* cc, ccache_entry_t* e) {
+  if (cc == NULL || e == NULL) return;
+  ccache_lock(cc);
+  ccache_entry_t** pe = ccache_find(cc, e->key, e->key_len, e->hash);
+  if (*pe != NULL) { ccache_delete(cc, pe); }
+  if (e->size > cc->max_size) {
+    ccache_entry_free(cc, e);
+  }
+  else {
+    ccache_evict(cc, e->size);
+    e->older = cc->newest;
+    e->newer = NULL;
+    if (cc->newest != NULL) { cc->newest->newer = e; } else { cc->oldest = e; }
+    cc->newest = e;
+    cc->size += e->size;
+    pe = &cc->buckets[e->hash % IC_CCACHE_BUCKETS];
+    e->next = *pe;
+    ccache_store(pe, e);  // publish
+  }
+  ccache_reclaim(cc);
+  ccache_unlock(cc);
+}
+
+
+//-------------------------------------------------------------
+// Public API
+//-------------------------------------------------------------
+
+ic_public bool ic_completion_cache_get(ic_completion_env_t* cenv, const char* id, const char* prefix) {
+  if (cenv == NULL) return false;
+  return ccache_get(cenv->env->ccache, cenv, id, prefix);
+}
+
+ic_public bool ic_completion_cache_put(const char* id, const char* prefix, const char** completions, const char** displays, const char** helps, long ttl_ms) {
+  ic_env_t* env = ic_get_env(); if (env==NULL) return false;
+  if (ttl_ms <= 0 || completions == NULL) {
+    ccache_remove(env->ccache, id, prefix);
+    return (ttl_ms <= 0);
+  }
+  ccache_t* cc = env->ccache;
+  ccache_entry_t* e = ccache_entry_new(cc, id, prefix, ttl_ms);
+  if (e == NULL) return false;
+  for (ssize_t i = 0; completions[i] != NULL; i++) {
+    if (!ccache_entry_add(cc, e, completions[i], (displays != NULL ? displays[i] : NULL), (helps != NULL ? helps[i] : NULL), 0, 0)) {
+      ccache_entry_free(cc, e);
+      return false;
+    }
+  }
+  ccache_put(cc, e);
+  return true;
+}
+
+ic_public void ic_set_completion_cache_limit(long max_bytes) {
+  ic_env_t* env = ic_get_env(); if (env==NULL) return;
+  ccache_set_limit(env->ccache, max_bytes);
+}
+
+ic_public long ic_set_filename_cache_ttl(long ttl_ms) {
+  ic_env_t* env = ic_get_env(); if (env==NULL) return 0;
+  const long prev = env->filename_cache_ttl;
+  env->filename_cache_ttl = (ttl_ms < 0 ? 0 : ttl_ms);
+  return prev;
+}
+
+
+//-------------------------------------------------------------
+// Caching the result of a completer: a completion closure
+// that records every completion that is passed on.
+//-------------------------------------------------------------
+
+typedef struct ccache_closure_s {
+  ccache_t*             cc;
+  ccache_entry_t*       entry;
+  bool                  complete;   // were all completions recorded?
+  void*                 prev_env;
+  ic_completion_fun_t*  prev_complete;
+} ccache_closure_t;
+
+static bool ccache_add_completion(ic_env_t* env, void* closure, const char* replacement, const char* display, const char* help, long delete_before, long delete_after) {
+  ccache_closure_t* cenv = (ccache_closure_t*)closure;
+  (*cenv->prev_complete)(env, cenv->prev_env, replacement, display, help, delete_before, delete_after);
+  // keep going even if the caller has enough (for a hint for example) so the cached entry is complete
+  if (cenv->entry->count >= IC_MAX_COMPLETIONS_TO_SHOW || !ccache_entry_add(cenv->cc, cenv->entry, replacement, display, help, delete_before, delete_after)) {
+    cenv->complete = false;
+    return false;
+  }
+  return true;
+}
+
+// Complete `prefix` using the cache for `id` (if `ttl_ms > 0`), and otherwise call `fun` and cache its result.
+ic_private void ccache_complete(ic_completion_env_t* cenv, const char* id, const char* prefix, ic_completer_fun_t* fun, long ttl_ms) {
+  ccache_t* cc = (ttl_ms > 0 ? cenv->env->ccache : NULL);
+  if (cc == NULL) {
+    (*fun)(cenv, prefix);
+    return;
+  }
+  if (ccache_get(cc, cenv, id, prefix)) return;
+  ccache_closure_t closure;
+  closure.cc = cc;
+  closure.entry = ccache_entry_new(cc, id, prefix, ttl_ms);
+  closure.complete = true;
+  closure.prev_env = cenv->closure;
+  closure.prev_complete = cenv->complete;
+  if (closure.entry == NULL) {
+    (*fun)(cenv, prefix);
+    return;
+  }
+  cenv->closure  = &closure;
+  cenv->complete = &ccache_add_completion;
+  (*fun)(cenv, prefix);
+  cenv->closure  = closure.prev_env;
+  cenv->complete = closure.prev_complete;
+  if (closure.complete) {
+    ccache_put(cc, closure.entry);
+  }
+  else {
+    ccache_entry_free(cc, closure.entry);
+  }
+}
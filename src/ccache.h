@@ -0,0 +1,47 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2021, Daan Leijen
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+-----------------------------------------------------------------------------*/
+#pragma once
+#ifndef IC_CCACHE_H
+#define IC_CCACHE_H
+
+#include "common.h"
+#include "completions.h"
+
+//-------------------------------------------------------------
+// Completion cache: completions of slow completers keyed by a
+// completer id and prefix, which expire after a time-to-live
+// and are evicted (oldest first) to stay within a memory bound.
+// Lookups are lock-free and writers are serialized, so the cache
+// can be used from any thread.
+//-------------------------------------------------------------
+
+#define IC_CCACHE_MAX_BYTES  (1024*1024L)
+
+struct ccache_s;
+typedef struct ccache_s ccache_t;
+
+struct ccache_entry_s;
+typedef struct ccache_entry_s ccache_entry_t;
+
+ic_private ccache_t* ccache_new(alloc_t* mem);
+ic_private void      ccache_free(ccache_t* cc);
+ic_private void      ccache_set_limit(ccache_t* cc, ssize_t max_bytes);  // evicts entries if needed
+
+// Add the cached completions (if not expired) to `cenv`; returns false if there is no entry
+ic_private bool      ccache_get(ccache_t* cc, ic_completion_env_t* cenv, const char* id, const char* prefix);
+ic_private void      ccache_remove(ccache_t* cc, const char* id, const char* prefix);
+
+// Build a new entry: it only becomes visible after `ccache_put` (which replaces any previous entry).
+ic_private ccache_entry_t* ccache_entry_new(ccache_t* cc, const char* id, const char* prefix, long ttl_ms);
+ic_private bool      ccache_entry_add(ccache_t* cc, ccache_entry_t* e, const char* replacement, const char* display, const char* help, long delete_before, long delete_after);
+ic_private void      ccache_entry_free(ccache_t* cc, ccache_entry_t* e);
+ic_private void      ccache_put(ccache_t* cc, ccache_entry_t* e);
+
+// Complete using the cached entry for `id` and `prefix`, or otherwise call `fun` and cache its completions for `ttl_ms`.
+ic_private void      ccache_complete(ic_completion_env_t* cenv, const char* id, const char* prefix, ic_completer_fun_t* fun, long ttl_ms);
+
+#endif // IC_CCACHE_H
@@ -11,6 +11,13 @@
 #include <stdlib.h>
 #include "common.h"
 
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <time.h>
+#include <sys/time.h>
+#endif
+
 
 //-------------------------------------------------------------
 // String wrappers for ssize_t
@@ -158,6 +165,30 @@ ic_private bool ic_icontains(const char* big, const char* s) {
   return (ic_stristr(big,s) != NULL);
 }
 
+// Find the first occurrence of `pat` in `s`. We skip ahead with `memchr` 
+// (which is vectorized in most C libraries) and only compare at candidates. 
+ic_private ssize_t ic_memmem(const char* s, ssize_t len, const char* pat, ssize_t patlen) {
+  if (s == NULL || pat == NULL || patlen <= 0 || len < patlen) return -1;
+  const char* p = s;
+  const char* last = s + (len - patlen);  // last possible start
+  while (p <= last) {
+    p = (const char*)memchr(p, pat[0], to_size_t(last - p + 1));
+    if (p == NULL) return -1;
+    if (memcmp(p + 1, pat + 1, to_size_t(patlen - 1)) == 0) return (p - s);
+    p++;
+  }
+  return -1;
+}
+
+// Find the last occurrence of `pat` in `s`.
+ic_private ssize_t ic_memrmem(const char* s, ssize_t len, const char* pat, ssize_t patlen) {
+  if (s == NULL || pat == NULL || patlen <= 0 || len < patlen) return -1;
+  for (ssize_t i = len - patlen; i >= 0; i--) {
+    if (s[i] == pat[0] && memcmp(s + i + 1, pat + 1, to_size_t(patlen - 1)) == 0) return i;
+  }
+  return -1;
+}
+
 
 //-------------------------------------------------------------
 // Unicode
@@ -301,6 +332,40 @@ ic_private void debug_msg(const char* fmt, ...) {
 #endif
 
 
+//-------------------------------------------------------------
+// Time
+//-------------------------------------------------------------
+
+ic_private int64_t ic_time_usecs(void) {
+  #if defined(_WIN32)
+  static LARGE_INTEGER freq;
+  if (freq.QuadPart == 0) { QueryPerformanceFrequency(&freq); }
+  LARGE_INTEGER t;
+  QueryPerformanceCounter(&t);
+  return (int64_t)((t.QuadPart * 1000000) / (freq.QuadPart > 0 ? freq.QuadPart : 1));
+  #elif defined(CLOCK_MONOTONIC)
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return ((int64_t)t.tv_sec * 1000000) + (t.tv_nsec / 1000);
+  #else
+  struct timeval t;
+  gettimeofday(&t, NULL);
+  return ((int64_t)t.tv_sec * 1000000) + t.tv_usec;
+  #endif
+}
+
+ic_private void ic_sleep_usecs(int64_t usecs) {
+  if (usecs <= 0) return;
+  #if defined(_WIN32)
+  Sleep((DWORD)((usecs + 999) / 1000));
+  #else
+  struct timespec t;
+  t.tv_sec  = (time_t)(usecs / 1000000);
+  t.tv_nsec = (long)((usecs % 1000000) * 1000);
+  nanosleep(&t, NULL);
+  #endif
+}
+
 //-------------------------------------------------------------
 // Allocation
 //-------------------------------------------------------------
@@ -65,6 +65,8 @@ ic_private bool    ic_strncpy(char* dest, ssize_t dest_size /* including 0 */, c
 
 ic_private bool    ic_contains(const char* big, const char* s);
 ic_private bool    ic_icontains(const char* big, const char* s);
+ic_private ssize_t ic_memmem(const char* s, ssize_t len, const char* pat, ssize_t patlen);  // -1 if not found
+ic_private ssize_t ic_memrmem(const char* s, ssize_t len, const char* pat, ssize_t patlen); // last occurrence
 ic_private char    ic_tolower(char c);
 ic_private void    ic_str_tolower(char* s);
 ic_private int     ic_stricmp(const char* s1, const char* s2);
@@ -152,6 +154,10 @@ ic_private ic_color_t ic_rgbx(ssize_t r, ssize_t g, ssize_t b);
 ic_private void debug_msg( const char* fmt, ... );
 #endif
 
+// Monotonic time in micro-seconds (used to measure callbacks)
+ic_private int64_t ic_time_usecs(void);
+ic_private void    ic_sleep_usecs(int64_t usecs);
+
 
 //-------------------------------------------------------------
 // Abstract environment
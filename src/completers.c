@@ -6,6 +6,13 @@
 -----------------------------------------------------------------------------*/
 #include <string.h>
 #include <stdio.h>
+#ifdef _WIN32
+#include <direct.h>
+#define ic_getcwd  _getcwd
+#else
+#include <unistd.h>
+#define ic_getcwd  getcwd
+#endif
 
 #include "../include/isocline.h"
 #include "common.h"
@@ -42,14 +49,22 @@ ic_public void ic_complete_word(ic_completion_env_t* cenv, const char* prefix, i
   
   ssize_t len = ic_strlen(prefix);
   ssize_t pos = len; // will be start of the 'word' (excluding a potential start quote)
-  while (pos > 0) {
-    // go back one code point
-    ssize_t ofs = str_prev_ofs(prefix, pos, NULL);
-    if (ofs <= 0) break;
-    if (!(*is_word_char)(prefix + (pos - ofs), (long)ofs)) { 
-      break;
+  int classes;
+  bool negate;
+  if (ic_char_class_of(is_word_char, &classes, &negate)) {
+    // builtin character class: scan back with table lookups
+    pos = str_scan_back_while(prefix, len, classes, negate);
+  }
+  else {
+    while (pos > 0) {
+      // go back one code point
+      ssize_t ofs = str_prev_ofs(prefix, pos, NULL);
+      if (ofs <= 0) break;
+      if (!(*is_word_char)(prefix + (pos - ofs), (long)ofs)) { 
+        break;
+      }
+      pos -= ofs;
     }
-    pos -= ofs;
   }
   if (pos < 0) { pos = 0; }
   
@@ -596,6 +611,7 @@ typedef struct filename_closure_s {
   const char* roots;
   const char* extensions;
   char        dir_sep;
+  const char* cache_id;   // identifies the roots, extensions, and separator in the completion cache
 } filename_closure_t;
 
 static void filename_completer( ic_completion_env_t* cenv, const char* prefix ) {
@@ -662,6 +678,47 @@ static void filename_completer( ic_completion_env_t* cenv, const char* prefix )
   sbuf_free(dir_prefix);
 }
 
+static void filename_completer_cached( ic_completion_env_t* cenv, const char* prefix ) {
+  const filename_closure_t* fclosure = (const filename_closure_t*)cenv->arg;
+  if (fclosure->cache_id == NULL) {
+    filename_completer(cenv, prefix);
+  }
+  else {
+    ccache_complete(cenv, fclosure->cache_id, prefix, &filename_completer, cenv->env->filename_cache_ttl);
+  }
+}
+
+//-------------------------------------------------------------
+// Complete words from the history
+//-------------------------------------------------------------
+
+static void history_word_completer( ic_completion_env_t* cenv, const char* prefix ) {
+  if (prefix == NULL) return;
+  // the words in the history are without quotes
+  const char quote = (prefix[0] == '\'' || prefix[0] == '"' ? prefix[0] : 0);
+  if (quote != 0) prefix++;
+  if (prefix[0] == 0) return;
+  const char* matches[IC_MAX_COMPLETIONS_TO_TRY];
+  const ssize_t n = history_match_tokens(cenv->env->history, prefix, matches, IC_MAX_COMPLETIONS_TO_TRY);
+  stringbuf_t* sbuf = (quote != 0 ? sbuf_new(cenv->env->mem) : NULL);
+  for (ssize_t i = 0; i < n; i++) {
+    const char* word = matches[i];
+    if (sbuf != NULL) {
+      sbuf_replace(sbuf, "");
+      sbuf_append_char(sbuf, quote);
+      sbuf_append(sbuf, matches[i]);
+      word = sbuf_string(sbuf);
+    }
+    if (!ic_add_completion(cenv, word)) break;
+  }
+  sbuf_free(sbuf);
+}
+
+ic_public void ic_complete_history_word( ic_completion_env_t* cenv, const char* prefix ) {
+  ic_complete_word( cenv, prefix, &history_word_completer, &ic_char_is_filename_letter );
+}
+
+
 ic_public void ic_complete_filename( ic_completion_env_t* cenv, const char* prefix, char dir_sep, const char* roots, const char* extensions ) {
   if (roots == NULL) roots = ".";
   if (extensions == NULL) extensions = "";
@@ -670,6 +727,15 @@ ic_public void ic_complete_filename( ic_completion_env_t* cenv, const char* pref
   fclosure.dir_sep = dir_sep;
   fclosure.roots = roots; 
   fclosure.extensions = extensions;
+  fclosure.cache_id = NULL;
   cenv->arg = &fclosure;
-  ic_complete_qword_ex( cenv, prefix, &filename_completer, &ic_char_is_filename_letter, '\\', "'\"");  
+  stringbuf_t* cache_id = NULL;
+  // the id includes the current directory as relative roots (like the default ".") change with it
+  char cwd[1024];
+  if (cenv->env->filename_cache_ttl > 0 && ic_getcwd(cwd, sizeof(cwd)) != NULL && (cache_id = sbuf_new(cenv->env->mem)) != NULL) {
+    sbuf_appendf(cache_id, "ic-filename:%c:%s:%s:%s", dir_sep, roots, extensions, cwd);
+    fclosure.cache_id = sbuf_string(cache_id);
+  }
+  ic_complete_qword_ex( cenv, prefix, &filename_completer_cached, &ic_char_is_filename_letter, '\\', "'\"");  
+  sbuf_free(cache_id);
 }
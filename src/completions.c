@@ -25,6 +25,11 @@ typedef struct completion_s {
   const char* help;
   ssize_t     delete_before;
   ssize_t     delete_after;
+  ic_completion_info_fun_t* info;  // if not NULL, computes the display or help on demand (see `lazy_display` and `lazy_help`)
+  void*       info_arg;
+  const char* info_completion;     // completion as passed to `info` (NULL if equal to `replacement`)
+  bool        lazy_display;        // the display is not yet computed?
+  bool        lazy_help;           // the help is not yet computed?
 } completion_t;
 
 struct completions_s {
@@ -34,6 +39,9 @@ struct completions_s {
   ssize_t count;
   ssize_t len;
   completion_t* elems;
+  ic_completion_info_fun_t* add_info;  // set during `ic_add_completion_lazy`
+  void* add_info_arg;
+  const char* add_info_completion;
   alloc_t* mem;
 };
 
@@ -66,6 +74,7 @@ ic_private void completions_clear(completions_t* cms) {
     mem_free( cms->mem, cm->display);
     mem_free( cms->mem, cm->replacement);
     mem_free( cms->mem, cm->help);
+    mem_free( cms->mem, cm->info_completion);
     memset(cm,0,sizeof(*cm));
     cms->count--;    
   }
@@ -87,6 +96,15 @@ static void completions_push(completions_t* cms, const char* replacement, const
   cm->help          = mem_strdup(cms->mem,help);
   cm->delete_before = delete_before;
   cm->delete_after  = delete_after;
+  cm->info          = cms->add_info;
+  cm->info_arg      = cms->add_info_arg;
+  cm->info_completion = NULL;
+  cm->lazy_display  = (cm->info != NULL && display == NULL);
+  cm->lazy_help     = (cm->info != NULL && help == NULL);
+  if (cm->info != NULL && strcmp(cms->add_info_completion, replacement) != 0) {
+    // the replacement was transformed (quoted for example)
+    cm->info_completion = mem_strdup(cms->mem, cms->add_info_completion);
+  }
   cms->count++;
 }
 
@@ -117,10 +135,24 @@ static completion_t* completions_get(completions_t* cms, ssize_t index) {
   return &cms->elems[index];
 }
 
+// compute a lazy display or help (only once)
+static void completion_force(completions_t* cms, completion_t* cm, bool display, bool help) {
+  const char* completion = (cm->info_completion != NULL ? cm->info_completion : cm->replacement);
+  if (display && cm->lazy_display) {
+    cm->lazy_display = false;
+    cm->display = mem_strdup(cms->mem, (*cm->info)(completion, cm->info_arg, false));
+  }
+  if (help && cm->lazy_help) {
+    cm->lazy_help = false;
+    cm->help = mem_strdup(cms->mem, (*cm->info)(completion, cm->info_arg, true));
+  }
+}
+
 ic_private const char* completions_get_display( completions_t* cms, ssize_t index, const char** help ) {
   if (help != NULL) { *help = NULL;  }
   completion_t* cm = completions_get(cms, index);
   if (cm == NULL) return NULL;
+  completion_force(cms, cm, true, help != NULL);
   if (help != NULL) { *help = cm->help; }
   return (cm->display != NULL ? cm->display : cm->replacement);
 }
@@ -128,6 +160,7 @@ ic_private const char* completions_get_display( completions_t* cms, ssize_t inde
 ic_private const char* completions_get_help( completions_t* cms, ssize_t index ) {
   completion_t* cm = completions_get(cms, index);
   if (cm == NULL) return NULL;
+  completion_force(cms, cm, false, true);
   return cm->help;
 }
 
@@ -135,6 +168,7 @@ ic_private const char* completions_get_hint(completions_t* cms, ssize_t index, c
   if (help != NULL) { *help = NULL; }
   completion_t* cm = completions_get(cms, index);
   if (cm == NULL) return NULL;
+  completion_force(cms, cm, false, help != NULL);
   ssize_t len = ic_strlen(cm->replacement);
   if (len < cm->delete_before) return NULL;
   const char* hint = (cm->replacement + cm->delete_before);
@@ -278,6 +312,20 @@ ic_public bool ic_add_completion_ex( ic_completion_env_t* cenv, const char* repl
   return ic_add_completion_prim(cenv,replacement,display,help,0,0);
 }
 
+ic_public bool ic_add_completion_lazy(ic_completion_env_t* cenv, const char* replacement, ic_completion_info_fun_t* info, void* arg) {
+  if (info == NULL) return ic_add_completion_ex(cenv, replacement, NULL, NULL);
+  // pass the callback on to `completions_push` (through any completion transformers)
+  completions_t* cms = cenv->env->completions;
+  cms->add_info = info;
+  cms->add_info_arg = arg;
+  cms->add_info_completion = replacement;
+  const bool cont = ic_add_completion_ex(cenv, replacement, NULL, NULL);
+  cms->add_info = NULL;
+  cms->add_info_arg = NULL;
+  cms->add_info_completion = NULL;
+  return cont;
+}
+
 ic_public bool ic_add_completion_prim(ic_completion_env_t* cenv, const char* replacement, const char* display, const char* help, long delete_before, long delete_after) {
   return (*cenv->complete)(cenv->env, cenv->closure, replacement, display, help, delete_before, delete_after );
 }
@@ -0,0 +1,268 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2021, Daan Leijen
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+-----------------------------------------------------------------------------*/
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "common.h"
+#include "draft.h"
+#include "stringbuf.h"
+
+//-------------------------------------------------------------
+// The draft journal is a text file with one record per line:
+//   =<text>              checkpoint: the full input
+//   +<pos>;<del>:<text>  edit: delete <del> bytes at <pos> and insert <text>
+// where <text> is escaped (\n, \t, \\, and \xHH). Each record is
+// written with a single flush, but never synced to disk, so
+// it survives a crash of the process or the session at little cost.
+// Every `IC_DRAFT_CHECKPOINT` edits the journal is replaced with
+// a single checkpoint (written to a temporary file first) to keep it small.
+//-------------------------------------------------------------
+
+#define IC_DRAFT_CHECKPOINT (64)
+
+struct draft_s {
+  const char*   fname;      // journal file
+  char*         tname;      // temporary file for a checkpoint
+  FILE*         f;          // open while editing
+  stringbuf_t*  last;       // last recorded input
+  stringbuf_t*  rec;        // record buffer
+  ssize_t       edits;      // edits since the last checkpoint
+  ssize_t       records;    // records written for the current input (for debugging)
+  int64_t       usecs;      // time spent writing them
+  int64_t       usecs_max;  // and the most time spent for a single record
+  bool          active;     // are we journaling an input?
+  alloc_t*      mem;
+};
+
+ic_private draft_t* draft_new(alloc_t* mem, const char* fname) {
+  if (fname == NULL) return NULL;
+  draft_t* d = mem_zalloc_tp(mem, draft_t);
+  if (d == NULL) return NULL;
+  d->mem   = mem;
+  d->fname = mem_strdup(mem, fname);
+  d->last  = sbuf_new(mem);
+  d->rec   = sbuf_new(mem);
+  const ssize_t tlen = ic_strlen(fname) + 5;
+  d->tname = mem_malloc_tp_n(mem, char, tlen);
+  if (d->fname == NULL || d->tname == NULL || d->last == NULL || d->rec == NULL) {
+    draft_free(d);
+    return NULL;
+  }
+  snprintf(d->tname, to_size_t(tlen), "%s.tmp", fname);
+  return d;
+}
+
+ic_private void draft_free(draft_t* d) {
+  if (d == NULL) return;
+  if (d->f != NULL) { fclose(d->f); }
+  mem_free(d->mem, d->fname);
+  mem_free(d->mem, d->tname);
+  sbuf_free(d->last);
+  sbuf_free(d->rec);
+  mem_free(d->mem, d);
+}
+
+
+//-------------------------------------------------------------
+// Encoding
+//-------------------------------------------------------------
+
+static void draft_append_escaped(stringbuf_t* sbuf, const char* s, ssize_t n) {
+  static const char* hexdigits = "0123456789ABCDEF";
+  for (ssize_t i = 0; i < n; i++) {
+    const char c = s[i];
+    if (c == '\\')      { sbuf_append(sbuf, "\\\\"); }
+    else if (c == '\n') { sbuf_append(sbuf, "\\n"); }
+    else if (c == '\t') { sbuf_append(sbuf, "\\t"); }
+    else if ((uint8_t)c < ' ' || c == 0x7F) {
+      sbuf_append(sbuf, "\\x");
+      sbuf_append_char(sbuf, hexdigits[(uint8_t)c / 16]);
+      sbuf_append_char(sbuf, hexdigits[(uint8_t)c % 16]);
+    }
+    else { sbuf_append_char(sbuf, c); }
+  }
+}
+
+static int draft_xdigit(char c) {
+  if (c >= '0' && c <= '9') return (c - '0');
+  if (c >= 'A' && c <= 'F') return (10 + (c - 'A'));
+  if (c >= 'a' && c <= 'f') return (10 + (c - 'a'));
+  return -1;
+}
+
+static bool draft_unescape(const char* s, stringbuf_t* sbuf) {
+  sbuf_clear(sbuf);
+  while (*s != 0) {
+    char c = *s++;
+    if (c == '\\') {
+      c = *s++;
+      if (c == 'n')       { sbuf_append_char(sbuf, '\n'); }
+      else if (c == 't')  { sbuf_append_char(sbuf, '\t'); }
+      else if (c == '\\') { sbuf_append_char(sbuf, '\\'); }
+      else if (c == 'x') {
+        const int c1 = (s[0] != 0 ? draft_xdigit(s[0]) : -1);
+        const int c2 = (c1 >= 0 ? draft_xdigit(s[1]) : -1);
+        if (c2 < 0) return false;
+        sbuf_append_char(sbuf, (char)(c1*16 + c2));
+        s += 2;
+      }
+      else return false;
+    }
+    else { sbuf_append_char(sbuf, c); }
+  }
+  return true;
+}
+
+
+//-------------------------------------------------------------
+// Journal
+//-------------------------------------------------------------
+
+static void draft_write_rec(draft_t* d) {
+  if (d->f == NULL) return;
+  fputs(sbuf_string(d->rec), d->f);
+  fflush(d->f);  // one write per record; no sync
+}
+
+// write the checkpoint to a temporary file and rename it over the journal
+// so a crash never leaves a truncated journal; then reopen it for appending
+static void draft_checkpoint(draft_t* d) {
+  if (d->f != NULL) {
+    fclose(d->f);
+    d->f = NULL;
+  }
+  d->edits = 0;
+  FILE* f = fopen(d->tname, "w");
+  if (f == NULL) return;
+  #ifndef _WIN32
+  chmod(d->tname, S_IRUSR|S_IWUSR);
+  #endif
+  bool ok = true;
+  if (sbuf_len(d->last) > 0) {  // an empty journal is an empty draft
+    sbuf_replace(d->rec, "=");
+    draft_append_escaped(d->rec, sbuf_string(d->last), sbuf_len(d->last));
+    sbuf_append_char(d->rec, '\n');
+    ok = (fputs(sbuf_string(d->rec), f) >= 0);
+  }
+  ok = (fclose(f) == 0) && ok;
+  #ifdef _WIN32
+  if (ok) { remove(d->fname); }  // rename does not replace an existing file on Windows
+  #endif
+  if (!ok || rename(d->tname, d->fname) != 0) {
+    remove(d->tname);
+    return;
+  }
+  d->f = fopen(d->fname, "a");
+}
+
+// the journal file is only created at the first edit
+ic_private void draft_start(draft_t* d, const char* input) {
+  if (d == NULL) return;
+  sbuf_replace(d->last, (input == NULL ? "" : input));
+  d->active = true;
+  if (sbuf_len(d->last) > 0) { draft_checkpoint(d); }
+}
+
+ic_private void draft_record(draft_t* d, const char* input) {
+  if (d == NULL || !d->active || input == NULL) return;
+  // find the changed part between the last and the new input
+  const char* prev = sbuf_string(d->last);
+  const ssize_t plen = sbuf_len(d->last);
+  const ssize_t len  = ic_strlen(input);
+  ssize_t start = 0;
+  while (start < plen && start < len && prev[start] == input[start]) { start++; }
+  ssize_t end = 0;   // length of the common suffix (not overlapping the prefix)
+  while (end < plen - start && end < len - start && prev[plen - end - 1] == input[len - end - 1]) { end++; }
+  const ssize_t del = plen - start - end;
+  const ssize_t ins = len - start - end;
+  if (del == 0 && ins == 0) return;  // no change
+  const int64_t t0 = ic_time_usecs();
+  sbuf_replace(d->last, input);
+  // checkpoint at the start and periodically
+  d->edits++;
+  if (d->f == NULL || d->edits >= IC_DRAFT_CHECKPOINT) {
+    draft_checkpoint(d);
+  }
+  else {
+    // otherwise append an edit record
+    sbuf_clear(d->rec);
+    sbuf_appendf(d->rec, "+%zd;%zd:", start, del);
+    draft_append_escaped(d->rec, input + start, ins);
+    sbuf_append_char(d->rec, '\n');
+    draft_write_rec(d);
+  }
+  // measure the cost per key
+  const int64_t t = ic_time_usecs() - t0;
+  d->records++;
+  d->usecs += t;
+  if (t > d->usecs_max) { d->usecs_max = t; }
+}
+
+ic_private void draft_done(draft_t* d) {
+  if (d == NULL || !d->active) return;
+  d->active = false;
+  sbuf_clear(d->last);
+  if (d->f != NULL) {
+    fclose(d->f);
+    d->f = NULL;
+  }
+  remove(d->fname);  // also if it could not be reopened after a checkpoint
+  if (d->records > 0) {
+    debug_msg("draft: %zd records: %lld us on average, at most %lld us\n", d->records, (long long)(d->usecs / d->records), (long long)d->usecs_max);
+  }
+  d->records = 0;
+  d->usecs = 0;
+  d->usecs_max = 0;
+}
+
+// replay the journal; stop at the first invalid (likely partially written) record
+ic_private char* draft_restore(draft_t* d) {
+  if (d == NULL) return NULL;
+  FILE* f = fopen(d->fname, "r");
+  if (f == NULL) return NULL;
+  stringbuf_t* text = sbuf_new(d->mem);
+  stringbuf_t* arg  = sbuf_new(d->mem);
+  if (text != NULL && arg != NULL) {
+    bool ok = true;
+    while (ok) {
+      // read a line
+      sbuf_clear(d->rec);
+      int c;
+      while ((c = fgetc(f)) != EOF && c != '\n') { sbuf_append_char(d->rec, (char)c); }
+      if (c == EOF) break;  // the last record must be complete
+      const char* line = sbuf_string(d->rec);
+      if (line[0] == '=') {
+        ok = draft_unescape(line + 1, arg);
+        if (ok) { sbuf_replace(text, sbuf_string(arg)); }
+      }
+      else if (line[0] == '+') {
+        ssize_t pos = -1;
+        ssize_t del = -1;
+        const char* colon = strchr(line, ':');
+        ok = (colon != NULL && ic_atoz2(line + 1, &pos, &del) && pos >= 0 && del >= 0 &&
+              pos + del <= sbuf_len(text) && draft_unescape(colon + 1, arg));
+        if (ok) {
+          sbuf_delete_at(text, pos, del);
+          sbuf_insert_at(text, sbuf_string(arg), pos);
+        }
+      }
+      else {
+        ok = false;
+      }
+    }
+    if (!ok) { debug_msg("draft: invalid record in %s\n", d->fname); }
+  }
+  fclose(f);
+  sbuf_free(arg);
+  char* res = NULL;
+  if (text != NULL && sbuf_len(text) > 0) {
+    res = sbuf_strdup(text);
+  }
+  sbuf_free(text);
+  return res;
+}
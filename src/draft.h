@@ -0,0 +1,29 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2021, Daan Leijen
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+-----------------------------------------------------------------------------*/
+#pragma once
+#ifndef IC_DRAFT_H
+#define IC_DRAFT_H
+
+#include "common.h"
+
+//-------------------------------------------------------------
+// Draft journal: persist the current input while editing
+// so it can be restored after a crash.
+//-------------------------------------------------------------
+
+struct draft_s;
+typedef struct draft_s draft_t;
+
+ic_private draft_t* draft_new(alloc_t* mem, const char* fname);
+ic_private void     draft_free(draft_t* d);
+
+ic_private char*    draft_restore(draft_t* d);                   // returns a left over draft (or NULL); caller frees
+ic_private void     draft_start(draft_t* d, const char* input);  // start journaling for a new input
+ic_private void     draft_record(draft_t* d, const char* input); // record the changes since the previous input
+ic_private void     draft_done(draft_t* d);                      // the input was accepted: remove the journal
+
+#endif // IC_DRAFT_H
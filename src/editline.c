@@ -6,6 +6,7 @@
 -----------------------------------------------------------------------------*/
 #include <stdio.h>
 #include <string.h>
+#include <stdlib.h>
 
 #include "common.h"
 #include "term.h"
@@ -13,9 +14,11 @@
 #include "env.h"
 #include "stringbuf.h"
 #include "history.h"
+#include "regex.h"
 #include "completions.h"
 #include "undo.h"
 #include "highlight.h"
+#include "vtext.h"
 
 //-------------------------------------------------------------
 // The editor state
@@ -35,6 +38,8 @@ typedef struct editor_s {
   ssize_t       termw;
   bool          modified;     // has a modification happened? (used for history navigation for example)  
   bool          disable_undo; // temporarily disable auto undo (for history search)
+  bool          enrich;       // was an insert only echoed? (then highlighting and hints are still pending)
+  bool          hint_pending; // was the input refreshed after an insert but is the hint still pending?
   ssize_t       history_idx;  // current index in the history 
   editstate_t*  undo;         // undo buffer  
   editstate_t*  redo;         // redo buffer
@@ -43,6 +48,13 @@ typedef struct editor_s {
   // caches
   attrbuf_t*    attrs;        // reuse attribute buffers 
   attrbuf_t*    attrs_extra; 
+  stringbuf_t*  find;         // pattern while finding in the input (NULL otherwise)
+  vtext_t*      vtexts;       // virtual text displayed in the input (annotations and the hint)
+  stringbuf_t*  view;         // the input composed with the virtual text
+  attrbuf_t*    view_attrs;
+  uint32_t*     view_hashes;  // hash of each visible row at the last refresh (if the view filled the screen)
+  ssize_t       view_rows;    // number of entries in `view_hashes` (0 if the screen content is unknown)
+  ssize_t       view_first_row; // first visible row at the last refresh
 } editor_t;
 
 
@@ -54,6 +66,7 @@ typedef struct editor_s {
 //-------------------------------------------------------------
 static char* edit_line( ic_env_t* env, const char* prompt_text );  // defined at bottom
 static void edit_refresh(ic_env_t* env, editor_t* eb);
+static void edit_find_highlight(ic_env_t* env, editor_t* eb, stringbuf_t* view, ssize_t promptw, ssize_t cpromptw, ssize_t first_row, ssize_t last_row);
 
 ic_private char* ic_editline(ic_env_t* env, const char* prompt_text) {
   tty_start_raw(env->tty);
@@ -61,7 +74,14 @@ ic_private char* ic_editline(ic_env_t* env, const char* prompt_text) {
   char* line = edit_line(env,prompt_text);
   term_end_raw(env->term,false);
   tty_end_raw(env->tty);
-  term_writeln(env->term,"");
+  if (env->rmodel != NULL) {
+    ssize_t len = 0;
+    const char* model = rmodel_done(env->rmodel, &len);
+    if (model != NULL && env->render != NULL) { env->render(model, (long)len, env->render_arg); }
+  }
+  else {
+    term_writeln(env->term,"");
+  }
   term_flush(env->term);
   return line;
 }
@@ -196,6 +216,9 @@ typedef struct refresh_info_s {
   bool        in_extra;
   ssize_t     first_row;
   ssize_t     last_row;
+  ssize_t     view_ofs;       // index in the view of `first_row`
+  uint32_t*   hashes;         // if not NULL, the row hashes (indexed by view row)
+  const bool* unchanged;      // if not NULL, rows that are already displayed correctly (indexed by view row)
 } refresh_info_t;
 
 static bool edit_refresh_rows_iter(
@@ -210,12 +233,18 @@ static bool edit_refresh_rows_iter(
   // debug_msg("edit: line refresh: row %zd, len: %zd\n", row, row_len);
   if (row < info->first_row) return false;
   if (row > info->last_row)  return true; // should not occur
+
+  // skip rows that are still on the screen
+  if (info->unchanged != NULL && info->unchanged[info->view_ofs + row - info->first_row]) {
+    if (row < info->last_row) { term_writeln(term, ""); }
+    return (row >= info->last_row);
+  }
   
   // term_clear_line(term);
   edit_write_prompt(info->env, info->eb, row, info->in_extra);
 
   //' write output
-  if (info->attrs == NULL || (info->env->no_highlight && info->env->no_bracematch)) {
+  if (info->attrs == NULL || (info->env->no_highlight && info->env->no_bracematch && info->eb->find == NULL)) {
     term_write_n( term, s + row_start, row_len );
   }
   else {
@@ -224,7 +253,7 @@ static bool edit_refresh_rows_iter(
 
   // write line ending
   if (row < info->last_row) {
-    if (is_wrap && tty_is_utf8(info->env->tty)) {       
+    if (is_wrap && tty_is_utf8(info->env->tty) && term_get_render_level(term) == 0) {       
       #ifndef __APPLE__
       bbcode_print( info->env->bbcode, "[ic-dim]\xE2\x86\x90");  // left arrow 
       #else
@@ -242,7 +271,7 @@ static bool edit_refresh_rows_iter(
 
 static void edit_refresh_rows(ic_env_t* env, editor_t* eb, stringbuf_t* input, attrbuf_t* attrs,
                                ssize_t promptw, ssize_t cpromptw, bool in_extra, 
-                                ssize_t first_row, ssize_t last_row) 
+                                ssize_t first_row, ssize_t last_row, ssize_t view_ofs, const bool* unchanged) 
 {
   if (input == NULL) return;
   refresh_info_t info;
@@ -252,9 +281,317 @@ static void edit_refresh_rows(ic_env_t* env, editor_t* eb, stringbuf_t* input, a
   info.in_extra   = in_extra;
   info.first_row  = first_row;
   info.last_row   = last_row;
+  info.view_ofs   = view_ofs;
+  info.hashes     = NULL;
+  info.unchanged  = unchanged;
   sbuf_for_each_row( input, eb->termw, promptw, cpromptw, &edit_refresh_rows_iter, &info, NULL);
 }
 
+//-------------------------------------------------------------
+// Row hashes: used to scroll the terminal instead of 
+// repainting every row when a full screen view moves by one row.
+//-------------------------------------------------------------
+
+static uint32_t edit_hash_bytes(uint32_t h, const void* p, ssize_t n) {
+  const uint8_t* b = (const uint8_t*)p;
+  for (ssize_t i = 0; i < n; i++) {
+    h = (h ^ b[i]) * 16777619U;  // FNV-1a
+  }
+  return h;
+}
+
+static bool edit_hash_rows_iter(
+    const char* s,
+    ssize_t row, ssize_t row_start, ssize_t row_len, 
+    ssize_t startw, bool is_wrap, const void* arg, void* res)
+{
+  ic_unused(res); ic_unused(startw);
+  const refresh_info_t* info = (const refresh_info_t*)(arg);
+  if (row < info->first_row) return false;
+  if (row > info->last_row)  return true; 
+
+  const char* prompt = (info->in_extra ? "" : (row == 0 ? info->eb->prompt_text : "\n"));
+  uint32_t h = edit_hash_bytes(2166136261U, prompt, ic_strlen(prompt) + 1);
+  h = edit_hash_bytes(h, s + row_start, row_len);
+  if (info->attrs != NULL && !(info->env->no_highlight && info->env->no_bracematch && info->eb->find == NULL)) {
+    h = edit_hash_bytes(h, attrbuf_attrs(info->attrs, row_start + row_len) + row_start, row_len * ssizeof(attr_t));
+  }
+  const uint8_t wrap = (is_wrap && row < info->last_row ? 1 : 0);
+  h = edit_hash_bytes(h, &wrap, 1);
+  info->hashes[info->view_ofs + row - info->first_row] = (h == 0 ? 1 : h);  // 0 is reserved for an unknown row
+  return (row >= info->last_row);  
+}
+
+static void edit_hash_rows(ic_env_t* env, editor_t* eb, stringbuf_t* input, attrbuf_t* attrs,
+                            ssize_t promptw, ssize_t cpromptw, bool in_extra, 
+                             ssize_t first_row, ssize_t last_row, ssize_t view_ofs, uint32_t* hashes) 
+{
+  if (input == NULL) return;
+  refresh_info_t info;
+  info.env        = env;
+  info.eb         = eb;
+  info.attrs      = attrs;
+  info.in_extra   = in_extra;
+  info.first_row  = first_row;
+  info.last_row   = last_row;
+  info.view_ofs   = view_ofs;
+  info.hashes     = hashes;
+  info.unchanged  = NULL;
+  sbuf_for_each_row( input, eb->termw, promptw, cpromptw, &edit_hash_rows_iter, &info, NULL);
+}
+
+// forget the row hashes as the screen content is no longer known
+static void edit_view_invalidate(editor_t* eb) {
+  eb->view_rows = 0;
+}
+
+
+//-------------------------------------------------------------
+// Highlighting within a time budget: if highlighting repeatedly
+// takes too long for the current input we fall back to cheaper
+// levels, and return to full highlighting once the input shrinks.
+//-------------------------------------------------------------
+
+#define IC_HIGHLIGHT_SLOW_MAX  (3)    // lower the level after this many consecutive calls over budget
+
+// The range of full lines around the rows that can be visible on the screen
+static void edit_highlight_viewport(ic_env_t* env, editor_t* eb, ssize_t promptw, ssize_t cpromptw, ssize_t* start, ssize_t* end) {
+  const char* s = sbuf_string(eb->input);
+  const ssize_t len = sbuf_len(eb->input);
+  const ssize_t termh = term_get_height(env->term);
+  rowcol_t rc = { 0 };
+  sbuf_get_rc_at_pos(eb->input, eb->termw, promptw, cpromptw, eb->pos, &rc);
+  const ssize_t first_row = (rc.row >= termh ? rc.row - termh + 1 : 0);
+  ssize_t i = sbuf_get_pos_at_rc(eb->input, eb->termw, promptw, cpromptw, first_row, 0);
+  ssize_t j = sbuf_get_pos_at_rc(eb->input, eb->termw, promptw, cpromptw, rc.row + termh, 0);
+  if (i < 0) i = 0;
+  if (j < 0) j = len;
+  while (i > 0 && s[i-1] != '\n') { i--; }
+  while (j < len && s[j] != '\n') { j++; }
+  *start = i;
+  *end = j;
+}
+
+static void edit_highlight(ic_env_t* env, editor_t* eb, ssize_t promptw, ssize_t cpromptw) {
+  const ssize_t len = sbuf_len(eb->input);
+  // return to full highlighting once the input is much smaller than when we degraded
+  if (env->highlight_level != IC_HIGHLIGHT_FULL && len <= env->highlight_slow_len/2) {
+    debug_msg("edit: highlight: back to full highlighting (input length %zd)\n", len);
+    env->highlight_level = IC_HIGHLIGHT_FULL;
+    env->highlight_slow = 0;
+  }
+  const ic_highlight_level_t level = env->highlight_level;
+  ic_highlight_fun_t* highlighter = (env->no_highlight || level >= IC_HIGHLIGHT_BRACES ? NULL : env->highlighter);
+  ssize_t start = 0;
+  ssize_t end = len;
+  if (highlighter != NULL && level == IC_HIGHLIGHT_VIEWPORT) {
+    edit_highlight_viewport(env, eb, promptw, cpromptw, &start, &end);
+  }
+  const int64_t t0 = ic_time_usecs();
+  highlight(env->mem, env->bbcode, sbuf_string(eb->input), start, end, eb->attrs, eb->vtexts, highlighter, env->highlighter_arg);
+  if (!env->no_bracematch && level < IC_HIGHLIGHT_PLAIN) {
+    highlight_match_braces(sbuf_string(eb->input), eb->attrs, eb->pos, ic_env_get_match_braces(env),  
+                              bbcode_style(env->bbcode,"ic-bracematch"), bbcode_style(env->bbcode,"ic-error"));
+  }
+  const int64_t t = ic_time_usecs() - t0;
+  env->highlight_last_us = (long)t;
+  
+  // check the budget
+  if (env->highlight_budget <= 0 || level >= IC_HIGHLIGHT_PLAIN || (highlighter == NULL && env->no_bracematch)) return;
+  if (t <= (int64_t)env->highlight_budget * 1000) {
+    env->highlight_slow = 0;
+  }
+  else if (++env->highlight_slow >= IC_HIGHLIGHT_SLOW_MAX) {
+    env->highlight_slow = 0;
+    env->highlight_slow_len = len;
+    env->highlight_level = (ic_highlight_level_t)(level + 1);
+    if (env->highlight_level == IC_HIGHLIGHT_BRACES && env->no_bracematch) { env->highlight_level = IC_HIGHLIGHT_PLAIN; }
+    debug_msg("edit: highlight: too slow (%lldus for input length %zd), lower level to %d\n", (long long)t, len, (int)env->highlight_level);
+  }
+}
+
+// The displayed input: either the input itself, or the input composed with
+// the virtual text (like the hint) in `eb->view` (the input is not modified).
+static stringbuf_t* edit_view(editor_t* eb, ssize_t* vpos) {
+  *vpos = eb->pos;
+  if (vtext_count(eb->vtexts) == 0) return eb->input;
+  if (eb->view == NULL) { eb->view = sbuf_new(eb->mem); }
+  if (eb->view_attrs == NULL && eb->attrs != NULL) { eb->view_attrs = attrbuf_new(eb->mem); }
+  if (eb->view == NULL) return eb->input;
+  sbuf_clear(eb->view);
+  attrbuf_clear(eb->view_attrs);
+  const ssize_t len = sbuf_len(eb->input);
+  vtext_compose(eb->vtexts, sbuf_string(eb->input), len, (eb->attrs == NULL ? NULL : attrbuf_attrs(eb->attrs, len)), eb->view, eb->view_attrs);
+  *vpos = vtext_view_pos(eb->vtexts, eb->pos);
+  return eb->view;
+}
+
+// Render the visible rows to the terminal
+static void edit_refresh_screen(ic_env_t* env, editor_t* eb, stringbuf_t* input, attrbuf_t* attrs, stringbuf_t* extra,
+                                 ssize_t rows, ssize_t rows_input, ssize_t rows_extra, ssize_t promptw, ssize_t cpromptw,
+                                  ssize_t first_row, ssize_t last_row, const rowcol_t* rc) 
+{
+  const ssize_t termh = term_get_height(env->term);
+  // if the view fills the screen, calculate row hashes so we can scroll instead of repainting all rows
+  const ssize_t first_rowx = (first_row > rows_input ? first_row - rows_input : 0);
+  const ssize_t last_rowx  = last_row - rows_input;
+  const ssize_t view_ofsx  = (first_row > rows_input ? 0 : rows_input - first_row);
+  const ssize_t vrows = last_row - first_row + 1;
+  uint32_t* hashes = NULL;
+  bool* unchanged = NULL;
+  ssize_t scroll = 0;
+  if (rows > termh && term_can_scroll(env->term)) {
+    hashes = mem_zalloc_tp_n(eb->mem, uint32_t, vrows);
+    if (hashes != NULL) {
+      edit_hash_rows(env, eb, input, attrs, promptw, cpromptw, false, first_row, last_row, 0, hashes);
+      if (rows_extra > 0 && last_rowx >= 0) {
+        edit_hash_rows(env, eb, extra, eb->attrs_extra, 0, 0, true, first_rowx, last_rowx, view_ofsx, hashes);
+      }
+      const ssize_t delta = first_row - eb->view_first_row;
+      if (eb->view_rows == vrows && eb->view_hashes != NULL && (delta == 1 || delta == -1)) {
+        unchanged = mem_zalloc_tp_n(eb->mem, bool, vrows);
+        if (unchanged != NULL) {
+          scroll = delta;
+          for (ssize_t i = 0; i < vrows; i++) {
+            const ssize_t j = i + delta;  // previous view row now displayed at row `i`
+            unchanged[i] = (j >= 0 && j < vrows && eb->view_hashes[j] == hashes[i]);
+          }
+        }
+      }
+    }
+  }
+
+  // reduce flicker
+  buffer_mode_t bmode = term_set_buffer_mode(env->term, BUFFERED);        
+
+  // back up to the first line
+  if (scroll != 0) {
+    // the view fills the screen: shift the displayed rows (which leaves the cursor at the top)
+    term_scroll_region(env->term, 0, termh - 1, scroll);
+  }
+  else {
+    term_start_of_line(env->term);
+    term_up(env->term, (eb->cur_row >= termh ? termh-1 : eb->cur_row) );
+  }
+  // term_clear_lines_to_end(env->term);  // gives flicker in old Windows cmd prompt 
+
+  // render rows
+  edit_refresh_rows( env, eb, input, attrs, promptw, cpromptw, false, first_row, last_row, 0, unchanged );  
+  if (rows_extra > 0) {
+    assert(extra != NULL); assert(last_rowx >= 0);
+    edit_refresh_rows(env, eb, extra, eb->attrs_extra, 0, 0, true, first_rowx, last_rowx, view_ofsx, unchanged);
+  }
+
+  // remember the displayed rows
+  mem_free(eb->mem, unchanged);
+  mem_free(eb->mem, eb->view_hashes);
+  eb->view_hashes = hashes;
+  eb->view_rows = (hashes != NULL ? vrows : 0);
+  eb->view_first_row = first_row;
+    
+  // overwrite trailing rows we do not use anymore  
+  ssize_t rrows = last_row - first_row + 1;  // rendered rows
+  if (rrows < termh && rows < eb->cur_rows) {
+    ssize_t clear = eb->cur_rows - rows;
+    while (rrows < termh && clear > 0) {
+      clear--;
+      rrows++;
+      term_writeln(env->term,"");
+      term_clear_line(env->term);
+    }
+  }
+  
+  // move cursor back to edit position
+  term_start_of_line(env->term);
+  term_up(env->term, first_row + rrows - 1 - rc->row );
+  term_right(env->term, rc->col + (rc->row == 0 ? promptw : cpromptw));
+
+  // and refresh
+  term_flush(env->term);
+
+  // stop buffering
+  term_set_buffer_mode(env->term, bmode);
+}
+
+//-------------------------------------------------------------
+// Render model: instead of escape sequences, all rows are sent
+// as (text,attribute) spans to a front-end (see `rmodel.c`).
+//-------------------------------------------------------------
+
+typedef struct model_info_s {
+  ic_env_t*    env;
+  attrbuf_t*   attrs;
+  stringbuf_t* prompt;     // the rendered prompt (if not in extra)
+  attrbuf_t*   prompt_attrs;
+  ssize_t      prompt_len; // the length of the prompt for the first row; the continuation prompt follows
+} model_info_t;
+
+static bool edit_model_rows_iter(
+    const char* s,
+    ssize_t row, ssize_t row_start, ssize_t row_len, 
+    ssize_t startw, bool is_wrap, const void* arg, void* res)
+{
+  ic_unused(res); ic_unused(startw); ic_unused(is_wrap);
+  const model_info_t* info = (const model_info_t*)(arg);
+  rmodel_t* rm = info->env->rmodel;
+  if (info->prompt != NULL) {
+    const ssize_t len = sbuf_len(info->prompt);
+    const ssize_t start = (row == 0 ? 0 : info->prompt_len);
+    const ssize_t end = (row == 0 ? info->prompt_len : len);
+    rmodel_append(rm, sbuf_string(info->prompt) + start, attrbuf_attrs(info->prompt_attrs, len) + start, end - start);
+  }
+  rmodel_append(rm, s + row_start, (info->attrs == NULL ? NULL : attrbuf_attrs(info->attrs, row_start + row_len) + row_start), row_len);
+  rmodel_end_row(rm);
+  return false;
+}
+
+static void edit_refresh_model(ic_env_t* env, editor_t* eb, stringbuf_t* input, attrbuf_t* attrs, stringbuf_t* extra, 
+                                ssize_t promptw, ssize_t cpromptw, const rowcol_t* rc) 
+{
+  // render the prompt and the continuation prompt
+  stringbuf_t* markup = sbuf_new(eb->mem);
+  model_info_t info;
+  info.env = env;
+  info.attrs = ((env->no_highlight && env->no_bracematch && eb->find == NULL) ? NULL : attrs);
+  info.prompt = sbuf_new(eb->mem);
+  info.prompt_attrs = attrbuf_new(eb->mem);
+  info.prompt_len = 0;
+  if (markup != NULL && info.prompt != NULL && info.prompt_attrs != NULL) {
+    sbuf_append(markup, "[ic-prompt]");
+    sbuf_append(markup, eb->prompt_text);
+    sbuf_append(markup, env->prompt_marker);
+    sbuf_append(markup, "[/ic-prompt]");
+    bbcode_append(env->bbcode, sbuf_string(markup), info.prompt, info.prompt_attrs);
+    info.prompt_len = sbuf_len(info.prompt);
+    sbuf_replace(markup, "[ic-prompt]");
+    const ssize_t cmarkerw = bbcode_column_width(env->bbcode, env->cprompt_marker);
+    for (ssize_t i = cmarkerw; i < cpromptw; i++) { sbuf_append_char(markup, ' '); }
+    sbuf_append(markup, env->cprompt_marker);
+    sbuf_append(markup, "[/ic-prompt]");
+    bbcode_append(env->bbcode, sbuf_string(markup), info.prompt, info.prompt_attrs);
+  }
+
+  // add all rows
+  rmodel_t* rm = env->rmodel;
+  rmodel_begin(rm);
+  sbuf_for_each_row(input, eb->termw, promptw, cpromptw, &edit_model_rows_iter, &info, NULL);
+  if (extra != NULL) {
+    info.attrs = eb->attrs_extra;
+    sbuf_free(info.prompt);
+    info.prompt = NULL;
+    sbuf_for_each_row(extra, eb->termw, 0, 0, &edit_model_rows_iter, &info, NULL);
+  }
+  sbuf_free(markup);
+  sbuf_free(info.prompt);
+  attrbuf_free(info.prompt_attrs);
+
+  // and send the difference with the previous model
+  ssize_t len = 0;
+  const char* model = rmodel_end(rm, rc->row, rc->col + (rc->row == 0 ? promptw : cpromptw), &len);
+  if (model != NULL && env->render != NULL) {
+    env->render(model, (long)len, env->render_arg);
+  }
+}
 
 static void edit_refresh(ic_env_t* env, editor_t* eb) 
 {
@@ -262,24 +599,19 @@ static void edit_refresh(ic_env_t* env, editor_t* eb)
   ssize_t promptw, cpromptw;
   edit_get_prompt_width( env, eb, false, &promptw, &cpromptw );
   
+  // syntax highlighting and brace matching
+  vtext_clear(eb->vtexts);
   if (eb->attrs != NULL) {
-    highlight( env->mem, env->bbcode, sbuf_string(eb->input), eb->attrs, 
-                 (env->no_highlight ? NULL : env->highlighter), env->highlighter_arg );
+    edit_highlight(env, eb, promptw, cpromptw);
   }
 
-  // highlight matching braces
-  if (eb->attrs != NULL && !env->no_bracematch) {
-    highlight_match_braces(sbuf_string(eb->input), eb->attrs, eb->pos, ic_env_get_match_braces(env),  
-                              bbcode_style(env->bbcode,"ic-bracematch"), bbcode_style(env->bbcode,"ic-error"));
-  }
-
-  // insert hint  
+  // show the hint right after the cursor
   if (sbuf_len(eb->hint) > 0) {
-    if (eb->attrs != NULL) {
-      attrbuf_insert_at( eb->attrs, eb->pos, sbuf_len(eb->hint), bbcode_style(env->bbcode, "ic-hint") );
-    }
-    sbuf_insert_at(eb->input, sbuf_string(eb->hint), eb->pos );
+    vtext_add(eb->vtexts, eb->pos, sbuf_string(eb->hint), sbuf_len(eb->hint), bbcode_style(env->bbcode, "ic-hint"), true);
   }
+  ssize_t vpos;
+  stringbuf_t* input = edit_view(eb, &vpos);
+  attrbuf_t* attrs = (input == eb->input ? eb->attrs : eb->view_attrs);
 
   // render extra (like a completion menu)
   stringbuf_t* extra = NULL;
@@ -295,7 +627,7 @@ static void edit_refresh(ic_env_t* env, editor_t* eb)
 
   // calculate rows and row/col position
   rowcol_t rc = { 0 };
-  const ssize_t rows_input = sbuf_get_rc_at_pos( eb->input, eb->termw, promptw, cpromptw, eb->pos, &rc );
+  const ssize_t rows_input = sbuf_get_rc_at_pos( input, eb->termw, promptw, cpromptw, vpos, &rc );
   rowcol_t rc_extra = { 0 };
   ssize_t rows_extra = 0;
   if (extra != NULL) { 
@@ -314,49 +646,21 @@ static void edit_refresh(ic_env_t* env, editor_t* eb)
     last_row = first_row + termh - 1;
   }
   assert(last_row - first_row < termh);
-  
-  // reduce flicker
-  buffer_mode_t bmode = term_set_buffer_mode(env->term, BUFFERED);        
 
-  // back up to the first line
-  term_start_of_line(env->term);
-  term_up(env->term, (eb->cur_row >= termh ? termh-1 : eb->cur_row) );
-  // term_clear_lines_to_end(env->term);  // gives flicker in old Windows cmd prompt 
-
-  // render rows
-  edit_refresh_rows( env, eb, eb->input, eb->attrs, promptw, cpromptw, false, first_row, last_row );  
-  if (rows_extra > 0) {
-    assert(extra != NULL);
-    const ssize_t first_rowx = (first_row > rows_input ? first_row - rows_input : 0);
-    const ssize_t last_rowx = last_row - rows_input; assert(last_rowx >= 0);
-    edit_refresh_rows(env, eb, extra, eb->attrs_extra, 0, 0, true, first_rowx, last_rowx);
-  }
-    
-  // overwrite trailing rows we do not use anymore  
-  ssize_t rrows = last_row - first_row + 1;  // rendered rows
-  if (rrows < termh && rows < eb->cur_rows) {
-    ssize_t clear = eb->cur_rows - rows;
-    while (rrows < termh && clear > 0) {
-      clear--;
-      rrows++;
-      term_writeln(env->term,"");
-      term_clear_line(env->term);
-    }
+  // highlight matches when finding in the input
+  if (eb->find != NULL) {
+    edit_find_highlight(env, eb, input, promptw, cpromptw, first_row, (last_row < rows_input ? last_row : rows_input - 1));
+    if (input != eb->input) { input = edit_view(eb, &vpos); }  // compose again to include the matches
   }
   
-  // move cursor back to edit position
-  term_start_of_line(env->term);
-  term_up(env->term, first_row + rrows - 1 - rc.row );
-  term_right(env->term, rc.col + (rc.row == 0 ? promptw : cpromptw));
-
-  // and refresh
-  term_flush(env->term);
-
-  // stop buffering
-  term_set_buffer_mode(env->term, bmode);
+  // and render
+  if (env->rmodel != NULL) {
+    edit_refresh_model(env, eb, input, attrs, extra, promptw, cpromptw, &rc);
+  }
+  else {
+    edit_refresh_screen(env, eb, input, attrs, extra, rows, rows_input, rows_extra, promptw, cpromptw, first_row, last_row, &rc);
+  }
 
-  // restore input by removing the hint
-  sbuf_delete_at(eb->input, eb->pos, sbuf_len(eb->hint));
   sbuf_delete_at(eb->extra, 0, sbuf_len(eb->hint_help));
   attrbuf_clear(eb->attrs);
   attrbuf_clear(eb->attrs_extra);
@@ -365,10 +669,16 @@ static void edit_refresh(ic_env_t* env, editor_t* eb)
   // update previous
   eb->cur_rows = rows;
   eb->cur_row = rc.row;
+  eb->enrich = false;
 }
 
 // clear current output
 static void edit_clear(ic_env_t* env, editor_t* eb ) {
+  edit_view_invalidate(eb);
+  if (env->rmodel != NULL) {
+    rmodel_reset(env->rmodel);  // the next model is sent in full
+    return;
+  }
   term_attr_reset(env->term);  
   term_up(env->term, eb->cur_row);
   
@@ -399,11 +709,13 @@ static bool edit_resize(ic_env_t* env, editor_t* eb ) {
   term_update_dim(env->term);
   ssize_t newtermw = term_get_width(env->term);
   if (eb->termw == newtermw) return false;
+  edit_view_invalidate(eb);
   
   // recalculate the row layout assuming the hardwrapping for the new terminal width
   ssize_t promptw, cpromptw;
   edit_get_prompt_width( env, eb, false, &promptw, &cpromptw );
-  sbuf_insert_at(eb->input, sbuf_string(eb->hint), eb->pos); // insert used hint    
+  ssize_t vpos;
+  stringbuf_t* input = edit_view(eb, &vpos);  // as displayed at the last refresh (with the hint)
   
   // render extra (like a completion menu)
   stringbuf_t* extra = NULL;
@@ -417,7 +729,7 @@ static bool edit_resize(ic_env_t* env, editor_t* eb ) {
     }
   }
   rowcol_t rc = { 0 };
-  const ssize_t rows_input = sbuf_get_wrapped_rc_at_pos( eb->input, eb->termw, newtermw, promptw, cpromptw, eb->pos, &rc );
+  const ssize_t rows_input = sbuf_get_wrapped_rc_at_pos( input, eb->termw, newtermw, promptw, cpromptw, vpos, &rc );
   rowcol_t rc_extra = { 0 };
   ssize_t rows_extra = 0;
   if (extra != NULL) {
@@ -433,9 +745,6 @@ static bool edit_resize(ic_env_t* env, editor_t* eb ) {
   }
   eb->termw = newtermw;     
   edit_refresh(env,eb); 
-
-  // remove hint again
-  sbuf_delete_at(eb->input, eb->pos, sbuf_len(eb->hint));
   sbuf_free(extra);
   return true;
 } 
@@ -449,15 +758,10 @@ static void editor_append_hint_help(editor_t* eb, const char* help) {
   }
 }
 
-// refresh with possible hint
-static void edit_refresh_hint(ic_env_t* env, editor_t* eb) {
-  if (env->no_hint || env->hint_delay > 0) {
-    // refresh without hint first
-    edit_refresh(env, eb);
-    if (env->no_hint) return;
-  }
-    
-  // and see if we can construct a hint (displayed after a delay)
+// construct a hint if there is a single completion (and measure the cost)
+static void edit_generate_hint(ic_env_t* env, editor_t* eb) {
+  if (term_get_render_level(env->term) >= 1) return;  // the output is too slow for hints
+  const int64_t t0 = ic_time_usecs();
   ssize_t count = completions_generate(env, env->completions, sbuf_string(eb->input), eb->pos, 2);
   if (count == 1) {
     const char* help = NULL;
@@ -492,11 +796,48 @@ static void edit_refresh_hint(ic_env_t* env, editor_t* eb) {
       }      
     }
   }
+  const int64_t t = ic_time_usecs() - t0;
+  env->hint_cost_us = (env->hint_computed == 0 ? t : (3*env->hint_cost_us + t)/4);
+  env->hint_computed++;
+}
 
-  if (env->hint_delay <= 0) {
-    // refresh with hint directly
-    edit_refresh(env, eb);
+// refresh after an insert; a possible hint is computed from the main loop
+// once no further input is pending and typing pauses (see `edit_line`)
+static void edit_refresh_insert(ic_env_t* env, editor_t* eb) {
+  edit_refresh(env, eb);
+  eb->hint_pending = !env->no_hint;
+}
+
+// How long to wait for a next key (in milliseconds) before computing a hint after an insert:
+// a bit longer than the usual interval between keys so we skip computing hints during a burst of typing,
+// but short enough that the hint is still ready when the hint delay expires. With no hint delay,
+// we only wait in proportion to the cost of computing a hint.
+ic_private long edit_hint_pause(ic_env_t* env) {
+  if (env->no_hint || env->key_interval_us <= 0) return 0;
+  int64_t pause = (3*env->key_interval_us)/2;
+  const int64_t budget = (env->hint_delay > 0 ? 1000*(int64_t)env->hint_delay - env->hint_cost_us : 2*env->hint_cost_us);
+  if (pause > budget) { pause = budget; }
+  return (pause < 1000 ? 0 : (long)(pause/1000));
+}
+
+// Update the average interval between typed keys (where pauses only count for a little).
+static void edit_key_typed(ic_env_t* env) {
+  const int64_t now = ic_time_usecs();
+  int64_t t = now - env->key_last_us;
+  if (env->key_last_us > 0 && t < 1000000) {
+    if (env->key_interval_us > 0 && t > 2*env->key_interval_us) { t = 2*env->key_interval_us; }
+    env->key_interval_us = (env->key_interval_us <= 0 ? t : (3*env->key_interval_us + t)/4);
+  }
+  env->key_last_us = now;
+}
+
+// Read a key, but while none is pending use the idle time to build the history token index.
+static code_t edit_read_key(ic_env_t* env) {
+  code_t c;
+  while (history_index_step(env->history)) {
+    if (tty_read_timeout(env->tty, 0, &c)) return c;
   }
+  return tty_read(env->tty);
 }
 
 //-------------------------------------------------------------
@@ -763,11 +1104,43 @@ static void edit_multiline_eol(ic_env_t* env, editor_t* eb) {
   edit_refresh(env,eb);
 }
 
+// Inserting characters happens in two phases to reduce latency: if the characters were 
+// appended at the end of the last row and still fit, we just echo them to the terminal.
+// The full refresh with highlighting, brace matching, and hints is deferred until no 
+// further input is pending (see `edit_line`).
+static bool edit_insert_echo(ic_env_t* env, editor_t* eb, ssize_t prev_pos, ssize_t prev_len) {
+  const ssize_t len = sbuf_len(eb->input);
+  if (eb->pos != len || prev_pos != prev_len || len <= prev_len) return false;
+  if (eb->cur_row != eb->cur_rows - 1 || sbuf_len(eb->extra) > 0 || sbuf_len(eb->hint) > 0 ||
+      eb->find != NULL || vtext_count(eb->vtexts) > 0 || env->rmodel != NULL) return false;
+  const char* s = sbuf_string(eb->input) + prev_len;
+  for (ssize_t i = 0; i < len - prev_len; i++) {
+    if ((uint8_t)s[i] < ' ' || s[i] == 0x7F) return false;
+  }
+  // does it fit on the current row?
+  ssize_t promptw, cpromptw;
+  edit_get_prompt_width(env, eb, false, &promptw, &cpromptw);
+  rowcol_t rc = { 0 };
+  sbuf_get_rc_at_pos(eb->input, eb->termw, promptw, cpromptw, prev_pos, &rc);
+  const ssize_t col = rc.col + (rc.row == 0 ? promptw : cpromptw);
+  if (rc.row != eb->cur_row || col + str_column_width(s) >= eb->termw) return false;
+  // echo
+  term_write_n(env->term, s, len - prev_len);
+  term_clear_to_end_of_line(env->term);
+  edit_view_invalidate(eb);
+  eb->enrich = (eb->attrs != NULL || !env->no_hint);
+  return true;
+}
+
 static void edit_insert_unicode(ic_env_t* env, editor_t* eb, unicode_t u) {
   editor_start_modify(eb);
+  const ssize_t prev_pos = eb->pos;
+  const ssize_t prev_len = sbuf_len(eb->input);
   ssize_t nextpos = sbuf_insert_unicode_at(eb->input, u, eb->pos);
   if (nextpos >= 0) eb->pos = nextpos;  
-  edit_refresh_hint(env, eb);
+  if (!edit_insert_echo(env, eb, prev_pos, prev_len)) {
+    edit_refresh_insert(env, eb);
+  }
 }
 
 static void edit_auto_brace(ic_env_t* env, editor_t* eb, char c) {
@@ -811,13 +1184,67 @@ static void editor_auto_indent(editor_t* eb, const char* pre, const char* post )
 
 static void edit_insert_char(ic_env_t* env, editor_t* eb, char c) {
   editor_start_modify(eb);
+  const ssize_t prev_pos = eb->pos;
+  const ssize_t prev_len = sbuf_len(eb->input);
   ssize_t nextpos = sbuf_insert_char_at( eb->input, c, eb->pos );
   if (nextpos >= 0) eb->pos = nextpos;
   edit_auto_brace(env, eb, c);
   if (c=='\n') {
     editor_auto_indent(eb, "{", "}");  // todo: custom auto indent tokens?
   }
-  edit_refresh_hint(env,eb);  
+  if (!edit_insert_echo(env, eb, prev_pos, prev_len)) {
+    edit_refresh_insert(env,eb);  
+  }
+}
+
+// Insert keys that were typed before the prompt was shown (in typeahead mode)
+// directly into the input; stop at the first non-character key and leave that
+// for the main loop. Renders only once at the end. 
+// Between calls the terminal translates enter to a linefeed (`ICRNL`), so 
+// a typed ahead linefeed submits the input.
+static void edit_insert_typeahead(ic_env_t* env, editor_t* eb) {
+  if (!tty_has_typeahead(env->tty)) return;
+  editor_start_modify(eb);
+  bool inserted = false;
+  code_t c;
+  while (tty_read_timeout(env->tty, 0, &c)) {
+    char chr;
+    unicode_t uchr;
+    ssize_t nextpos = -1;
+    if (code_is_ascii_char(c,&chr)) {
+      nextpos = sbuf_insert_char_at(eb->input, chr, eb->pos);
+    }
+    else if (code_is_unicode(c,&uchr) && !code_is_virt_key(c)) {
+      nextpos = sbuf_insert_unicode_at(eb->input, uchr, eb->pos);
+    }
+    else {
+      tty_code_pushback(env->tty, (c == KEY_LINEFEED ? KEY_ENTER : c));
+      break;
+    }
+    if (nextpos >= 0) { eb->pos = nextpos; inserted = true; }
+  }
+  if (inserted) {
+    edit_refresh_insert(env, eb);
+  }
+  else {
+    editor_undo_forget(eb);
+  }
+}
+
+// Restore an unfinished input from the draft journal (if enabled)
+// and start journaling the current input.
+static void edit_restore_draft(ic_env_t* env, editor_t* eb) {
+  if (env->draft == NULL) return;
+  char* draft = draft_restore(env->draft);
+  if (draft != NULL) {
+    editor_start_modify(eb);  // so ctrl-z discards the draft
+    sbuf_replace(eb->input, draft);
+    eb->pos = sbuf_len(eb->input);
+    sbuf_replace(eb->extra, "[ic-info](restored an unfinished input; press ctrl-z to discard)[/]");
+    edit_refresh(env, eb);
+    mem_free(env->mem, draft);
+  }
+  draft_start(env->draft, sbuf_string(eb->input));
 }
 
 //-------------------------------------------------------------
@@ -832,6 +1259,12 @@ static void edit_insert_char(ic_env_t* env, editor_t* eb, char c) {
 
 #include "editline_history.c"
 
+//-------------------------------------------------------------
+// Find in the input
+//-------------------------------------------------------------
+
+#include "editline_find.c"
+
 //-------------------------------------------------------------
 // Completion
 //-------------------------------------------------------------
@@ -853,6 +1286,7 @@ static char* edit_line( ic_env_t* env, const char* prompt_text )
   eb.extra    = sbuf_new(env->mem);
   eb.hint     = sbuf_new(env->mem);
   eb.hint_help= sbuf_new(env->mem);
+  eb.vtexts   = vtext_new(env->mem);
   eb.termw    = term_get_width(env->term);  
   eb.pos      = 0;
   eb.cur_rows = 1; 
@@ -862,7 +1296,7 @@ static char* edit_line( ic_env_t* env, const char* prompt_text )
   eb.history_idx   = 0;  
   editstate_init(&eb.undo);
   editstate_init(&eb.redo);
-  if (eb.input==NULL || eb.extra==NULL || eb.hint==NULL || eb.hint_help==NULL) {
+  if (eb.input==NULL || eb.extra==NULL || eb.hint==NULL || eb.hint_help==NULL || eb.vtexts==NULL) {
     return NULL;
   }
 
@@ -872,30 +1306,82 @@ static char* edit_line( ic_env_t* env, const char* prompt_text )
     eb.attrs_extra = attrbuf_new(env->mem);
   }
   
-  // show prompt
-  edit_write_prompt(env, &eb, 0, false);   
+  // start recording keys
+  tty_set_trace(env->tty, env->trace);
+  trace_edit_start(env->trace, eb.termw, term_get_height(env->term));
+
+  // show prompt (or send the first full model right away to a front-end)
+  if (env->rmodel != NULL) {
+    edit_refresh(env, &eb);
+  }
+  else {
+    edit_write_prompt(env, &eb, 0, false);
+  }
 
   // always a history entry for the current input
   history_push(env->history, "");
 
+  // restore an unfinished draft and start with any keys that were typed ahead
+  edit_restore_draft(env, &eb);
+  edit_insert_typeahead(env, &eb);
+
   // process keys
   code_t c;          // current key code
+  int64_t key_start = 0;    // start time of processing `c` (if recording)
+  ssize_t key_written = 0;  // output bytes before processing `c`
   while(true) {    
     // read a character
     term_flush(env->term);
-    if (env->hint_delay <= 0 || sbuf_len(eb.hint) == 0) {
+    bool pending = false;
+    long hint_waited = 0;   // time already waited for the hint delay
+    if (eb.enrich || eb.hint_pending) {
+      // the last insert was only echoed, or its hint is not yet computed: process further
+      // input first and refresh with highlighting and hints once no input is pending
+      pending = tty_read_timeout(env->tty, 0, &c);
+      const long pause = (pending ? 0 : edit_hint_pause(env));
+      if (pending) {
+        // typed ahead
+      }
+      else {
+        // refresh with highlighting first if we wait or there is no direct hint
+        if (eb.enrich && (pause > 0 || env->no_hint || env->hint_delay > 0)) {
+          edit_refresh(env, &eb);
+        }
+        // and only compute a hint once typing pauses
+        if (pause > 0) {
+          term_flush(env->term);
+          if (tty_read_timeout(env->tty, pause, &c)) {
+            pending = true;
+            env->hint_avoided++;
+          }
+          else {
+            hint_waited = pause;
+          }
+        }
+        if (!pending && !env->no_hint) {
+          edit_generate_hint(env, &eb);
+          if (env->hint_delay <= 0) { edit_refresh(env, &eb); }
+        }
+        term_flush(env->term);
+      }
+      eb.hint_pending = false;
+    }
+    if (pending) {
+      // process the pending key right away
+    }
+    else if (env->hint_delay <= 0 || sbuf_len(eb.hint) == 0) {
       // blocking read
-      c = tty_read(env->tty);
+      c = edit_read_key(env);
     }
     else {
       // timeout to display hint
-      if (!tty_read_timeout(env->tty, env->hint_delay, &c)) {
+      if (!tty_read_timeout(env->tty, env->hint_delay - hint_waited, &c)) {
         // timed-out
         if (sbuf_len(eb.hint) > 0) {
           // display hint
           edit_refresh(env, &eb);
         }
-        c = tty_read(env->tty);
+        c = edit_read_key(env);
       }
       else {
         // clear the pending hint if we got input before the delay expired
@@ -903,6 +1389,11 @@ static char* edit_line( ic_env_t* env, const char* prompt_text )
         sbuf_clear(eb.hint_help);
       }
     }
+    edit_key_typed(env);
+
+    // measure the processing of this key (if recording)
+    key_start   = (env->trace != NULL ? ic_time_usecs() : 0);
+    key_written = term_get_written(env->term);
     
     // update terminal in case of a resize
     if (tty_term_resize_event(env->tty)) {
@@ -914,6 +1405,12 @@ static char* edit_line( ic_env_t* env, const char* prompt_text )
     sbuf_clear(eb.hint);
     sbuf_clear(eb.hint_help);
 
+    // remove a one-time message (like for a restored draft)
+    if (sbuf_len(eb.extra) > 0) {
+      sbuf_clear(eb.extra);
+      edit_refresh(env, &eb);
+    }
+
     // if the user tries to move into a hint with left-cursor or end, we complete it first
     if ((c == KEY_RIGHT || c == KEY_END) && had_hint) {
       edit_generate_completions(env, &eb, true);
@@ -970,6 +1467,10 @@ static char* edit_line( ic_env_t* env, const char* prompt_text )
       case KEY_CTRL_S:
         edit_history_search_with_current_word(env,&eb);
         break;
+      case WITH_ALT('s'):
+      case KEY_F3:
+        edit_find(env, &eb);
+        break;
       case KEY_CTRL_P:
         edit_history_prev(env, &eb);
         break;
@@ -1099,6 +1600,13 @@ static char* edit_line( ic_env_t* env, const char* prompt_text )
       }
     }
 
+    // journal the changes
+    draft_record(env->draft, sbuf_string(eb.input));
+
+    if (env->trace != NULL) {
+      term_flush(env->term);
+      trace_key(env->trace, c, ic_time_usecs() - key_start, term_get_written(env->term) - key_written);
+    }
   }
 
   // goto end
@@ -1109,6 +1617,10 @@ static char* edit_line( ic_env_t* env, const char* prompt_text )
   env->no_bracematch = true;
   edit_refresh(env,&eb);
   env->no_bracematch = bm;
+  if (env->trace != NULL) {
+    term_flush(env->term);
+    trace_key(env->trace, c, ic_time_usecs() - key_start, term_get_written(env->term) - key_written);
+  }
   
   // save result
   char* res; 
@@ -1126,16 +1638,22 @@ static char* edit_line( ic_env_t* env, const char* prompt_text )
   history_update(env->history, sbuf_string(eb.input));
   if (res == NULL || sbuf_len(eb.input) <= 1) { ic_history_remove_last(); } // no empty or single-char entries
   history_save(env->history);
+  draft_done(env->draft);
+  trace_edit_done(env->trace);
 
   // free resources 
   editstate_done(env->mem, &eb.undo);
   editstate_done(env->mem, &eb.redo);
   attrbuf_free(eb.attrs);
   attrbuf_free(eb.attrs_extra);
+  mem_free(env->mem, eb.view_hashes);
   sbuf_free(eb.input);
   sbuf_free(eb.extra);
   sbuf_free(eb.hint);
   sbuf_free(eb.hint_help);
+  vtext_free(eb.vtexts);
+  sbuf_free(eb.view);
+  attrbuf_free(eb.view_attrs);
 
   return res;
 }
@@ -87,6 +87,25 @@ static void editor_append_completion3(ic_env_t* env, editor_t* eb, ssize_t col_w
   editor_append_completion(env, eb, idx3, col_width, true, (idx3 == selected) );
 }
 
+// a single line without help for slow links; returns the number of displayed entries
+// (and leaves room for a "+N more" marker if not all entries fit)
+static ssize_t editor_append_completion_line(ic_env_t* env, editor_t* eb, ssize_t twidth, ssize_t count, ssize_t selected ) {
+  ssize_t width = 0;
+  ssize_t i;
+  for (i = 0; i < count && i < 9; i++) {
+    const char* display = completions_get_display(env->completions, i, NULL);
+    if (display == NULL) break;
+    const ssize_t w = 3 + bbcode_column_width(env->bbcode, display) + 2;
+    const ssize_t reserve = (i + 1 < count ? 10 : 0);
+    if (i > 0 && width + w > twidth - reserve) break;
+    width += w;
+    sbuf_appendf(eb->extra, "[ic-info]%s%zd [/]", (i == selected ? "*" : " "), 1 + i);
+    sbuf_append(eb->extra, display);
+    sbuf_append(eb->extra, "  ");
+  }
+  return i;
+}
+
 static ssize_t edit_completions_max_width( ic_env_t* env, ssize_t count ) {
   ssize_t max_width = 0;
   for( ssize_t i = 0; i < count; i++) {
@@ -114,7 +133,13 @@ again:
   sbuf_clear(eb->extra);
   ssize_t twidth = term_get_width(env->term) - 1;
   ssize_t colwidth;
-  if (count > 3 && ((colwidth = 3 + edit_completions_max_width(env, 9))*3 + 2*2) < twidth) {
+  const bool minimal = (term_get_render_level(env->term) >= 3);
+  if (minimal) {
+    // the output is very slow: display on a single line
+    count_displayed = editor_append_completion_line(env, eb, twidth, count, selected);
+    percolumn = count_displayed;
+  }
+  else if (count > 3 && ((colwidth = 3 + edit_completions_max_width(env, 9))*3 + 2*2) < twidth) {
     // display as a 3 column block
     count_displayed = (count > 9 ? 9 : count);
     percolumn = 3;
@@ -141,7 +166,15 @@ again:
       editor_append_completion(env, eb, i, -1, true /* numbered */, selected == i);
     }
   }
-  if (count > count_displayed) {
+  if (count > count_displayed && minimal) {
+    if (more_available) {
+      sbuf_append(eb->extra, "[ic-info]+more[/]");
+    }
+    else {
+      sbuf_appendf(eb->extra, "[ic-info]+%zd more[/]", count - count_displayed);
+    }
+  }
+  else if (count > count_displayed) {
     if (more_available) {
       sbuf_append(eb->extra, "\n[ic-info](press page-down (or ctrl-j) to see all further completions)[/]");
     }
@@ -167,7 +200,7 @@ again:
   // direct selection?
   if (c >= '1' && c <= '9') {
     ssize_t i = (c - '1');
-    if (i < count) {
+    if (i < count_displayed) {
       selected = i;
       c = KEY_ENTER;
     }
@@ -213,7 +246,7 @@ again:
     assert(selected < count);
     edit_complete(env, eb, selected); 
   }
-  else if ((c == KEY_PAGEDOWN || c == KEY_LINEFEED) && count > 9) {
+  else if ((c == KEY_PAGEDOWN || c == KEY_LINEFEED) && count > count_displayed) {
     // show all completions
     c = 0;
     if (more_available) {
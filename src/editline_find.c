@@ -0,0 +1,155 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2021, Daan Leijen
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+-----------------------------------------------------------------------------*/
+
+//-------------------------------------------------------------
+// Incremental find in the current input: this is included into editline.c
+//-------------------------------------------------------------
+
+// Highlight all matches of the find pattern in the visible rows of the displayed input `view` (called from `edit_refresh`).
+static void edit_find_highlight(ic_env_t* env, editor_t* eb, stringbuf_t* view, ssize_t promptw, ssize_t cpromptw, ssize_t first_row, ssize_t last_row) {
+  const ssize_t patlen = sbuf_len(eb->find);
+  if (patlen <= 0 || eb->attrs == NULL || last_row < first_row) return;
+  const char* s = sbuf_string(eb->input);
+  const ssize_t len = sbuf_len(eb->input);
+  ssize_t start = sbuf_get_pos_at_rc(view, eb->termw, promptw, cpromptw, first_row, 0);
+  ssize_t end   = sbuf_get_pos_at_rc(view, eb->termw, promptw, cpromptw, last_row + 1, 0);
+  if (start < 0) start = 0;
+  if (end < 0 || end > sbuf_len(view)) end = sbuf_len(view);
+  // map back to input positions (the view may contain virtual text)
+  start = vtext_input_pos(eb->vtexts, start);
+  end   = vtext_input_pos(eb->vtexts, end);
+  if (end > len) end = len;
+  // include matches that start before the viewport and end inside it
+  start = (start > patlen - 1 ? start - (patlen - 1) : 0);
+  const attr_t attr = bbcode_style(env->bbcode, "ic-find");
+  const char* pat = sbuf_string(eb->find);
+  ssize_t pos = start;
+  while (pos < end) {
+    ssize_t i = ic_memmem(s + pos, (end + patlen - 1 < len ? end + patlen - 1 : len) - pos, pat, patlen);
+    if (i < 0) break;
+    attrbuf_update_at(eb->attrs, pos + i, patlen, attr);
+    pos += i + patlen;
+  }
+}
+
+// Find the next (or previous) match starting at `from`; wraps around.
+static bool edit_find_at(editor_t* eb, ssize_t from, bool backward, ssize_t* match) {
+  const char* s = sbuf_string(eb->input);
+  const ssize_t len = sbuf_len(eb->input);
+  const char* pat = sbuf_string(eb->find);
+  const ssize_t patlen = sbuf_len(eb->find);
+  ssize_t i;
+  if (!backward) {
+    if (from < 0) from = 0;
+    if (from > len) from = len;
+    i = ic_memmem(s + from, len - from, pat, patlen);
+    if (i >= 0) { i += from; }
+           else { i = ic_memmem(s, len, pat, patlen); }  // wrap around
+  }
+  else {
+    // the last match that starts at or before `from` (none if `from` is negative)
+    i = (from < 0 ? -1 : ic_memrmem(s, (from + patlen < len ? from + patlen : len), pat, patlen));
+    if (i < 0) { i = ic_memrmem(s, len, pat, patlen); }  // wrap around
+  }
+  if (i < 0) return false;
+  *match = i;
+  return true;
+}
+
+static void edit_find(ic_env_t* env, editor_t* eb) {
+  if (sbuf_len(eb->input) == 0) return;
+  stringbuf_t* find = sbuf_new(eb->mem);
+  if (find == NULL) return;
+  // we need an attribute buffer to show the matches
+  attrbuf_t* attrs = NULL;
+  if (eb->attrs == NULL) {
+    attrs = attrbuf_new(eb->mem);
+    eb->attrs = attrs;
+  }
+  eb->find = find;
+  bool old_hint = ic_enable_hint(false);
+  const ssize_t start_pos = eb->pos;
+  ssize_t match = eb->pos;   // current match (or start position)
+  code_t c;
+
+again:
+  sbuf_replace(eb->extra, "[ic-info]find:[/] [!pre]");
+  sbuf_append(eb->extra, sbuf_string(find));
+  sbuf_append(eb->extra, "[/pre]");
+  if (!env->no_help) {
+    sbuf_append(eb->extra, "\n[ic-info](use tab for the next match, shift-tab for the previous one, and enter to stop)[/]");
+  }
+  edit_refresh(env, eb);
+
+  // Wait for input
+  c = tty_read(env->tty);
+  if (tty_term_resize_event(env->tty)) {
+    edit_resize(env, eb);
+  }
+
+  if (c == KEY_ESC || c == KEY_BELL /* ^G */ || c == KEY_CTRL_C) {
+    // cancel
+    c = 0;
+    eb->pos = start_pos;
+  }
+  else if (c == KEY_ENTER) {
+    // stop at the current match
+    c = 0;
+  }
+  else if (c == KEY_TAB || c == KEY_F3 || c == WITH_ALT('s') || c == KEY_CTRL_S || c == KEY_DOWN) {
+    if (sbuf_len(find) > 0 && !edit_find_at(eb, match + 1, false, &match)) { term_beep(env->term); }
+    eb->pos = match;
+    goto again;
+  }
+  else if (c == KEY_SHIFT_TAB || c == KEY_CTRL_R || c == KEY_UP) {
+    if (sbuf_len(find) > 0 && !edit_find_at(eb, match - 1, true, &match)) { term_beep(env->term); }
+    eb->pos = match;
+    goto again;
+  }
+  else if (c == KEY_BACKSP) {
+    // shorten the pattern: the first match from the start can only be earlier
+    ssize_t prev = sbuf_prev(find, sbuf_len(find), NULL);
+    if (prev >= 0) { sbuf_delete_from(find, prev); }
+    match = start_pos;
+    if (sbuf_len(find) > 0) { edit_find_at(eb, start_pos, false, &match); }
+    eb->pos = match;
+    goto again;
+  }
+  else {
+    char chr;
+    unicode_t uchr;
+    if (code_is_ascii_char(c, &chr)) {
+      sbuf_append_char(find, chr);
+    }
+    else if (code_is_unicode(c, &uchr) && !code_is_virt_key(c)) {
+      sbuf_insert_unicode_at(find, uchr, sbuf_len(find));
+    }
+    else {
+      // any other key stops the find and is processed as usual
+      goto done;
+    }
+    // a longer pattern only matches at or after the current match
+    if (!edit_find_at(eb, match, false, &match)) {
+      term_beep(env->term);
+      sbuf_delete_from(find, sbuf_prev(find, sbuf_len(find), NULL));
+    }
+    eb->pos = match;
+    goto again;
+  }
+
+done:
+  sbuf_clear(eb->extra);
+  eb->find = NULL;
+  sbuf_free(find);
+  if (attrs != NULL) {
+    eb->attrs = NULL;
+    attrbuf_free(attrs);
+  }
+  ic_enable_hint(old_hint);
+  edit_refresh(env, eb);
+  if (c != 0) tty_code_pushback(env->tty, c);
+}
@@ -41,6 +41,7 @@ static const char* help[] = {
   "^p",         "go back in the history",
   "^n",         "go forward in the history",
   "^r,^s",      "search the history starting with the current word",
+  "alt-s,F3",   "find in the current input",
   "","",
 
   "", "Deletion:",
@@ -88,6 +89,15 @@ static const char* help[] = {
   "^r",         "find the next match",
   "shift-tab,"
   "^s",         "find an earlier match",
+  "/...",       "search with a regular expression (if typed first)",
+  "esc",        "exit search",
+  "","",
+  "","In fuzzy history search:",
+  "enter",      "use the selected history entry",
+  "tab,down,"
+  "^r",         "select the next match",
+  "shift-tab,up,"
+  "^s",         "select the previous match",
   "esc",        "exit search",
   " ","",
   NULL, NULL
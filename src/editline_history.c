@@ -83,6 +83,72 @@ static void hsearch_done( alloc_t* mem, hsearch_t* hs ) {
   }
 }
 
+// Is a key pending that changes the search pattern, that is, a character or backspace?
+// (the key is pushed back so it is read next)
+static bool edit_search_key_pending(ic_env_t* env) {
+  code_t c;
+  if (!tty_read_timeout(env->tty, 0, &c)) return false;
+  tty_code_pushback(env->tty, c);
+  return (c == KEY_BACKSP || (c >= ' ' && code_is_unicode(c, NULL)));
+}
+
+#define IC_HISTORY_RX_CHUNK  (2048)  // entries searched between checks for a pending key
+
+typedef struct rx_find_s {
+  ic_env_t* env;
+  rx_t*     rx;
+  ssize_t   pos;
+  ssize_t   len;
+  ssize_t   visited;
+  bool      interrupted;
+} rx_find_t;
+
+static bool edit_history_rx_visit(ssize_t n, const char* entry, void* arg) {
+  rx_find_t* find = (rx_find_t*)arg;
+  const ssize_t len = ic_strlen(entry);
+  if (rx_search(find->rx, entry, len, &find->pos, &find->len)) {
+    if (find->pos + find->len < len) return false;
+    // a match at the end of a preview (like with `$`) may not hold for the full entry
+    char* full = history_get_large(find->env->history, n);
+    if (full == NULL) return false;
+    const bool found = rx_search(find->rx, full, ic_strlen(full), &find->pos, &find->len);
+    mem_free(find->env->mem, full);
+    if (found) return false;
+  }
+  find->visited++;
+  if (find->visited % IC_HISTORY_RX_CHUNK == 0 && edit_search_key_pending(find->env)) {
+    find->interrupted = true;
+    return false;
+  }
+  return true;
+}
+
+// Find `search` in the history; if it starts with a `/` the rest is a regular expression.
+// The regular expression (`*rx`) is allocated on demand and only recompiled if it changed.
+// Large entries are matched on their preview, and only read from their side file if a regular
+// expression match reaches the end of the preview. A regular expression search over a large history
+// stops when the pattern changes again (see `edit_search_key_pending`); the current match is then kept.
+static bool edit_history_find(ic_env_t* env, rx_t** rx, ssize_t from, const char* search, bool backward, ssize_t* hidx, ssize_t* hpos, ssize_t* hlen) {
+  if (search[0] != '/') {
+    if (!history_search(env->history, from, search, backward, hidx, hpos)) return false;
+    *hlen = ic_strlen(search);
+    return true;
+  }
+  if (*rx == NULL) {
+    *rx = rx_new(env->mem);
+    if (*rx == NULL) return false;
+  }
+  if (!rx_compile(*rx, search + 1)) return false;   // invalid (or still incomplete)
+  rx_find_t find = { env, *rx, 0, 0, 0, false };
+  const ssize_t i = history_scan(env->history, from, backward, &edit_history_rx_visit, &find);
+  if (find.interrupted) return true;
+  if (i < 0) return false;
+  *hidx = i;
+  *hpos = find.pos;
+  *hlen = find.len;
+  return true;
+}
+
 static void edit_history_search(ic_env_t* env, editor_t* eb, char* initial ) {
   if (history_count( env->history ) <= 0) {
     term_beep(env->term);
@@ -109,6 +175,7 @@ static void edit_history_search(ic_env_t* env, editor_t* eb, char* initial ) {
   ssize_t match_pos = 0;       // current matched position
   ssize_t match_len = 0;       // length of the match
   const char* hentry = NULL;   // current history entry
+  rx_t* rx = NULL;             // regular expression (if the search starts with `/`)
   
   // Simulate per character searches for each letter in `initial` (so backspace works)
   if (initial != NULL) {
@@ -120,10 +187,7 @@ static void edit_history_search(ic_env_t* env, editor_t* eb, char* initial ) {
       hsearch_push( eb->mem, &hs, hidx, match_pos, match_len, true);
       char c = initial[ipos + next];  // terminate temporarily
       initial[ipos + next] = 0;
-      if (history_search( env->history, hidx, initial, true, &hidx, &match_pos )) {
-        match_len = ipos + next;
-      }      
-      else if (ipos + next >= initial_len) {
+      if (!edit_history_find( env, &rx, hidx, initial, true, &hidx, &match_pos, &match_len ) && ipos + next >= initial_len) {
         term_beep(env->term);
       }
       initial[ipos + next] = c;       // restore
@@ -163,8 +227,8 @@ again:
   sbuf_clear(eb->extra);
 
   // Process commands
-  if (c == KEY_ESC || c == KEY_BELL /* ^G */ || c == KEY_CTRL_C) {
-    c = 0;  
+  if (c == KEY_ESC || c == KEY_BELL /* ^G */ || c == KEY_CTRL_C || c == KEY_EVENT_STOP) {
+    if (c != KEY_EVENT_STOP) { c = 0; }  // the editor stops as well on a stop event
     eb->disable_undo = false;
     editor_undo_restore(eb, false);
   } 
@@ -187,7 +251,7 @@ again:
   else if (c == KEY_CTRL_R || c == KEY_TAB || c == KEY_UP) {    
     // search backward
     hsearch_push(env->mem, &hs, hidx, match_pos, match_len, false);
-    if (!history_search( env->history, hidx+1, sbuf_string(eb->input), true, &hidx, &match_pos )) {
+    if (!edit_history_find( env, &rx, hidx+1, sbuf_string(eb->input), true, &hidx, &match_pos, &match_len )) {
       hsearch_pop(env->mem,&hs,NULL,NULL,NULL,NULL);
       term_beep(env->term);
     };
@@ -196,7 +260,7 @@ again:
   else if (c == KEY_CTRL_S || c == KEY_SHIFT_TAB || c == KEY_DOWN) {    
     // search forward
     hsearch_push(env->mem, &hs, hidx, match_pos, match_len, false);
-    if (!history_search( env->history, hidx-1, sbuf_string(eb->input), false, &hidx, &match_pos )) {
+    if (!edit_history_find( env, &rx, hidx-1, sbuf_string(eb->input), false, &hidx, &match_pos, &match_len )) {
       hsearch_pop(env->mem, &hs,NULL,NULL,NULL,NULL);
       term_beep(env->term);
     };
@@ -224,10 +288,7 @@ again:
       goto again;
     }
     // search for the new input
-    if (history_search( env->history, hidx, sbuf_string(eb->input), true, &hidx, &match_pos )) {
-      match_len = sbuf_len(eb->input);
-    }
-    else {
+    if (!edit_history_find( env, &rx, hidx, sbuf_string(eb->input), true, &hidx, &match_pos, &match_len )) {
       term_beep(env->term);
     };
     goto again;
@@ -236,6 +297,347 @@ again:
   // done
   eb->disable_undo = false;
   hsearch_done(env->mem,hs);
+  rx_free(rx);
+  eb->prompt_text = prompt_text;
+  ic_enable_hint(old_hint);
+  edit_refresh(env,eb);
+  if (c != 0) tty_code_pushback(env->tty, c);
+}
+
+//-------------------------------------------------------------
+// Fuzzy history search: show a ranked list of all entries 
+// that contain the input as a subsequence.
+//-------------------------------------------------------------
+
+#define IC_FUZZY_SHOW_MAX   (8)   // number of matches shown
+#define IC_FUZZY_RECENCY    (12)  // maximal bonus for recent entries
+#define IC_FUZZY_CHUNK      (2048)  // entries scored between checks for a pending key
+
+typedef struct fuzzy_match_s {
+  ssize_t hidx;     // history index
+  ssize_t score;    // match score including the recency bonus
+} fuzzy_match_t;
+
+static bool fuzzy_char_eq(const char* s, ssize_t n, const char* p, ssize_t m, bool icase) {
+  if (n != m) return false;
+  if (n == 1 && icase) return (ic_tolower(s[0]) == ic_tolower(p[0]));
+  return (strncmp(s, p, to_size_t(n)) == 0);
+}
+
+static bool fuzzy_is_word_start(const char* s, ssize_t i) {
+  if (i == 0) return true;
+  const char prev = s[i-1];
+  const char c = s[i];
+  if ((prev >= 'a' && prev <= 'z') && (c >= 'A' && c <= 'Z')) return true;  // camelCase
+  return !(ic_char_is_letter(&prev, 1) || ic_char_is_digit(&prev, 1) || (uint8_t)prev >= 0x80);
+}
+
+// Score `pat` as a subsequence of `s`, or return -1 if it does not match.
+// Each matched character scores, with a bonus for consecutive characters and
+// starts of words, while gaps are penalized. We first find the leftmost match end
+// and then match backward from there to find the shortest match.
+// If `mpos` is not NULL, it receives the offset of each matched pattern character.
+static ssize_t fuzzy_score(const char* s, const char* pat, bool icase, ssize_t* mpos) {
+  const ssize_t slen = ic_strlen(s);
+  const ssize_t plen = ic_strlen(pat);
+  ssize_t i = 0;
+  ssize_t j = 0;
+  ssize_t k = 0;  // matched pattern characters
+  while (j < plen) {
+    const ssize_t pn = str_next_ofs(pat, plen, j, NULL);
+    if (pn <= 0) return -1;
+    bool eq = false;
+    while (!eq) {
+      if (i >= slen) return -1;
+      const ssize_t sn = str_next_ofs(s, slen, i, NULL);
+      if (sn <= 0) return -1;
+      eq = fuzzy_char_eq(s + i, sn, pat + j, pn, icase);
+      i += sn;
+    }
+    j += pn;
+    k++;
+  }
+  ssize_t score = 0;
+  ssize_t next = -1;  // offset of the next matched character
+  while (j > 0) {
+    const ssize_t pn = str_prev_ofs(pat, j, NULL);
+    j -= pn;
+    ssize_t sn;
+    do {
+      sn = str_prev_ofs(s, i, NULL);
+      i -= sn;
+    } while (!fuzzy_char_eq(s + i, sn, pat + j, pn, icase));
+    if (mpos != NULL) { mpos[--k] = i; }
+    score += 16;
+    if (fuzzy_is_word_start(s, i)) { score += 8; }
+    if (next >= 0) {
+      const ssize_t gap = next - (i + sn);
+      if (gap == 0) { score += 12; }
+               else { score -= 3 + (gap > 16 ? 16 : gap - 1); }
+    }
+    next = i;
+  }
+  score -= (i > 8 ? 8 : i);  // leading gap
+  return (score < 0 ? 0 : score);
+}
+
+// Quick check if the bytes of `pat` are a subsequence of `s`. This is implied by a match,
+// and is much faster to reject an entry with as `strchr` and `strpbrk` are vectorized in most
+// C libraries (with either case of a letter as the set for `strpbrk` if `icase` is set).
+static bool fuzzy_may_match(const char* s, const char* pat, bool icase) {
+  for (; *pat != 0 && s != NULL; pat++) {
+    const char c = *pat;
+    if (icase && ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'))) {
+      const char set[3] = { (char)(c | 0x20), (char)(c & ~0x20), 0 };
+      s = strpbrk(s, set);
+    }
+    else {
+      s = strchr(s, c);
+    }
+    if (s != NULL) s++;
+  }
+  return (s != NULL);
+}
+
+static int fuzzy_match_compare_hidx(const void* p1, const void* p2) {
+  const fuzzy_match_t* m1 = (const fuzzy_match_t*)p1;
+  const fuzzy_match_t* m2 = (const fuzzy_match_t*)p2;
+  return (m1->hidx < m2->hidx ? -1 : (m1->hidx > m2->hidx ? 1 : 0));
+}
+
+static int fuzzy_match_compare(const void* p1, const void* p2) {
+  const fuzzy_match_t* m1 = (const fuzzy_match_t*)p1;
+  const fuzzy_match_t* m2 = (const fuzzy_match_t*)p2;
+  if (m1->score != m2->score) return (m1->score > m2->score ? -1 : 1);
+  return (m1->hidx < m2->hidx ? -1 : (m1->hidx > m2->hidx ? 1 : 0));
+}
+
+static bool fuzzy_ignore_case(const char* pat) {
+  for (; *pat != 0; pat++) {
+    if (*pat >= 'A' && *pat <= 'Z') return false;  // smart case
+  }
+  return true;
+}
+
+typedef struct fuzzy_rank_s {
+  ic_env_t*      env;
+  fuzzy_match_t* matches;
+  ssize_t        count;
+  ssize_t        visited;
+  const char*    pat;
+  bool           icase;
+} fuzzy_rank_t;
+
+static bool fuzzy_rank_visit(ssize_t hidx, const char* entry, void* arg) {
+  fuzzy_rank_t* rank = (fuzzy_rank_t*)arg;
+  if (hidx == 0) return true;  // skip the current input
+  const ssize_t score = (fuzzy_may_match(entry, rank->pat, rank->icase) ? fuzzy_score(entry, rank->pat, rank->icase, NULL) : -1);
+  if (score >= 0) {
+    rank->matches[rank->count].hidx = hidx;
+    rank->matches[rank->count].score = score;
+    rank->count++;
+  }
+  rank->visited++;
+  return (rank->visited % IC_FUZZY_CHUNK != 0 || !edit_search_key_pending(rank->env));
+}
+
+// Rank the history entries that match `pat`. When `refine` is true a character was
+// inserted in the pattern: only the current matches can still match so we just rescore those.
+// Entries are scored on their preview if they are large (so no side files are read), and
+// the older entries are visited in order so each compressed block is decoded only once.
+// To stay responsive on a large history, ranking stops early when a character or backspace 
+// is pending (as it is ranked again right after); returns false in that case with the matches so far.
+static bool fuzzy_rank(ic_env_t* env, fuzzy_match_t* matches, ssize_t* count, const char* pat, bool refine) {
+  const ssize_t hcount = history_count(env->history);
+  const bool icase = fuzzy_ignore_case(pat);
+  bool complete = true;
+  ssize_t n = 0;
+  if (refine) {
+    qsort(matches, to_size_t(*count), sizeof(matches[0]), &fuzzy_match_compare_hidx);
+    for (ssize_t i = 0; i < *count; i++) {
+      if (i > 0 && i % IC_FUZZY_CHUNK == 0 && edit_search_key_pending(env)) {
+        complete = false;
+        break;
+      }
+      matches[n].hidx = matches[i].hidx;
+      const char* entry = history_get_preview(env->history, matches[i].hidx);
+      matches[n].score = (entry != NULL && fuzzy_may_match(entry, pat, icase) ? fuzzy_score(entry, pat, icase, NULL) : -1);
+      if (matches[n].score >= 0) { n++; }
+    }
+  }
+  else {
+    fuzzy_rank_t rank = { env, matches, 0, 0, pat, icase };
+    complete = (history_scan(env->history, 0, true, &fuzzy_rank_visit, &rank) < 0);
+    n = rank.count;
+  }
+  for (ssize_t i = 0; i < n; i++) {
+    matches[i].score += (IC_FUZZY_RECENCY * (hcount - matches[i].hidx)) / hcount;
+  }
+  qsort(matches, to_size_t(n), sizeof(matches[0]), &fuzzy_match_compare);
+  *count = n;
+  return complete;
+}
+
+// Append the first line of a history entry with the matched characters underlined.
+static void edit_fuzzy_append(ic_env_t* env, editor_t* eb, const char* entry, const char* pat, ssize_t* mpos, ssize_t rank, bool selected) {
+  const ssize_t plen = ic_strlen(pat);
+  ssize_t k = 0;
+  if (plen > 0 && fuzzy_score(entry, pat, fuzzy_ignore_case(pat), mpos) >= 0) {
+    for (ssize_t j = 0; j < plen; j += str_next_ofs(pat, plen, j, NULL)) { k++; }
+  }
+  sbuf_appendf(eb->extra, "[ic-info]%s%zd [/]", (selected ? (tty_is_utf8(env->tty) ? "\xE2\x86\x92" : "*") : " "), 1 + rank);
+  const ssize_t width = eb->termw - 5;
+  if (width > 0) { sbuf_appendf(eb->extra, "[width=\"%zd;left; ;on\"]", width); }
+  sbuf_append(eb->extra, (selected ? "[ic-emphasis]" : "[ic-diminish]"));
+  const ssize_t len = ic_strlen(entry);
+  const char* nl = strchr(entry, '\n');
+  const ssize_t end = (nl == NULL ? len : nl - entry);
+  ssize_t pos = 0;
+  for (ssize_t m = 0; m < k && mpos[m] < end; m++) {
+    const ssize_t n = str_next_ofs(entry, len, mpos[m], NULL);
+    sbuf_append(eb->extra, "[!pre]");
+    sbuf_append_n(eb->extra, entry + pos, mpos[m] - pos);
+    sbuf_append(eb->extra, "[/pre][u ic-emphasis][!pre]");
+    sbuf_append_n(eb->extra, entry + mpos[m], n);
+    sbuf_append(eb->extra, "[/pre][/u]");
+    pos = mpos[m] + n;
+  }
+  sbuf_append(eb->extra, "[!pre]");
+  sbuf_append_n(eb->extra, entry + pos, end - pos);
+  if (end < len) { sbuf_append(eb->extra, (tty_is_utf8(env->tty) ? " \xE2\x80\xA6" : " ...")); }
+  sbuf_append(eb->extra, "[/pre]");
+  sbuf_append(eb->extra, (selected ? "[/ic-emphasis]" : "[/ic-diminish]"));
+  if (width > 0) { sbuf_append(eb->extra, "[/width]"); }
+  sbuf_append(eb->extra, "\n");
+}
+
+static void edit_history_fuzzy_search(ic_env_t* env, editor_t* eb, char* initial) {
+  const ssize_t hcount = history_count(env->history);
+  if (hcount <= 1) {
+    term_beep(env->term);
+    return;
+  }
+
+  // update history
+  if (eb->modified) { 
+    history_update(env->history, sbuf_string(eb->input)); // update first entry if modified
+    eb->history_idx = 0;               // and start again 
+    eb->modified = false;
+  }
+
+  fuzzy_match_t* matches = mem_malloc_tp_n(eb->mem, fuzzy_match_t, hcount);
+  if (matches == NULL) return;
+  ssize_t* mpos = NULL;   // matched positions for display
+  
+  // set a search prompt and remember the previous state
+  editor_undo_capture(eb);
+  eb->disable_undo = true;
+  bool old_hint = ic_enable_hint(false);  
+  const char* prompt_text = eb->prompt_text;
+  eb->prompt_text = "history search";
+  sbuf_replace(eb->input, (initial != NULL ? initial : ""));
+  eb->pos = sbuf_len(eb->input);
+
+  ssize_t count = 0;      // current number of matches
+  ssize_t selected = 0;   // selected match
+  bool complete = fuzzy_rank(env, matches, &count, sbuf_string(eb->input), false);  // are all entries ranked?
+  code_t c;
+
+again:
+  if (count == 0) {
+    sbuf_append(eb->extra, "[ic-info](no matches)[/]\n");
+  }
+  else {
+    mem_free(eb->mem, mpos);
+    mpos = mem_malloc_tp_n(eb->mem, ssize_t, sbuf_len(eb->input) + 1);
+    if (mpos != NULL) {
+      const ssize_t first = (selected >= IC_FUZZY_SHOW_MAX ? selected - IC_FUZZY_SHOW_MAX + 1 : 0);
+      for (ssize_t i = first; i < count && i < first + IC_FUZZY_SHOW_MAX; i++) {
+        edit_fuzzy_append(env, eb, history_get(env->history, matches[i].hidx), sbuf_string(eb->input), mpos, i, (i == selected));
+      }
+    }
+    if (count > IC_FUZZY_SHOW_MAX) {
+      sbuf_appendf(eb->extra, "[ic-info](%zd matches)[/]\n", count);
+    }
+  }
+  if (!env->no_help) {
+    sbuf_append(eb->extra, "[ic-info](use tab or up/down to select a match)[/]\n");
+  }
+  edit_refresh(env, eb);
+
+  // finish an interrupted ranking unless the pattern changes again
+  if (!complete && !edit_search_key_pending(env)) {
+    complete = fuzzy_rank(env, matches, &count, sbuf_string(eb->input), false);
+    selected = 0;
+    sbuf_clear(eb->extra);
+    goto again;
+  }
+
+  // Wait for input
+  c = tty_read(env->tty);
+  if (tty_term_resize_event(env->tty)) {
+    edit_resize(env, eb);
+  }
+  sbuf_clear(eb->extra);
+
+  // Process commands
+  if (c == KEY_ESC || c == KEY_BELL /* ^G */ || c == KEY_CTRL_C || c == KEY_EVENT_STOP || (c == KEY_ENTER && count == 0)) {
+    if (c != KEY_EVENT_STOP) { c = 0; }  // the editor stops as well on a stop event
+    eb->disable_undo = false;
+    editor_undo_restore(eb, false);
+  } 
+  else if (c == KEY_ENTER) {
+    c = 0;
+    editor_undo_forget(eb);
+    sbuf_replace(eb->input, history_get(env->history, matches[selected].hidx));
+    eb->pos = sbuf_len(eb->input);
+    eb->modified = false;
+    eb->history_idx = matches[selected].hidx;
+  }  
+  else if (c == KEY_CTRL_R || c == KEY_TAB || c == KEY_DOWN) {    
+    if (selected + 1 < count) { selected++; }
+                         else { term_beep(env->term); }
+    goto again;
+  }  
+  else if (c == KEY_CTRL_S || c == KEY_SHIFT_TAB || c == KEY_UP) {    
+    if (selected > 0) { selected--; }
+                 else { term_beep(env->term); }
+    goto again;
+  }
+  else if (c == KEY_BACKSP) {
+    edit_backspace(env, eb);
+    complete = fuzzy_rank(env, matches, &count, sbuf_string(eb->input), false);
+    selected = 0;
+    goto again;
+  }
+  else if (c == KEY_F1) {
+    edit_show_help(env, eb);
+    goto again;
+  }
+  else {
+    // insert character and rescore the current matches
+    char chr;
+    unicode_t uchr;
+    if (code_is_ascii_char(c,&chr)) {
+      edit_insert_char(env,eb,chr);      
+    }
+    else if (code_is_unicode(c,&uchr)) {
+      edit_insert_unicode(env,eb,uchr);
+    }
+    else {
+      // ignore command
+      term_beep(env->term);
+      goto again;
+    }
+    complete = fuzzy_rank(env, matches, &count, sbuf_string(eb->input), complete);  // only refine a complete ranking
+    selected = 0;
+    goto again;
+  }
+
+  // done
+  eb->disable_undo = false;
+  mem_free(eb->mem, mpos);
+  mem_free(eb->mem, matches);
   eb->prompt_text = prompt_text;
   ic_enable_hint(old_hint);
   edit_refresh(env,eb);
@@ -255,6 +657,11 @@ static void edit_history_search_with_current_word(ic_env_t* env, editor_t* eb) {
       initial = mem_strndup(eb->mem, sbuf_string(eb->input) + start, eb->pos - start);
     }
   }
-  edit_history_search( env, eb, initial);
+  if (env->history_fuzzy) {
+    edit_history_fuzzy_search(env, eb, initial);
+  }
+  else {
+    edit_history_search(env, eb, initial);
+  }
   mem_free(env->mem, initial);
 }
@@ -16,6 +16,9 @@
 #include "history.h"
 #include "completions.h"
 #include "bbcode.h"
+#include "draft.h"
+#include "ccache.h"
+#include "rmodel.h"
 
 //-------------------------------------------------------------
 // Environment
@@ -29,6 +32,13 @@ struct ic_env_s {
   completions_t*  completions;      // current completions
   history_t*      history;          // edit history
   bbcode_t*       bbcode;           // print with bbcodes
+  draft_t*        draft;            // draft journal (NULL if not enabled)
+  trace_t*        trace;            // keystroke trace (NULL if not recording)
+  ccache_t*       ccache;           // completion cache (created upfront so other threads can use it)
+  long            filename_cache_ttl; // cache filename completions for this many milliseconds (0 to disable)
+  rmodel_t*       rmodel;           // render model (NULL if rendering to the terminal)
+  ic_render_fun_t* render;          // receives the render model
+  void*           render_arg;       // user state for `render`
   const char*     prompt_marker;    // the prompt marker (defaults to "> ")
   const char*     cprompt_marker;   // prompt marker for continuation lines (defaults to `prompt_marker`)
   ic_highlight_fun_t* highlighter;  // highlight callback
@@ -37,10 +47,12 @@ struct ic_env_s {
   const char*     auto_braces;      // auto insertion braces, e.g "()[]{}\"\"''"
   char            multiline_eol;    // character used for multiline input ("\") (set to 0 to disable)
   bool            initialized;      // are we initialized?
+  bool            tty_init;         // was the tty created? (this is done on first use)
   bool            noedit;           // is rich editing possible (tty != NULL)
   bool            singleline_only;  // allow only single line editing?
   bool            complete_nopreview; // do not show completion preview for each selection in the completion menu?
   bool            complete_autotab; // try to keep completing after a completion?
+  bool            history_fuzzy;    // use fuzzy ranked history search?
   bool            no_multiline_indent; // indent continuation lines to line up under the initial prompt 
   bool            no_help;          // show short help line for history search etc.
   bool            no_hint;          // allow hinting?
@@ -49,11 +61,23 @@ struct ic_env_s {
   bool            no_autobrace;     // enable automatic brace insertion?
   bool            no_lscolors;      // use LSCOLORS/LS_COLORS to colorize file name completions?
   long            hint_delay;       // delay before displaying a hint in milliseconds
+  long            hint_computed;    // number of hints computed (completer calls)
+  long            hint_avoided;     // number of hint computations avoided as typing continued
+  int64_t         hint_cost_us;     // average duration of computing a hint in micro-seconds
+  int64_t         key_interval_us;  // average interval between typed keys in micro-seconds (0 if unknown)
+  int64_t         key_last_us;      // time of the last typed key
+  long            highlight_budget; // time budget for highlighting in milliseconds (0 for no limit)
+  long            highlight_last_us; // duration of the last highlighting in micro-seconds
+  ic_highlight_level_t highlight_level; // current level; lowered if highlighting is repeatedly too slow
+  ssize_t         highlight_slow;   // consecutive highlighting calls over budget
+  ssize_t         highlight_slow_len; // input length at which the level was last lowered
 };
 
 ic_private char*        ic_editline(ic_env_t* env, const char* prompt_text);
+ic_private long         edit_hint_pause(ic_env_t* env);  // current pause before computing a hint in milliseconds
 
 ic_private ic_env_t*    ic_get_env(void);
+ic_private tty_t*       ic_env_get_tty(ic_env_t* env);
 ic_private const char*  ic_env_get_auto_braces(ic_env_t* env);
 ic_private const char*  ic_env_get_match_braces(ic_env_t* env);
 
@@ -11,6 +11,7 @@
 #include "stringbuf.h"
 #include "attr.h"
 #include "bbcode.h"
+#include "vtext.h"
 
 //-------------------------------------------------------------
 // Syntax highlighting
@@ -18,8 +19,10 @@
 
 struct ic_highlight_env_s {
   attrbuf_t*    attrs;
+  vtext_t*      vtexts;  // annotations (can be NULL)
   const char*   input;   
   ssize_t       input_len;     
+  ssize_t       input_ofs;    // offset of `input` in the full input (if only a part is highlighted)
   bbcode_t*     bbcode;
   alloc_t*      mem;
   ssize_t       cached_upos;  // cached unicode position
@@ -27,20 +30,32 @@ struct ic_highlight_env_s {
 };
 
 
-ic_private void highlight( alloc_t* mem, bbcode_t* bb, const char* s, attrbuf_t* attrs, ic_highlight_fun_t* highlighter, void* arg ) {
+// Highlight `s`; only the part from `start` to `end` is passed to the highlighter (use 0 and -1 for all of `s`).
+ic_private void highlight( alloc_t* mem, bbcode_t* bb, const char* s, ssize_t start, ssize_t end, attrbuf_t* attrs, vtext_t* vtexts, ic_highlight_fun_t* highlighter, void* arg ) {
   const ssize_t len = ic_strlen(s);
   if (len <= 0) return;
   attrbuf_set_at(attrs,0,len,attr_none()); // fill to length of s
   if (highlighter != NULL) {
+    if (start < 0) start = 0;
+    if (end < 0 || end > len) end = len;
+    if (start >= end) return;
+    char* part = NULL;
+    if (start > 0 || end < len) {
+      part = mem_strndup(mem, s + start, end - start);
+      if (part == NULL) return;
+    }
     ic_highlight_env_t henv;
     henv.attrs = attrs;
-    henv.input = s;     
-    henv.input_len = len;
+    henv.vtexts = vtexts;
+    henv.input = (part != NULL ? part : s);     
+    henv.input_len = end - start;
+    henv.input_ofs = start;
     henv.bbcode = bb;
     henv.mem = mem;
     henv.cached_cpos = 0;
     henv.cached_upos = 0;
-    (*highlighter)( &henv, s, arg );    
+    (*highlighter)( &henv, henv.input, arg );    
+    mem_free(mem, part);
   }
 }
 
@@ -100,7 +115,9 @@ static void highlight_attr(ic_highlight_env_t* henv, ssize_t pos, ssize_t count,
   if (henv==NULL) return;
   pos_adjust(henv,&pos,&count);
   if (pos < 0 || count <= 0) return;
-  attrbuf_update_at(henv->attrs, pos, count, attr);
+  if (pos + count > henv->input_len) { count = henv->input_len - pos; }  // stay within the highlighted part
+  if (count <= 0) return;
+  attrbuf_update_at(henv->attrs, henv->input_ofs + pos, count, attr);
 }
 
 ic_public void ic_highlight(ic_highlight_env_t* henv, long pos, long count, const char* style ) {
@@ -108,18 +125,30 @@ ic_public void ic_highlight(ic_highlight_env_t* henv, long pos, long count, cons
   highlight_attr(henv,pos,count,bbcode_style( henv->bbcode, style ));
 }
 
+ic_public void ic_highlight_annotate(ic_highlight_env_t* henv, long pos, const char* text, const char* style) {
+  if (henv == NULL || text == NULL || text[0] == 0) return;
+  ssize_t spos = pos;
+  ssize_t len = 0;
+  pos_adjust(henv, &spos, &len);
+  if (spos < 0) return;
+  if (spos > henv->input_len) spos = henv->input_len;
+  const attr_t attr = (style == NULL || style[0] == 0 ? attr_none() : bbcode_style(henv->bbcode, style));
+  vtext_add(henv->vtexts, henv->input_ofs + spos, text, -1, attr, false);
+}
+
 ic_public void ic_highlight_formatted(ic_highlight_env_t* henv, const char* s, const char* fmt) {
   if (s==NULL || s[0] == 0 || fmt==NULL) return;
   attrbuf_t* attrs = attrbuf_new(henv->mem);
   stringbuf_t* out = sbuf_new(henv->mem);  // todo: avoid allocating out?
   if (attrs!=NULL && out != NULL) {
     bbcode_append( henv->bbcode, fmt, out, attrs);
-    const ssize_t len = ic_strlen(s);
+    ssize_t len = ic_strlen(s);
+    if (len > henv->input_len) { len = henv->input_len; }
     if (sbuf_len(out) != len) {
       debug_msg("highlight: formatted string content differs from the original input:\n  original: %s\n  formatted: %s\n", s, fmt);
     }
     for( ssize_t i = 0; i < len; i++) {
-      attrbuf_update_at(henv->attrs, i, 1, attrbuf_attr_at(attrs,i));
+      attrbuf_update_at(henv->attrs, henv->input_ofs + i, 1, attrbuf_attr_at(attrs,i));
     }
   }
   sbuf_free(out);
@@ -12,12 +12,13 @@
 #include "attr.h"
 #include "term.h"
 #include "bbcode.h"
+#include "vtext.h"
 
 //-------------------------------------------------------------
 // Syntax highlighting
 //-------------------------------------------------------------
 
-ic_private void highlight( alloc_t* mem, bbcode_t* bb, const char* s, attrbuf_t* attrs, ic_highlight_fun_t* highlighter, void* arg );
+ic_private void highlight( alloc_t* mem, bbcode_t* bb, const char* s, ssize_t start, ssize_t end, attrbuf_t* attrs, vtext_t* vtexts, ic_highlight_fun_t* highlighter, void* arg );
 ic_private void highlight_match_braces(const char* s, attrbuf_t* attrs, ssize_t cursor_pos, const char* braces, attr_t match_attr, attr_t error_attr);
 ic_private ssize_t find_matching_brace(const char* s, ssize_t cursor_pos, const char* braces, bool* is_balanced);
 
@@ -5,28 +5,87 @@
   found in the "LICENSE" file at the root of this distribution.
 -----------------------------------------------------------------------------*/
 #include <stdio.h>
-#include <string.h>  
+#include <stdlib.h>
+#include <string.h>
 #include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#include <io.h>
+#else
+#include <dirent.h>
+#endif
 
 #include "../include/isocline.h"
 #include "common.h"
 #include "history.h"
 #include "stringbuf.h"
+#include "lz.h"
+#include "tindex.h"
 
-#define IC_MAX_HISTORY (200)
+#define IC_MAX_HISTORY      (200)     // default maximum number of entries
+#define IC_HISTORY_HOT      (256)     // at most this many recent entries are kept uncompressed
+#define IC_HISTORY_BLOCK    (128)     // older entries are compressed in blocks of this many entries
+#define IC_HISTORY_BLOB_MIN (4*1024)  // entries of at least this size are stored in a side file
+#define IC_HISTORY_PREVIEW  (80)      // maximal preview length of such entries
+#define IC_HISTORY_BLOB_TAG "#@blob "  // reference to a side file in the history file
+#define IC_HISTORY_BLOOM    (64)      // words in the bloom filter of a block (4096 bits with 3 probes: < 0.1% false positives)
+#define IC_HISTORY_INDEX_STEP (4096)  // entries that are added to the token index in one step (about 4ms)
+
+// A large entry (like a pasted script) is stored once in a side file named by its hash
+// in the `<fname>.blobs` directory; the history file only contains a reference and a preview.
+typedef struct hblob_s {
+  uint64_t hash;               // hash of the entry
+  ssize_t  len;                // length of the entry
+  char     preview[IC_HISTORY_PREVIEW+1];  // start of the first line (a prefix of the entry)
+} hblob_t;
+
+// Older entries are kept in compressed blocks. The uncompressed contents of a block
+// are the history file lines of its entries, so a block is written as is on save.
+typedef struct hblock_s {
+  char*    data;               // compressed lines (oldest first)
+  ssize_t  clen;               // compressed length
+  ssize_t  rlen;               // uncompressed length
+  ssize_t  count;              // number of entries (lines)
+  uint64_t bloom[IC_HISTORY_BLOOM];  // bloom filter of the line hashes (to find duplicates quickly)
+  ssize_t  blobs;              // number of references to large entries
+} hblock_t;
 
 struct history_s {
-  ssize_t  count;              // current number of entries in use
-  ssize_t  len;                // size of elems 
-  const char** elems;         // history items (up to count)
+  ssize_t  count;              // current number of recent entries in use
+  ssize_t  len;                // size of elems
+  const char** elems;         // recent history items (up to count); NULL if a large entry is not yet loaded
+  hblob_t** blobs;            // for each item a blob reference if it is large, or NULL
+  ssize_t  max;                // maximum number of entries (recent and older ones)
+  hblock_t* blocks;           // older entries in compressed blocks (oldest first)
+  ssize_t  block_count;        // number of blocks in use
+  ssize_t  block_len;          // size of blocks
+  ssize_t  cold_count;         // total number of entries in the blocks
+  ssize_t  cached;             // the block that is decompressed in `raw` (or -1)
+  ssize_t  cached_start;       // the index of the first entry in the cached block (from the oldest)
+  char*    raw;                // decompressed block
+  ssize_t  raw_len;            // size of raw
+  ssize_t* lines;              // line offsets in `raw` (count+1)
+  ssize_t  lines_len;          // size of lines
+  stringbuf_t* entry;          // the last decoded older entry (as returned by `history_get`)
+  tindex_t* tokens;           // index of the tokens in the entries (created on first use)
+  ssize_t  tokens_todo;        // the oldest entries that are not yet in the token index
   const char*  fname;         // history file
   alloc_t* mem;
   bool     allow_duplicates;   // allow duplicate entries?
+  bool     loading;            // loading the history file? (then duplicates are only removed at the end)
+  ssize_t  unsaved;            // the newest recent entries that are not yet in the history file
+  ssize_t  file_lines;         // number of lines in the history file (including duplicates and evicted entries)
+  bool     rewrite;            // must the history file be rewritten? (as entries in it were removed)
 };
 
+static void history_cold_clear( history_t* h );
+static void history_delete_at( history_t* h, ssize_t idx );
+static void history_unindex( history_t* h, ssize_t pos, const char* entry );
+
 ic_private history_t* history_new(alloc_t* mem) {
   history_t* h = mem_zalloc_tp(mem,history_t);
   h->mem = mem;
+  h->cached = -1;
   return h;
 }
 
@@ -35,9 +94,16 @@ ic_private void history_free(history_t* h) {
   history_clear(h);
   if (h->len > 0) {
     mem_free( h->mem, h->elems );
+    mem_free( h->mem, h->blobs );
     h->elems = NULL;
+    h->blobs = NULL;
     h->len = 0;
   }
+  mem_free(h->mem, h->blocks);
+  mem_free(h->mem, h->raw);
+  mem_free(h->mem, h->lines);
+  sbuf_free(h->entry);
+  tindex_free(h->tokens);
   mem_free(h->mem, h->fname);
   h->fname = NULL;
   mem_free(h->mem, h); // free ourselves
@@ -50,7 +116,573 @@ ic_private bool history_enable_duplicates( history_t* h, bool enable ) {
 }
 
 ic_private ssize_t  history_count(const history_t* h) {
-  return h->count;
+  return h->count + h->cold_count;
+}
+
+//-------------------------------------------------------------
+// Large entries
+//-------------------------------------------------------------
+
+static uint64_t history_hash( const char* s, ssize_t len ) {
+  uint64_t h = 14695981039346656037ULL;
+  for (ssize_t i = 0; i < len; i++) {
+    h = (h ^ (uint8_t)s[i]) * 1099511628211ULL;  // FNV-1a
+  }
+  return h;
+}
+
+static hblob_t* history_blob_new( history_t* h, const char* entry, ssize_t len, uint64_t hash ) {
+  hblob_t* blob = mem_zalloc_tp(h->mem, hblob_t);
+  if (blob == NULL) return NULL;
+  blob->hash = hash;
+  blob->len  = len;
+  ssize_t n = 0;
+  while (n < IC_HISTORY_PREVIEW && entry[n] != 0 && entry[n] != '\n') { n++; }
+  if (n == IC_HISTORY_PREVIEW) {
+    while (n > 0 && ((uint8_t)entry[n] & 0xC0) == 0x80) { n--; }  // do not split a utf-8 character
+  }
+  ic_memcpy(blob->preview, entry, n);
+  blob->preview[n] = 0;
+  return blob;
+}
+
+// The side file name of a blob (in `buf` of at least `len` bytes); false if there is no history file.
+static bool history_blob_fname( const history_t* h, const hblob_t* blob, char* buf, ssize_t len ) {
+  if (h->fname == NULL) return false;
+  int n = snprintf(buf, to_size_t(len), "%s.blobs/%016llx", h->fname, (unsigned long long)blob->hash);
+  return (n > 0 && n < len);
+}
+
+// Read a blob from its side file; returns NULL if it cannot be read.
+static char* history_blob_load( const history_t* h, const hblob_t* blob ) {
+  char* entry = NULL;
+  char fname[1024]; fname[0] = 0;
+  if (history_blob_fname(h, blob, fname, ssizeof(fname))) {
+    FILE* f = fopen(fname, "rb");
+    if (f != NULL) {
+      entry = mem_malloc_tp_n(h->mem, char, blob->len + 1);
+      if (entry != NULL) {
+        if (fread(entry, 1, to_size_t(blob->len), f) == to_size_t(blob->len)) {
+          entry[blob->len] = 0;
+        }
+        else {
+          mem_free(h->mem, entry); entry = NULL;
+        }
+      }
+      fclose(f);
+    }
+  }
+  if (entry != NULL && (strlen(entry) != to_size_t(blob->len) || history_hash(entry, blob->len) != blob->hash)) {
+    mem_free(h->mem, entry); entry = NULL;
+  }
+  if (entry == NULL) {
+    debug_msg("history: unable to read: %s\n", fname);
+  }
+  return entry;
+}
+
+// Load the entry at `idx` if it was stored in a side file; uses the preview if it cannot be read.
+static const char* history_entry( history_t* h, ssize_t idx ) {
+  if (h->elems[idx] != NULL) return h->elems[idx];
+  const hblob_t* blob = h->blobs[idx];
+  assert(blob != NULL);
+  char* entry = history_blob_load(h, blob);
+  if (entry == NULL) {
+    entry = mem_strdup(h->mem, blob->preview);
+  }
+  h->elems[idx] = entry;
+  return entry;
+}
+
+// The recent entry at `idx`, or just its preview if it is large and not loaded.
+static const char* history_preview( const history_t* h, ssize_t idx ) {
+  return (h->elems[idx] != NULL ? h->elems[idx] : h->blobs[idx]->preview);
+}
+
+// Find `search` in a large entry; its side file is only read if the preview does not match,
+// and then just temporarily (so a search does not keep all side files resident).
+static ssize_t history_blob_match( history_t* h, const hblob_t* blob, const char* search ) {
+  const char* p = strstr(blob->preview, search);
+  if (p != NULL) return (ssize_t)(p - blob->preview);
+  char* entry = history_blob_load(h, blob);
+  if (entry == NULL) return -1;
+  p = strstr(entry, search);
+  const ssize_t pos = (p == NULL ? -1 : (ssize_t)(p - entry));
+  mem_free(h->mem, entry);
+  return pos;
+}
+
+// Write the side file of a blob if it does not exist yet (and the contents are known).
+static void history_blob_save( const history_t* h, const char* entry, const hblob_t* blob ) {
+  char fname[1024];
+  if (entry == NULL || !history_blob_fname(h, blob, fname, ssizeof(fname))) return;
+  struct stat st;
+  if (stat(fname, &st) == 0) return;  // already stored (possibly by another session)
+  if (ic_strlen(entry) != blob->len) return;  // only the preview is known as the side file could not be read
+  char dname[1024];
+  snprintf(dname, sizeof(dname), "%s.blobs", h->fname);
+  #ifdef _WIN32
+  _mkdir(dname);
+  #else
+  mkdir(dname, S_IRWXU);
+  #endif
+  // write to a temporary file first so a partial write is never used
+  char tname[1040];
+  snprintf(tname, sizeof(tname), "%s.tmp", fname);
+  FILE* f = fopen(tname, "wb");
+  if (f == NULL) return;
+  #ifndef _WIN32
+  chmod(tname,S_IRUSR|S_IWUSR);
+  #endif
+  bool ok = (fwrite(entry, 1, to_size_t(blob->len), f) == to_size_t(blob->len));
+  ok = (fclose(f) == 0) && ok;
+  if (!ok || rename(tname, fname) != 0) {
+    remove(tname);
+  }
+}
+
+static bool history_is_eq( history_t* h, ssize_t idx, const char* entry, ssize_t len, uint64_t hash ) {
+  const hblob_t* blob = h->blobs[idx];
+  if (blob != NULL) return (blob->len == len && blob->hash == hash);
+  return (entry != NULL && len < IC_HISTORY_BLOB_MIN && strcmp(h->elems[idx], entry) == 0);
+}
+
+//-------------------------------------------------------------
+// Encoding of entries as lines in the history file
+//-------------------------------------------------------------
+
+static char from_xdigit( int c ) {
+  if (c >= '0' && c <= '9') return (char)(c - '0');
+  if (c >= 'A' && c <= 'F') return (char)(10 + (c - 'A'));
+  if (c >= 'a' && c <= 'f') return (char)(10 + (c - 'a'));
+  return 0;
+}
+
+static char to_xdigit( uint8_t c ) {
+  if (c <= 9) return ((char)c + '0');
+  if (c >= 10 && c <= 15) return ((char)c - 10 + 'A');
+  return '0';
+}
+
+static bool ic_isxdigit( int c ) {
+  return ((c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F') || (c >= '0' && c <= '9'));
+}
+
+// Append the escaped entry to `sbuf`.
+static void history_encode( const char* entry, stringbuf_t* sbuf ) {
+  //debug_msg("history: write: %s\n", entry);
+  while( entry != NULL && *entry != 0 ) {
+    // append plain runs at once
+    const char* plain = entry;
+    while (*plain >= ' ' && *plain <= '~' && *plain != '\\' && *plain != '#') { plain++; }
+    if (plain > entry) {
+      sbuf_append_n(sbuf, entry, (ssize_t)(plain - entry));
+      entry = plain;
+      continue;
+    }
+    char c = *entry++;
+    if (c == '\\')      { sbuf_append(sbuf,"\\\\"); }
+    else if (c == '\n') { sbuf_append(sbuf,"\\n"); }
+    else if (c == '\r') { /* ignore */ } // sbuf_append(sbuf,"\\r"); }
+    else if (c == '\t') { sbuf_append(sbuf,"\\t"); }
+    else if (c < ' ' || c > '~' || c == '#') {
+      char c1 = to_xdigit( (uint8_t)c / 16 );
+      char c2 = to_xdigit( (uint8_t)c % 16 );
+      sbuf_append(sbuf,"\\x");
+      sbuf_append_char(sbuf,c1);
+      sbuf_append_char(sbuf,c2);
+    }
+    else sbuf_append_char(sbuf,c);
+  }
+}
+
+// Decode an escaped line of `len` bytes into `sbuf`; returns false if it is invalid.
+static bool history_decode( const char* s, ssize_t len, stringbuf_t* sbuf ) {
+  sbuf_clear(sbuf);
+  for (ssize_t i = 0; i < len; i++) {
+    // append plain runs at once
+    const char* esc = (const char*)memchr(s + i, '\\', to_size_t(len - i));
+    const ssize_t n = (esc == NULL ? len : (ssize_t)(esc - s)) - i;
+    if (n > 0) {
+      sbuf_append_n(sbuf, s + i, n);
+      i += n;
+      if (i >= len) break;
+    }
+    char c = s[i];
+    if (c == '\\') {
+      c = (i + 1 < len ? s[++i] : 0);
+      if (c == 'n')       { sbuf_append(sbuf,"\n"); }
+      else if (c == 'r')  { /* ignore */ }  // sbuf_append(sbuf,"\r");
+      else if (c == 't')  { sbuf_append(sbuf,"\t"); }
+      else if (c == '\\') { sbuf_append(sbuf,"\\"); }
+      else if (c == 'x' && i + 2 < len && ic_isxdigit(s[i+1]) && ic_isxdigit(s[i+2])) {
+        char chr = from_xdigit(s[i+1])*16 + from_xdigit(s[i+2]);
+        sbuf_append_char(sbuf,chr);
+        i += 2;
+      }
+      else return false;
+    }
+    else sbuf_append_char(sbuf,c);
+  }
+  return true;
+}
+
+// Append the history file line of an entry (without a newline); large entries
+// are written as a reference to their side file: `#@blob <hash> <len> <preview>`
+static void history_encode_line( const history_t* h, const char* entry, const hblob_t* blob, stringbuf_t* sbuf ) {
+  if (blob != NULL && h->fname != NULL) {
+    sbuf_appendf(sbuf, IC_HISTORY_BLOB_TAG "%016llx %lld ", (unsigned long long)blob->hash, (long long)blob->len);
+    history_encode(blob->preview, sbuf);
+  }
+  else {
+    history_encode(entry, sbuf);
+  }
+}
+
+// Parse a decoded blob reference.
+static bool history_parse_blob( const char* line, hblob_t* blob ) {
+  unsigned long long hash = 0;
+  long long len = 0;
+  int n = 0;
+  if (sscanf(line + strlen(IC_HISTORY_BLOB_TAG), "%16llx %lld%n", &hash, &len, &n) < 2) return false;
+  if (len < IC_HISTORY_BLOB_MIN) return false;  // smaller entries are never stored in a side file
+  const char* preview = line + strlen(IC_HISTORY_BLOB_TAG) + n;
+  if (*preview == ' ') { preview++; }
+  blob->hash = (uint64_t)hash;
+  blob->len  = (ssize_t)len;
+  ic_strncpy(blob->preview, ssizeof(blob->preview), preview, IC_HISTORY_PREVIEW);
+  return true;
+}
+
+static bool history_is_blob_line( const char* line, const char* decoded ) {
+  return (line[0] == '#' && strncmp(decoded, IC_HISTORY_BLOB_TAG, strlen(IC_HISTORY_BLOB_TAG)) == 0);
+}
+
+//-------------------------------------------------------------
+// Older entries in compressed blocks
+//-------------------------------------------------------------
+
+// each probe uses 12 bits of the hash
+static void history_bloom_add( uint64_t* bloom, uint64_t hash ) {
+  for (int i = 0; i < 3; i++, hash >>= 12) {
+    bloom[(hash >> 6) & (IC_HISTORY_BLOOM - 1)] |= (1ULL << (hash & 63));
+  }
+}
+
+static bool history_bloom_has( const uint64_t* bloom, uint64_t hash ) {
+  for (int i = 0; i < 3; i++, hash >>= 12) {
+    if ((bloom[(hash >> 6) & (IC_HISTORY_BLOOM - 1)] & (1ULL << (hash & 63))) == 0) return false;
+  }
+  return true;
+}
+
+// Compress `count` lines in `raw` into block `blk`.
+static bool history_block_pack( history_t* h, hblock_t* blk, const char* raw, ssize_t rlen, ssize_t count ) {
+  ssize_t clen;
+  char* data = lz_compress(h->mem, raw, rlen, &clen);
+  if (data == NULL) return false;
+  mem_free(h->mem, blk->data);
+  blk->data  = data;
+  blk->clen  = clen;
+  blk->rlen  = rlen;
+  blk->count = count;
+  memset(blk->bloom, 0, sizeof(blk->bloom));
+  blk->blobs = 0;
+  ssize_t start = 0;
+  for (ssize_t i = 0; i < rlen; i++) {
+    if (raw[i] == '\n') {
+      history_bloom_add(blk->bloom, history_hash(raw + start, i - start));
+      if (raw[start] == '#') { blk->blobs++; }  // a `#` in an entry is always escaped
+      start = i + 1;
+    }
+  }
+  return true;
+}
+
+// Decompress block `b` (whose first entry is `start`) into `raw` and find its lines.
+static bool history_block_load( history_t* h, ssize_t b, ssize_t start ) {
+  if (h->cached == b) return true;
+  h->cached = -1;
+  const hblock_t* blk = &h->blocks[b];
+  if (h->raw_len < blk->rlen + 1) {
+    char* raw = mem_realloc_tp(h->mem, char, h->raw, blk->rlen + 1);
+    if (raw == NULL) return false;
+    h->raw = raw;
+    h->raw_len = blk->rlen + 1;
+  }
+  if (h->lines_len < blk->count + 1) {
+    ssize_t* lines = mem_realloc_tp(h->mem, ssize_t, h->lines, blk->count + 1);
+    if (lines == NULL) return false;
+    h->lines = lines;
+    h->lines_len = blk->count + 1;
+  }
+  if (!lz_decompress(blk->data, blk->clen, h->raw, blk->rlen)) {
+    debug_msg("history: corrupt block %zd\n", b);
+    return false;
+  }
+  h->raw[blk->rlen] = 0;
+  ssize_t n = 0;
+  h->lines[0] = 0;
+  const char* p = h->raw;
+  const char* end = h->raw + blk->rlen;
+  while (n < blk->count && (p = (const char*)memchr(p, '\n', to_size_t(end - p))) != NULL) {
+    p++;
+    h->lines[++n] = p - h->raw;
+  }
+  if (n != blk->count) return false;
+  h->cached = b;
+  h->cached_start = start;
+  return true;
+}
+
+// Find and load the block of the older entry `g` (counting from the oldest);
+// returns the block index (or -1) and the line in that block in `*k`.
+static ssize_t history_block_find( history_t* h, ssize_t g, ssize_t* k ) {
+  if (g < 0 || g >= h->cold_count) return -1;
+  // start at the cached block as access is mostly sequential
+  ssize_t b = 0;
+  ssize_t start = 0;
+  if (h->cached >= 0) {
+    b = h->cached;
+    start = h->cached_start;
+  }
+  while (g < start) {
+    b--;
+    start -= h->blocks[b].count;
+  }
+  while (g >= start + h->blocks[b].count) {
+    start += h->blocks[b].count;
+    b++;
+  }
+  if (!history_block_load(h, b, start)) return -1;
+  *k = g - start;
+  return b;
+}
+
+// Decode line `k` of the loaded block; large entries are read from their side file if `full` is set
+// (and otherwise just their preview is returned). The result is valid until the next call.
+static const char* history_block_entry( history_t* h, ssize_t k, bool full ) {
+  if (h->entry == NULL) {
+    h->entry = sbuf_new(h->mem);
+    if (h->entry == NULL) return NULL;
+  }
+  const char* line = h->raw + h->lines[k];
+  if (!history_decode(line, h->lines[k+1] - h->lines[k] - 1, h->entry)) return NULL;
+  if (history_is_blob_line(line, sbuf_string(h->entry))) {
+    hblob_t blob;
+    if (history_parse_blob(sbuf_string(h->entry), &blob)) {
+      char* s = (full ? history_blob_load(h, &blob) : NULL);
+      sbuf_replace(h->entry, (s != NULL ? s : blob.preview));
+      mem_free(h->mem, s);
+    }
+  }
+  return sbuf_string(h->entry);
+}
+
+// Delete the older entry `g`; its block is compressed again without it.
+static bool history_cold_delete_at( history_t* h, ssize_t g ) {
+  ssize_t k;
+  const ssize_t b = history_block_find(h, g, &k);
+  if (b < 0) return false;
+  if (h->tokens != NULL) { history_unindex(h, g, history_block_entry(h, k, false)); }
+  hblock_t* blk = &h->blocks[b];
+  h->cached = -1;
+  if (blk->count <= 1) {
+    mem_free(h->mem, blk->data);
+    ic_memmove(h->blocks + b, h->blocks + b + 1, (h->block_count - b - 1) * ssizeof(hblock_t));
+    h->block_count--;
+  }
+  else {
+    const ssize_t start = h->lines[k];
+    const ssize_t end   = h->lines[k+1];
+    ic_memmove(h->raw + start, h->raw + end, blk->rlen - end);
+    if (!history_block_pack(h, blk, h->raw, blk->rlen - (end - start), blk->count - 1)) return false;
+  }
+  h->cold_count--;
+  return true;
+}
+
+// Remove the older entries with the given history file line.
+static void history_cold_remove( history_t* h, const char* line, ssize_t len ) {
+  const uint64_t hash = history_hash(line, len);
+  ssize_t b = 0;
+  ssize_t start = 0;
+  while (b < h->block_count) {
+    const hblock_t* blk = &h->blocks[b];
+    ssize_t found = -1;
+    if (history_bloom_has(blk->bloom, hash) && history_block_load(h, b, start)) {
+      for (ssize_t k = 0; k < blk->count; k++) {
+        if (h->lines[k+1] - h->lines[k] - 1 == len && memcmp(h->raw + h->lines[k], line, to_size_t(len)) == 0) {
+          found = k;
+          break;
+        }
+      }
+    }
+    if (found >= 0 && history_cold_delete_at(h, start + found)) {
+      continue;  // look at the same block again
+    }
+    start += blk->count;
+    b++;
+  }
+}
+
+// Move the oldest recent entries to a new compressed block.
+static bool history_cold_pack( history_t* h ) {
+  const ssize_t n = (h->count < IC_HISTORY_BLOCK ? h->count : IC_HISTORY_BLOCK);
+  if (n <= 0) return false;
+  if (h->block_count >= h->block_len) {
+    const ssize_t newlen = (h->block_len <= 0 ? 8 : 2*h->block_len);
+    hblock_t* blocks = mem_realloc_tp(h->mem, hblock_t, h->blocks, newlen);
+    if (blocks == NULL) return false;
+    h->blocks = blocks;
+    h->block_len = newlen;
+  }
+  stringbuf_t* sbuf = sbuf_new(h->mem);
+  if (sbuf == NULL) return false;
+  if (h->unsaved > h->count - n) {
+    // unsaved entries are compressed: just write the whole file on the next save
+    h->rewrite = true;
+    h->unsaved = h->count - n;
+  }
+  for (ssize_t i = 0; i < n; i++) {
+    if (h->blobs[i] != NULL) { history_blob_save(h, h->elems[i], h->blobs[i]); }
+    history_encode_line(h, h->elems[i], h->blobs[i], sbuf);
+    sbuf_append_char(sbuf, '\n');
+  }
+  hblock_t* blk = &h->blocks[h->block_count];
+  memset(blk, 0, sizeof(*blk));
+  const bool ok = history_block_pack(h, blk, sbuf_string(sbuf), sbuf_len(sbuf), n);
+  sbuf_free(sbuf);
+  if (!ok) return false;
+  h->block_count++;
+  h->cold_count += n;
+  // and remove them from the recent entries
+  for (ssize_t i = 0; i < n; i++) {
+    mem_free(h->mem, h->elems[i]);
+    mem_free(h->mem, h->blobs[i]);
+  }
+  ic_memmove(h->elems, h->elems + n, (h->count - n) * ssizeof(h->elems[0]));
+  ic_memmove(h->blobs, h->blobs + n, (h->count - n) * ssizeof(h->blobs[0]));
+  h->count -= n;
+  return true;
+}
+
+static void history_cold_clear( history_t* h ) {
+  for (ssize_t b = 0; b < h->block_count; b++) {
+    mem_free(h->mem, h->blocks[b].data);
+  }
+  h->block_count = 0;
+  h->cold_count = 0;
+  h->cached = -1;
+}
+
+// Find `search` in line `k` of the loaded block (matching large entries like `history_blob_match`).
+static ssize_t history_block_match( history_t* h, ssize_t k, const char* search ) {
+  if (h->entry == NULL) {
+    h->entry = sbuf_new(h->mem);
+    if (h->entry == NULL) return -1;
+  }
+  const char* line = h->raw + h->lines[k];
+  if (!history_decode(line, h->lines[k+1] - h->lines[k] - 1, h->entry)) return -1;
+  const char* s = sbuf_string(h->entry);
+  hblob_t blob;
+  if (history_is_blob_line(line, s) && history_parse_blob(s, &blob)) {
+    return history_blob_match(h, &blob, search);
+  }
+  const char* p = strstr(s, search);
+  return (p == NULL ? -1 : (ssize_t)(p - s));
+}
+
+// Search the older entries starting at `g` (towards older ones if `backward`) using the escaped search string `esearch`
+// to skip blocks quickly (unless they contain large entries).
+static bool history_cold_search( history_t* h, ssize_t g, bool backward, const char* search, const char* esearch, ssize_t* gfound, ssize_t* pos ) {
+  const ssize_t elen = ic_strlen(esearch);
+  while (g >= 0 && g < h->cold_count) {
+    ssize_t k;
+    const ssize_t b = history_block_find(h, g, &k);
+    if (b < 0) return false;
+    const hblock_t* blk = &h->blocks[b];
+    if (elen == 0 || blk->blobs > 0 || ic_memmem(h->raw, blk->rlen, esearch, elen) >= 0) {
+      for ( ; k >= 0 && k < blk->count; k += (backward ? -1 : 1)) {
+        const ssize_t p = history_block_match(h, k, search);
+        if (p >= 0) {
+          *gfound = h->cached_start + k;
+          *pos = p;
+          return true;
+        }
+      }
+    }
+    g = (backward ? h->cached_start - 1 : h->cached_start + blk->count);
+  }
+  return false;
+}
+
+// Add `hash` to the open addressed set `set` of `size` (a power of 2); returns false if it was already present.
+static bool history_hset_add( uint64_t* set, ssize_t size, uint64_t hash ) {
+  if (hash == 0) hash = 1;  // 0 is an empty slot
+  ssize_t i = (ssize_t)(hash & (uint64_t)(size - 1));
+  while (set[i] != 0) {
+    if (set[i] == hash) return false;
+    i = (i + 1) & (size - 1);
+  }
+  set[i] = hash;
+  return true;
+}
+
+// Remove the entries that are duplicates of newer ones. This is done once after loading
+// the history file (as `history_push_blob` does not check for duplicates then).
+static void history_dedup( history_t* h ) {
+  if (h->allow_duplicates || history_count(h) <= 1) return;
+  ssize_t size = 64;
+  while (size < 2*(h->count + h->cold_count)) { size *= 2; }
+  uint64_t* set = mem_zalloc_tp_n(h->mem, uint64_t, size);
+  stringbuf_t* line = sbuf_new(h->mem);
+  if (set != NULL && line != NULL) {
+    // the recent entries from the newest to the oldest
+    for (ssize_t i = h->count - 1; i >= 0; i--) {
+      sbuf_clear(line);
+      history_encode_line(h, h->elems[i], h->blobs[i], line);
+      if (!history_hset_add(set, size, history_hash(sbuf_string(line), sbuf_len(line)))) {
+        history_delete_at(h, i);
+      }
+    }
+    // and visit the blocks from the newest line to the oldest
+    ssize_t start = h->cold_count;
+    for (ssize_t b = h->block_count - 1; b >= 0; b--) {
+      hblock_t* blk = &h->blocks[b];
+      start -= blk->count;
+      if (!history_block_load(h, b, start)) break;
+      bool dup[IC_HISTORY_BLOCK];  // blocks have at most `IC_HISTORY_BLOCK` lines
+      bool dups = false;
+      for (ssize_t k = blk->count - 1; k >= 0; k--) {
+        dup[k] = !history_hset_add(set, size, history_hash(h->raw + h->lines[k], h->lines[k+1] - h->lines[k] - 1));
+        if (dup[k]) { dups = true; }
+      }
+      if (!dups) continue;
+      // compact the remaining lines and compress the block again
+      ssize_t rlen = 0;
+      ssize_t count = 0;
+      for (ssize_t k = 0; k < blk->count; k++) {
+        if (dup[k]) continue;
+        const ssize_t n = h->lines[k+1] - h->lines[k];  // including the newline
+        ic_memmove(h->raw + rlen, h->raw + h->lines[k], n);
+        rlen += n;
+        count++;
+      }
+      h->cached = -1;
+      h->cold_count -= (blk->count - count);
+      if (count == 0) {
+        mem_free(h->mem, blk->data);
+        ic_memmove(h->blocks + b, h->blocks + b + 1, (h->block_count - b - 1) * ssizeof(hblock_t));
+        h->block_count--;
+      }
+      else if (!history_block_pack(h, blk, h->raw, rlen, count)) {
+        break;
+      }
+    }
+  }
+  sbuf_free(line);
+  mem_free(h->mem, set);
 }
 
 //-------------------------------------------------------------
@@ -67,43 +699,90 @@ ic_private bool history_update( history_t* h, const char* entry ) {
 
 static void history_delete_at( history_t* h, ssize_t idx ) {
   if (idx < 0 || idx >= h->count) return;
+  if (idx >= h->count - h->unsaved) { h->unsaved--; }
+  history_unindex(h, h->cold_count + idx, history_preview(h, idx));
   mem_free(h->mem, h->elems[idx]);
+  mem_free(h->mem, h->blobs[idx]);
   for(ssize_t i = idx+1; i < h->count; i++) {
     h->elems[i-1] = h->elems[i];
+    h->blobs[i-1] = h->blobs[i];
   }
   h->count--;
 }
 
-ic_private bool history_push( history_t* h, const char* entry ) {
-  if (h->len <= 0 || entry==NULL)  return false;
-  // remove any older duplicate
-  if (!h->allow_duplicates) {
-    for( int i = 0; i < h->count; i++) {
-      if (strcmp(h->elems[i],entry) == 0) {
+static bool history_push_blob( history_t* h, const char* entry, hblob_t* blob ) {
+  if (h->len <= 0 || (entry==NULL && blob==NULL))  return false;
+  const ssize_t len = (blob != NULL ? blob->len : ic_strlen(entry));
+  const uint64_t hash = (blob != NULL ? blob->hash : (len >= IC_HISTORY_BLOB_MIN ? history_hash(entry,len) : 0));
+  if (blob == NULL && len >= IC_HISTORY_BLOB_MIN) {
+    blob = history_blob_new(h, entry, len, hash);
+  }
+  // remove any older duplicate (when loading this is done at the end in `history_dedup`)
+  if (!h->allow_duplicates && !h->loading) {
+    for( ssize_t i = h->count - 1; i >= 0; i--) {
+      if (history_is_eq(h,i,entry,len,hash)) {
         history_delete_at(h,i);
       }
     }
+    if (h->cold_count > 0) {
+      stringbuf_t* line = sbuf_new(h->mem);
+      if (line != NULL) {
+        history_encode_line(h, entry, blob, line);
+        history_cold_remove(h, sbuf_string(line), sbuf_len(line));
+        sbuf_free(line);
+      }
+    }
+  }
+  // delete oldest entry if full
+  if (h->count + h->cold_count >= h->max) {
+    if (h->cold_count > 0) { history_cold_delete_at(h, 0); }
+                      else { history_delete_at(h, 0); }
   }
-  // insert at front
-  if (h->count == h->len) {
-    // delete oldest entry
-    history_delete_at(h,0);    
+  // and compress older entries if there is no room for recent ones
+  if (h->count == h->len && !history_cold_pack(h)) {
+    history_delete_at(h,0);
   }
   assert(h->count < h->len);
-  h->elems[h->count] = mem_strdup(h->mem,entry);
+  h->elems[h->count] = (entry != NULL ? mem_strdup(h->mem,entry) : NULL);
+  h->blobs[h->count] = blob;
   h->count++;
+  if (!h->loading) { h->unsaved++; }
+  if (h->tokens != NULL) {
+    const char* s = history_preview(h, h->count - 1);
+    tindex_add(h->tokens, s, ic_strlen(s), false);
+  }
   return true;
 }
 
+ic_private bool history_push( history_t* h, const char* entry ) {
+  return history_push_blob(h, entry, NULL);
+}
+
 
 static void history_remove_last_n( history_t* h, ssize_t n ) {
   if (n <= 0) return;
-  if (n > h->count) n = h->count;
-  for( ssize_t i = h->count - n; i < h->count; i++) {
+  ssize_t m = (n > h->count ? h->count : n);
+  if (n > h->unsaved) { h->rewrite = true; }  // saved entries are removed
+  h->unsaved = (n > h->unsaved ? 0 : h->unsaved - n);
+  for( ssize_t i = h->count - 1; i >= h->count - m; i--) {
+    history_unindex(h, h->cold_count + i, history_preview(h, i));
     mem_free( h->mem, h->elems[i] );
+    mem_free( h->mem, h->blobs[i] );
+  }
+  h->count -= m;
+  assert(h->count >= 0);
+  // and older entries
+  n -= m;
+  if (n >= h->cold_count) {
+    history_cold_clear(h);
+  }
+  else {
+    while (n-- > 0) { history_cold_delete_at(h, h->cold_count - 1); }
+  }
+  if (history_count(h) == 0) {
+    tindex_free(h->tokens);
+    h->tokens = NULL;
   }
-  h->count -= n;
-  assert(h->count >= 0);    
 }
 
 ic_private void history_remove_last(history_t* h) {
@@ -111,50 +790,232 @@ ic_private void history_remove_last(history_t* h) {
 }
 
 ic_private void history_clear(history_t* h) {
-  history_remove_last_n( h, h->count );
+  history_remove_last_n( h, history_count(h) );
+  tindex_free(h->tokens);
+  h->tokens = NULL;
+}
+
+ic_private const char* history_get( history_t* h, ssize_t n ) {
+  if (n < 0 || n >= history_count(h)) return NULL;
+  if (n < h->count) return history_entry(h, h->count - n - 1);
+  // an older entry: only valid until the next call
+  ssize_t k;
+  if (history_block_find(h, h->cold_count - (n - h->count) - 1, &k) < 0) return NULL;
+  return history_block_entry(h, k, true);
+}
+
+// Find `search` in the entry at `n`.
+static ssize_t history_match( history_t* h, ssize_t n, const char* search ) {
+  const ssize_t idx = h->count - n - 1;
+  const char* s = h->elems[idx];
+  if (s == NULL) return history_blob_match(h, h->blobs[idx], search);
+  const char* p = strstr(s, search);
+  return (p == NULL ? -1 : (ssize_t)(p - s));
 }
 
-ic_private const char* history_get( const history_t* h, ssize_t n ) {
-  if (n < 0 || n >= h->count) return NULL;
-  return h->elems[h->count - n - 1];
+static bool history_search_cold( history_t* h, ssize_t from, const char* search, bool backward, ssize_t* i, ssize_t* pos ) {
+  stringbuf_t* esearch = sbuf_new(h->mem);
+  if (esearch == NULL) return false;
+  history_encode(search, esearch);
+  ssize_t g;
+  bool found = history_cold_search(h, h->cold_count - (from - h->count) - 1, backward, search, sbuf_string(esearch), &g, pos);
+  sbuf_free(esearch);
+  if (found) { *i = h->count + (h->cold_count - g - 1); }
+  return found;
 }
 
-ic_private bool history_search( const history_t* h, ssize_t from /*including*/, const char* search, bool backward, ssize_t* hidx, ssize_t* hpos ) {
-  const char* p = NULL;
+ic_private bool history_search( history_t* h, ssize_t from /*including*/, const char* search, bool backward, ssize_t* hidx, ssize_t* hpos ) {
+  ssize_t pos = -1;
   ssize_t i;
   if (backward) {
     for( i = from; i < h->count; i++ ) {
-      p = strstr( history_get(h,i), search);
-      if (p != NULL) break;
+      pos = history_match(h, i, search);
+      if (pos >= 0) break;
+    }
+    // and continue with the older entries
+    if (pos < 0 && h->cold_count > 0) {
+      history_search_cold(h, (from > h->count ? from : h->count), search, true, &i, &pos);
     }
   }
   else {
-    for( i = from; i >= 0; i-- ) {
-      p = strstr( history_get(h,i), search);
-      if (p != NULL) break;
+    // first the older entries, then the recent ones
+    if (from >= h->count && h->cold_count > 0) {
+      history_search_cold(h, from, search, false, &i, &pos);
+    }
+    if (pos < 0) {
+      for( i = (from < h->count ? from : h->count - 1); i >= 0; i-- ) {
+        pos = history_match(h, i, search);
+        if (pos >= 0) break;
+      }
     }
   }
-  if (p == NULL) return false;
+  if (pos < 0) return false;
   if (hidx != NULL) *hidx = i;
-  if (hpos != NULL) *hpos = (p - history_get(h,i));
+  if (hpos != NULL) *hpos = pos;
   return true;
 }
 
+// Visit the entries starting at `from` (towards older ones if `backward`). Each block of older
+// entries is decompressed once, and large entries are only visited with their preview (so no side
+// files are read). Stops at the first entry for which `fun` returns false and returns its index,
+// or -1 if all entries were visited.
+ic_private ssize_t history_scan( history_t* h, ssize_t from, bool backward, history_visit_fun_t* fun, void* arg ) {
+  const ssize_t count = history_count(h);
+  if (from < 0 || from >= count) return -1;
+  ssize_t n = from;
+  if (backward) {
+    for ( ; n < h->count; n++) {
+      const ssize_t idx = h->count - n - 1;
+      if (!fun(n, history_preview(h, idx), arg)) return n;
+    }
+    while (n < count) {
+      ssize_t k;
+      if (history_block_find(h, h->cold_count - (n - h->count) - 1, &k) < 0) return -1;
+      for ( ; k >= 0; k--, n++) {
+        const char* entry = history_block_entry(h, k, false);
+        if (entry != NULL && !fun(n, entry, arg)) return n;
+      }
+    }
+  }
+  else {
+    while (n >= h->count) {
+      ssize_t k;
+      const ssize_t b = history_block_find(h, h->cold_count - (n - h->count) - 1, &k);
+      if (b < 0) return -1;
+      for ( ; k < h->blocks[b].count; k++, n--) {
+        const char* entry = history_block_entry(h, k, false);
+        if (entry != NULL && !fun(n, entry, arg)) return n;
+      }
+    }
+    for ( ; n >= 0; n--) {
+      const ssize_t idx = h->count - n - 1;
+      if (!fun(n, history_preview(h, idx), arg)) return n;
+    }
+  }
+  return -1;
+}
+
+// If entry `n` is large and was visited with just its preview (in `history_scan`),
+// return its full text read from the side file (the caller frees it); NULL otherwise.
+ic_private char* history_get_large( history_t* h, ssize_t n ) {
+  if (n < 0 || n >= history_count(h)) return NULL;
+  if (n < h->count) {
+    const ssize_t idx = h->count - n - 1;
+    return (h->elems[idx] == NULL ? history_blob_load(h, h->blobs[idx]) : NULL);
+  }
+  ssize_t k;
+  if (history_block_find(h, h->cold_count - (n - h->count) - 1, &k) < 0) return NULL;
+  const char* line = h->raw + h->lines[k];
+  if (line[0] != '#') return NULL;  // not a blob reference
+  stringbuf_t* sbuf = sbuf_new(h->mem);
+  if (sbuf == NULL) return NULL;
+  char* entry = NULL;
+  hblob_t blob;
+  if (history_decode(line, h->lines[k+1] - h->lines[k] - 1, sbuf) && history_is_blob_line(line, sbuf_string(sbuf)) &&
+      history_parse_blob(sbuf_string(sbuf), &blob)) {
+    entry = history_blob_load(h, &blob);
+  }
+  sbuf_free(sbuf);
+  return entry;
+}
+
+// Like `history_get` but only returns the preview of a large entry (so no side file is read).
+ic_private const char* history_get_preview( history_t* h, ssize_t n ) {
+  if (n < 0 || n >= history_count(h)) return NULL;
+  if (n < h->count) {
+    const ssize_t idx = h->count - n - 1;
+    return history_preview(h, idx);
+  }
+  ssize_t k;
+  if (history_block_find(h, h->cold_count - (n - h->count) - 1, &k) < 0) return NULL;
+  return history_block_entry(h, k, false);
+}
+
 //-------------------------------------------------------------
-// 
+// Token index
+//-------------------------------------------------------------
+
+// The token index is created on first use. Pushed entries are added right away, while the
+// existing ones are added in steps from the newest to the oldest (`tokens_todo` is the number
+// of oldest entries that are not yet added). The first lookup adds a few steps, and the
+// editor adds the rest when it is idle (see `history_index_step`).
+
+// Remove the tokens of the deleted entry at `pos` (counted from the oldest).
+static void history_unindex( history_t* h, ssize_t pos, const char* entry ) {
+  if (h->tokens == NULL) return;
+  if (pos < h->tokens_todo) {
+    h->tokens_todo--;  // it was not yet added
+  }
+  else if (entry != NULL) {
+    tindex_remove(h->tokens, entry, ic_strlen(entry));
+  }
+}
+
+// Add at most `n` of the newest entries that are not yet in the token index.
+static void history_index_older( history_t* h, ssize_t n ) {
+  while (n > 0 && h->tokens_todo > 0) {
+    const ssize_t pos = h->tokens_todo - 1;
+    if (pos >= h->cold_count) {
+      const char* s = history_preview(h, pos - h->cold_count);
+      tindex_add(h->tokens, s, ic_strlen(s), true);
+      h->tokens_todo--;
+      n--;
+    }
+    else {
+      ssize_t k;
+      if (history_block_find(h, pos, &k) < 0) {
+        h->tokens_todo = 0;
+        break;
+      }
+      for ( ; k >= 0 && n > 0; k--, n--) {
+        const char* s = history_block_entry(h, k, false);  // only the preview of large entries
+        if (s != NULL) { tindex_add(h->tokens, s, ic_strlen(s), true); }
+        h->tokens_todo--;
+      }
+    }
+  }
+}
+
+ic_private bool history_index_step( history_t* h ) {
+  if (h->tokens == NULL || h->tokens_todo <= 0) return false;
+  history_index_older(h, IC_HISTORY_INDEX_STEP);
+  if (h->tokens_todo > 0) return true;
+  tindex_update(h->tokens);  // so the next lookup is fast
+  return false;
+}
+
+ic_private ssize_t history_match_tokens( history_t* h, const char* prefix, const char** matches, ssize_t max ) {
+  if (h->tokens == NULL) {
+    h->tokens = tindex_new(h->mem);
+    if (h->tokens == NULL) return 0;
+    h->tokens_todo = history_count(h);
+  }
+  history_index_older(h, 8*IC_HISTORY_INDEX_STEP);
+  return tindex_match(h->tokens, prefix, matches, max);
+}
+
+
+//-------------------------------------------------------------
+//
 //-------------------------------------------------------------
 
 ic_private void history_load_from(history_t* h, const char* fname, long max_entries ) {
   history_clear(h);
+  h->unsaved = 0;
+  h->file_lines = 0;
+  h->rewrite = false;
   h->fname = mem_strdup(h->mem,fname);
   if (max_entries == 0) {
     assert(h->elems == NULL);
     return;
   }
-  if (max_entries < 0 || max_entries > IC_MAX_HISTORY) max_entries = IC_MAX_HISTORY;
-  h->elems = (const char**)mem_zalloc_tp_n(h->mem, char*, max_entries );
-  if (h->elems == NULL) return;
-  h->len = max_entries;
+  if (max_entries < 0) max_entries = IC_MAX_HISTORY;
+  const ssize_t len = (max_entries > IC_HISTORY_HOT ? IC_HISTORY_HOT : max_entries);
+  h->elems = (const char**)mem_zalloc_tp_n(h->mem, char*, len );
+  h->blobs = mem_zalloc_tp_n(h->mem, hblob_t*, len );
+  if (h->elems == NULL || h->blobs == NULL) return;
+  h->len = len;
+  h->max = max_entries;
   history_load(h);
 }
 
@@ -165,71 +1026,52 @@ ic_private void history_load_from(history_t* h, const char* fname, long max_entr
 // save/load history to file
 //-------------------------------------------------------------
 
-static char from_xdigit( int c ) {
-  if (c >= '0' && c <= '9') return (char)(c - '0');
-  if (c >= 'A' && c <= 'F') return (char)(10 + (c - 'A'));
-  if (c >= 'a' && c <= 'f') return (char)(10 + (c - 'a'));
-  return 0;
-}
-
-static char to_xdigit( uint8_t c ) {
-  if (c <= 9) return ((char)c + '0');
-  if (c >= 10 && c <= 15) return ((char)c - 10 + 'A');
-  return '0';
+// Read a blob reference: `#@blob <hash> <len> <preview>`
+static bool history_read_blob( history_t* h, const char* line ) {
+  hblob_t* blob = mem_zalloc_tp(h->mem, hblob_t);
+  if (blob == NULL) return false;
+  if (!history_parse_blob(line, blob)) {
+    mem_free(h->mem, blob);
+    return true; // ignore
+  }
+  if (!history_push_blob(h, NULL, blob)) {
+    mem_free(h->mem, blob);
+    return false;
+  }
+  return true;
 }
 
-static bool ic_isxdigit( int c ) {
-  return ((c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F') || (c >= '0' && c <= '9'));
+static bool history_read_line( FILE* f, stringbuf_t* line ) {
+  sbuf_clear(line);
+  char buf[1024];
+  bool any = false;
+  while (fgets(buf, sizeof(buf), f) != NULL) {  // lines are escaped so they contain no 0 bytes
+    any = true;
+    ssize_t n = ic_strlen(buf);
+    if (n > 0 && buf[n-1] == '\n') {
+      sbuf_append_n(line, buf, n - 1);
+      return true;
+    }
+    sbuf_append_n(line, buf, n);
+  }
+  return any;
 }
 
-static bool history_read_entry( history_t* h, FILE* f, stringbuf_t* sbuf ) {
-  sbuf_clear(sbuf);
-  while( !feof(f)) {
-    int c = fgetc(f);
-    if (c == EOF || c == '\n') break;
-    if (c == '\\') {
-      c = fgetc(f);
-      if (c == 'n')       { sbuf_append(sbuf,"\n"); }
-      else if (c == 'r')  { /* ignore */ }  // sbuf_append(sbuf,"\r");
-      else if (c == 't')  { sbuf_append(sbuf,"\t"); }
-      else if (c == '\\') { sbuf_append(sbuf,"\\"); }
-      else if (c == 'x') {
-        int c1 = fgetc(f);         
-        int c2 = fgetc(f);
-        if (ic_isxdigit(c1) && ic_isxdigit(c2)) {
-          char chr = from_xdigit(c1)*16 + from_xdigit(c2);
-          sbuf_append_char(sbuf,chr);
-        }
-        else return false;
-      }
-      else return false;
-    }
-    else sbuf_append_char(sbuf,(char)c);
+static bool history_read_entry( history_t* h, const char* line, ssize_t len, stringbuf_t* sbuf ) {
+  if (!history_decode(line, len, sbuf)) return false;
+  if (history_is_blob_line(line, sbuf_string(sbuf))) {
+    return history_read_blob(h, sbuf_string(sbuf));
   }
   if (sbuf_len(sbuf)==0 || sbuf_string(sbuf)[0] == '#') return true;
   return history_push(h, sbuf_string(sbuf));
 }
 
-static bool history_write_entry( const char* entry, FILE* f, stringbuf_t* sbuf ) {
+static bool history_write( const history_t* h, ssize_t idx, FILE* f, stringbuf_t* sbuf ) {
   sbuf_clear(sbuf);
-  //debug_msg("history: write: %s\n", entry);
-  while( entry != NULL && *entry != 0 ) {
-    char c = *entry++;
-    if (c == '\\')      { sbuf_append(sbuf,"\\\\"); }
-    else if (c == '\n') { sbuf_append(sbuf,"\\n"); }
-    else if (c == '\r') { /* ignore */ } // sbuf_append(sbuf,"\\r"); }
-    else if (c == '\t') { sbuf_append(sbuf,"\\t"); }
-    else if (c < ' ' || c > '~' || c == '#') {
-      char c1 = to_xdigit( (uint8_t)c / 16 );
-      char c2 = to_xdigit( (uint8_t)c % 16 );
-      sbuf_append(sbuf,"\\x"); 
-      sbuf_append_char(sbuf,c1); 
-      sbuf_append_char(sbuf,c2);            
-    }
-    else sbuf_append_char(sbuf,c);
-  }
+  // large entries are written to a side file once; here we just write a reference
+  if (h->blobs[idx] != NULL) { history_blob_save(h, h->elems[idx], h->blobs[idx]); }
+  history_encode_line(h, h->elems[idx], h->blobs[idx], sbuf);
   //debug_msg("history: write buf: %s\n", sbuf_string(sbuf));
-  
   if (sbuf_len(sbuf) > 0) {
     sbuf_append(sbuf,"\n");
     fputs(sbuf_string(sbuf),f);
@@ -241,29 +1083,170 @@ ic_private void history_load( history_t* h ) {
   if (h->fname == NULL) return;
   FILE* f = fopen(h->fname, "r");
   if (f == NULL) return;
+  // the token index is created again on its next use
+  tindex_free(h->tokens);
+  h->tokens = NULL;
+  stringbuf_t* line = sbuf_new(h->mem);
   stringbuf_t* sbuf = sbuf_new(h->mem);
-  if (sbuf != NULL) {
-    while (!feof(f)) {
-      if (!history_read_entry(h,f,sbuf)) break; // error
+  if (line != NULL && sbuf != NULL) {
+    h->loading = true;
+    while (history_read_line(f,line)) {
+      h->file_lines++;
+      if (!history_read_entry(h,sbuf_string(line),sbuf_len(line),sbuf)) break; // error
     }
-    sbuf_free(sbuf);
+    h->loading = false;
+    history_dedup(h);
+    h->unsaved = 0;
+    h->rewrite = false;
   }
+  sbuf_free(sbuf);
+  sbuf_free(line);
   fclose(f);
 }
 
-ic_private void history_save( const history_t* h ) {
-  if (h->fname == NULL) return;
+// The hashes of the side files that are referenced by the history.
+typedef struct hrefs_s {
+  uint64_t* hashes;
+  ssize_t   count;
+  ssize_t   len;
+} hrefs_t;
+
+static bool history_refs_add( const history_t* h, hrefs_t* refs, uint64_t hash ) {
+  if (refs->count >= refs->len) {
+    const ssize_t newlen = (refs->len <= 0 ? 64 : 2*refs->len);
+    uint64_t* hashes = mem_realloc_tp(h->mem, uint64_t, refs->hashes, newlen);
+    if (hashes == NULL) return false;
+    refs->hashes = hashes;
+    refs->len = newlen;
+  }
+  refs->hashes[refs->count++] = hash;
+  return true;
+}
+
+// Add the side files referenced by the history file lines in `raw`.
+static bool history_refs_add_lines( const history_t* h, hrefs_t* refs, const char* raw, ssize_t rlen, stringbuf_t* sbuf ) {
+  ssize_t start = 0;
+  for (ssize_t i = 0; i < rlen; i++) {
+    if (raw[i] != '\n') continue;
+    if (raw[start] == '#' && history_decode(raw + start, i - start, sbuf) && history_is_blob_line(raw + start, sbuf_string(sbuf))) {
+      hblob_t blob;
+      if (history_parse_blob(sbuf_string(sbuf), &blob) && !history_refs_add(h, refs, blob.hash)) return false;
+    }
+    start = i + 1;
+  }
+  return true;
+}
+
+static int history_hash_compare( const void* p1, const void* p2 ) {
+  const uint64_t h1 = *((const uint64_t*)p1);
+  const uint64_t h2 = *((const uint64_t*)p2);
+  return (h1 < h2 ? -1 : (h1 > h2 ? 1 : 0));
+}
+
+// Delete the side files in `<fname>.blobs` that are no longer referenced (as evicted or removed entries leave them behind).
+static void history_blob_sweep( const history_t* h, hrefs_t* refs ) {
+  char dname[1024];
+  int n = snprintf(dname, sizeof(dname), "%s.blobs", h->fname);
+  if (n <= 0 || n >= (int)sizeof(dname)) return;
+  qsort(refs->hashes, to_size_t(refs->count), sizeof(uint64_t), &history_hash_compare);
+  char fname[1024+32];
+  #ifdef _WIN32
+  snprintf(fname, sizeof(fname), "%s\\*", dname);
+  struct _finddata_t entry;
+  intptr_t d = _findfirst(fname, &entry);
+  if (d == -1) return;
+  do {
+    const char* name = entry.name;
+  #else
+  DIR* d = opendir(dname);
+  if (d == NULL) return;
+  struct dirent* entry;
+  while ((entry = readdir(d)) != NULL) {
+    const char* name = entry->d_name;
+  #endif
+    // only names of exactly 16 hex digits are side files
+    ssize_t len = 0;
+    while (len < 16 && ic_isxdigit(name[len])) { len++; }
+    if (len == 16 && name[16] == 0) {
+      const uint64_t hash = (uint64_t)strtoull(name, NULL, 16);
+      if (bsearch(&hash, refs->hashes, to_size_t(refs->count), sizeof(uint64_t), &history_hash_compare) == NULL) {
+        snprintf(fname, sizeof(fname), "%s/%.16s", dname, name);
+        remove(fname);
+      }
+    }
+  #ifdef _WIN32
+  } while (_findnext(d, &entry) == 0);
+  _findclose(d);
+  #else
+  }
+  closedir(d);
+  #endif
+}
+
+// Write the whole history file (and delete side files that are no longer referenced).
+static void history_save_all( const history_t* h ) {
   FILE* f = fopen(h->fname, "w");
   if (f == NULL) return;
   #ifndef _WIN32
   chmod(h->fname,S_IRUSR|S_IWUSR);
   #endif
+  hrefs_t refs = { NULL, 0, 0 };
+  bool refs_ok = true;  // do we know all referenced side files?
   stringbuf_t* sbuf = sbuf_new(h->mem);
+  // older entries: the blocks contain the lines as is
+  char* raw = NULL;
+  for (ssize_t b = 0; b < h->block_count; b++) {
+    const hblock_t* blk = &h->blocks[b];
+    char* p = mem_realloc_tp(h->mem, char, raw, blk->rlen + 1);
+    if (p == NULL) { refs_ok = false; break; }
+    raw = p;
+    if (!lz_decompress(blk->data, blk->clen, raw, blk->rlen)) { refs_ok = false; break; }  // error
+    fwrite(raw, 1, to_size_t(blk->rlen), f);
+    if (refs_ok) { refs_ok = (sbuf != NULL && history_refs_add_lines(h, &refs, raw, blk->rlen, sbuf)); }
+  }
+  mem_free(h->mem, raw);
+  // and the recent ones
   if (sbuf != NULL) {
-    for( int i = 0; i < h->count; i++ )  {
-      if (!history_write_entry(h->elems[i],f,sbuf)) break;  // error
+    for( ssize_t i = 0; i < h->count; i++ )  {
+      if (!history_write(h,i,f,sbuf)) break;  // error
+      if (h->blobs[i] != NULL && refs_ok) { refs_ok = history_refs_add(h, &refs, h->blobs[i]->hash); }
     }
     sbuf_free(sbuf);
   }
-  fclose(f);  
+  else {
+    refs_ok = false;
+  }
+  fclose(f);
+  if (refs_ok) { history_blob_sweep(h, &refs); }
+  mem_free(h->mem, refs.hashes);
+}
+
+// Append the unsaved entries to the history file, or rewrite it if entries in it were removed,
+// or if it has grown to twice the number of entries (due to duplicates and evicted entries).
+// Appending keeps saving cheap for a large history as that is done after each input.
+ic_private void history_save( history_t* h ) {
+  if (h->fname == NULL) return;
+  const ssize_t count = history_count(h);
+  if (h->rewrite || h->file_lines + h->unsaved > 2*count + IC_HISTORY_BLOCK) {
+    history_save_all(h);
+    h->file_lines = count;
+  }
+  else if (h->unsaved > 0) {
+    FILE* f = fopen(h->fname, "a");
+    if (f == NULL) return;
+    #ifndef _WIN32
+    chmod(h->fname,S_IRUSR|S_IWUSR);
+    #endif
+    stringbuf_t* sbuf = sbuf_new(h->mem);
+    if (sbuf != NULL) {
+      for (ssize_t i = h->count - h->unsaved; i < h->count; i++) {
+        if (!history_write(h,i,f,sbuf)) break;  // error
+      }
+      sbuf_free(sbuf);
+    }
+    fclose(f);
+    h->file_lines += h->unsaved;
+  }
+  h->unsaved = 0;
+  h->rewrite = false;
 }
@@ -25,14 +25,28 @@ ic_private ssize_t  history_count(const history_t* h);
 
 ic_private void     history_load_from(history_t* h, const char* fname, long max_entries);
 ic_private void     history_load( history_t* h );
-ic_private void     history_save( const history_t* h );
+ic_private void     history_save( history_t* h );
 
 ic_private bool     history_push( history_t* h, const char* entry );
 ic_private bool     history_update( history_t* h, const char* entry );
-ic_private const char* history_get( const history_t* h, ssize_t n );
+ic_private const char* history_get( history_t* h, ssize_t n );
 ic_private void     history_remove_last(history_t* h);
 
-ic_private bool     history_search( const history_t* h, ssize_t from, const char* search, bool backward, ssize_t* hidx, ssize_t* hpos);
+ic_private bool     history_search( history_t* h, ssize_t from, const char* search, bool backward, ssize_t* hidx, ssize_t* hpos);
+
+// Visit the entries from `from` (towards older ones if `backward`) until `fun` returns false; 
+// large entries are only visited with their preview. Returns the index where the scan stopped (or -1).
+typedef bool (history_visit_fun_t)(ssize_t n, const char* entry, void* arg);
+ic_private ssize_t  history_scan( history_t* h, ssize_t from, bool backward, history_visit_fun_t* fun, void* arg );
+ic_private const char* history_get_preview( history_t* h, ssize_t n );  // only the preview of a large entry
+ic_private char*    history_get_large( history_t* h, ssize_t n );          // the full text of a large entry (or NULL); caller frees
+
+// Find at most `max` words in the history that start with `prefix` (the most frequent and recent first);
+// the matches are valid until the next push.
+ic_private ssize_t  history_match_tokens( history_t* h, const char* prefix, const char** matches, ssize_t max );
+
+// Add more of the existing entries to the token index (when idle); returns true if there are more to add.
+ic_private bool     history_index_step( history_t* h );
 
 
 #endif // IC_HISTORY_H
@@ -25,10 +25,18 @@
 # include "bbcode.c"
 # include "editline.c"
 # include "highlight.c"
+# include "vtext.c"
 # include "undo.c"
 # include "history.c"
+# include "lz.c"
+# include "tindex.c"
+# include "regex.c"
+# include "draft.c"
+# include "trace.c"
 # include "completers.c"
 # include "completions.c"
+# include "ccache.c"
+# include "rmodel.c"
 # include "term.c"
 # include "tty_esc.c"
 # include "tty.c"
@@ -59,6 +67,7 @@ ic_public char* ic_readline(const char* prompt_text)
 {
   ic_env_t* env = ic_get_env();
   if (env == NULL) return NULL;
+  ic_env_get_tty(env);
   if (!env->noedit) {
     // terminal editing enabled
     return ic_editline(env, prompt_text);   // in editline.c
@@ -152,10 +161,117 @@ void ic_style_close(void) {
 
 ic_public bool ic_async_stop(void) {
   ic_env_t* env = ic_get_env(); if (env==NULL) return false;
-  if (env->tty==NULL) return false;
+  if (env->tty==NULL) return false;  // note: do not create it here as we may be on another thread
   return tty_async_stop(env->tty);
 }
 
+
+//-------------------------------------------------------------
+// Headless mode
+//-------------------------------------------------------------
+
+ic_public bool ic_headless_init(long width, long height) {
+  ic_env_t* env = ic_get_env(); if (env==NULL) return false;
+  if (env->term == NULL || env->completions == NULL || env->history == NULL || env->bbcode == NULL) return false;
+  if (!tty_is_headless(env->tty)) {
+    tty_t* tty = tty_new_headless(env->mem);
+    if (tty == NULL) return false;
+    if (!term_set_headless(env->term, tty, width, height)) {
+      tty_free(tty);
+      return false;
+    }
+    tty_free(env->tty);
+    env->tty = tty;
+    env->tty_init = true;
+  }
+  else if (!term_set_headless(env->term, env->tty, width, height)) {
+    return false;
+  }
+  env->noedit = false;
+  return true;
+}
+
+ic_public bool ic_headless_feed(const uint32_t* codes, long count) {
+  ic_env_t* env = ic_get_env(); if (env==NULL) return false;
+  if (!tty_is_headless(env->tty) || codes == NULL) return false;
+  stringbuf_t* sbuf = sbuf_new(env->mem);
+  if (sbuf == NULL) return false;
+  for (long i = 0; i < count; i++) {
+    uint8_t buf[5];
+    unicode_to_qutf8(codes[i], buf);
+    sbuf_append_n(sbuf, (const char*)buf, (buf[0] == 0 ? 1 : ic_strlen((const char*)buf)));  // include a 0 (ctrl-space)
+  }
+  bool ok = tty_feed(env->tty, sbuf_string(sbuf), sbuf_len(sbuf));
+  sbuf_free(sbuf);
+  return ok;
+}
+
+ic_public bool ic_headless_feed_bytes(const char* bytes, long len) {
+  ic_env_t* env = ic_get_env(); if (env==NULL) return false;
+  if (bytes == NULL) return false;
+  return tty_feed(env->tty, bytes, (len < 0 ? ic_strlen(bytes) : len));
+}
+
+ic_public const char* ic_headless_output(long* len) {
+  ic_env_t* env = ic_get_env(); 
+  if (env==NULL || env->term == NULL || !tty_is_headless(env->tty)) {
+    if (len != NULL) *len = 0;
+    return NULL;
+  }
+  ssize_t n = 0;
+  const char* s = term_get_capture(env->term, &n);
+  if (len != NULL) *len = (long)n;
+  return s;
+}
+
+ic_public void ic_headless_clear_output(void) {
+  ic_env_t* env = ic_get_env(); if (env==NULL) return;
+  if (env->term == NULL || !tty_is_headless(env->tty)) return;
+  term_clear_capture(env->term);
+}
+
+ic_public bool ic_set_trace_file(const char* fname) {
+  ic_env_t* env = ic_get_env(); if (env==NULL) return false;
+  trace_t* trace = NULL;
+  if (fname != NULL) {
+    trace = trace_new(env->mem, fname);
+    if (trace == NULL) return false;
+  }
+  tty_set_trace(env->tty, NULL);  // re-attached at the start of each edit
+  trace_free(env->trace);
+  env->trace = trace;
+  return true;
+}
+
+ic_public bool ic_headless_replay(const char* fname) {
+  ic_env_t* env = ic_get_env(); if (env==NULL) return false;
+  uint8_t* input;
+  int64_t* times;
+  ssize_t  count, width, height;
+  if (!trace_load_input(env->mem, fname, &input, &times, &count, &width, &height)) return false;
+  bool ok = (tty_is_headless(env->tty) || ic_headless_init((long)width, (long)height));
+  if (ok) { ok = tty_feed_timed(env->tty, input, times, count); }
+  mem_free(env->mem, input);
+  mem_free(env->mem, times);
+  return ok;
+}
+
+ic_public bool ic_set_render_model(ic_render_fun_t* render, void* arg) {
+  ic_env_t* env = ic_get_env(); if (env==NULL) return false;
+  if (render == NULL) {
+    rmodel_free(env->rmodel);
+    env->rmodel = NULL;
+  }
+  else if (env->rmodel == NULL) {
+    env->rmodel = rmodel_new(env->mem);
+    if (env->rmodel == NULL) return false;
+  }
+  rmodel_reset(env->rmodel);
+  env->render = render;
+  env->render_arg = arg;
+  return true;
+}
+
 static void set_prompt_marker(ic_env_t* env, const char* prompt_marker, const char* cprompt_marker) {
   if (prompt_marker == NULL) prompt_marker = "> ";
   if (cprompt_marker == NULL) cprompt_marker = prompt_marker;
@@ -202,11 +318,24 @@ ic_public bool ic_enable_history_duplicates( bool enable ) {
   return history_enable_duplicates(env->history, enable);
 }
 
+ic_public bool ic_enable_history_fuzzy_search( bool enable ) {
+  ic_env_t* env = ic_get_env(); if (env==NULL) return false;
+  bool prev = env->history_fuzzy;
+  env->history_fuzzy = enable;
+  return prev;
+}
+
 ic_public void ic_set_history(const char* fname, long max_entries ) {
   ic_env_t* env = ic_get_env(); if (env==NULL) return;
   history_load_from(env->history, fname, max_entries );
 }
 
+ic_public void ic_set_draft_file(const char* fname) {
+  ic_env_t* env = ic_get_env(); if (env==NULL) return;
+  draft_free(env->draft);
+  env->draft = draft_new(env->mem, fname);
+}
+
 ic_public void ic_history_remove_last(void) {
   ic_env_t* env = ic_get_env(); if (env==NULL) return;
   history_remove_last(env->history);
@@ -257,13 +386,63 @@ ic_public long ic_set_hint_delay(long delay_ms) {
   return prev;
 }
 
+ic_public void ic_get_hint_stats(long* computed, long* avoided, long* pause_ms) {
+  ic_env_t* env = ic_get_env();
+  if (computed != NULL) { *computed = (env == NULL ? 0 : env->hint_computed); }
+  if (avoided != NULL)  { *avoided  = (env == NULL ? 0 : env->hint_avoided); }
+  if (pause_ms != NULL) { *pause_ms = (env == NULL ? 0 : edit_hint_pause(env)); }
+}
+
+ic_public long ic_set_highlight_budget(long budget_ms) {
+  ic_env_t* env = ic_get_env(); if (env==NULL) return 0;
+  long prev = env->highlight_budget;
+  env->highlight_budget = (budget_ms < 0 ? 0 : budget_ms);
+  env->highlight_level = IC_HIGHLIGHT_FULL;
+  env->highlight_slow = 0;
+  return prev;
+}
+
+ic_public ic_highlight_level_t ic_get_highlight_stats(long* last_us) {
+  ic_env_t* env = ic_get_env(); 
+  if (last_us != NULL) { *last_us = (env == NULL ? 0 : env->highlight_last_us); }
+  return (env == NULL ? IC_HIGHLIGHT_FULL : env->highlight_level);
+}
+
+ic_public bool ic_enable_adaptive_rendering(bool enable) {
+  ic_env_t* env = ic_get_env(); if (env==NULL || env->term==NULL) return false;
+  return term_enable_adaptive(env->term, enable);
+}
+
+ic_public bool ic_enable_scroll_regions(bool enable) {
+  ic_env_t* env = ic_get_env(); if (env==NULL || env->term==NULL) return false;
+  return term_enable_scroll(env->term, enable);
+}
+
+ic_public ic_render_level_t ic_get_render_stats(long* bytes_per_sec) {
+  ic_env_t* env = ic_get_env(); 
+  const bool valid = (env != NULL && env->term != NULL);
+  if (bytes_per_sec != NULL) { *bytes_per_sec = (valid ? term_get_bandwidth(env->term) : 0); }
+  return (valid ? (ic_render_level_t)term_get_render_level(env->term) : IC_RENDER_FULL);
+}
+
 ic_public void ic_set_tty_esc_delay(long initial_delay_ms, long followup_delay_ms ) {
   ic_env_t* env = ic_get_env(); if (env==NULL) return;
-  if (env->tty == NULL) return;
-  tty_set_esc_delay(env->tty, initial_delay_ms, followup_delay_ms);
+  tty_t* tty = ic_env_get_tty(env);
+  if (tty == NULL) return;
+  tty_set_esc_delay(tty, initial_delay_ms, followup_delay_ms);
 }
 
 
+ic_public bool ic_enable_typeahead(bool enable, bool noecho) {
+  ic_env_t* env = ic_get_env(); if (env==NULL) return false;
+  return tty_set_typeahead(ic_env_get_tty(env), enable, noecho);
+}
+
+ic_public bool ic_enable_input_thread(bool enable) {
+  ic_env_t* env = ic_get_env(); if (env==NULL) return false;
+  return tty_set_input_thread(ic_env_get_tty(env), enable);
+}
+
 ic_public bool ic_enable_highlight(bool enable) {
   ic_env_t* env = ic_get_env(); if (env==NULL) return false;
   bool prev = env->no_highlight;
@@ -399,6 +578,16 @@ ic_public void ic_term_vwritef(const char* fmt, va_list args) {
   term_vwritef(env->term, fmt, args);
 }
 
+ic_public void ic_term_start_passthrough(void) {
+  ic_env_t* env = ic_get_env(); if (env==NULL || env->term==NULL) return;
+  term_start_passthrough(env->term);
+}
+
+ic_public void ic_term_end_passthrough(void) {
+  ic_env_t* env = ic_get_env(); if (env==NULL || env->term==NULL) return;
+  term_end_passthrough(env->term);
+}
+
 ic_public void ic_term_reset( void )  {
   ic_env_t* env = ic_get_env(); if (env==NULL) return;
   if (env->term == NULL) return;
@@ -488,7 +677,12 @@ static void ic_env_free(ic_env_t* env) {
   if (env == NULL) return;
   history_save(env->history);
   history_free(env->history);
+  draft_free(env->draft);
+  tty_set_trace(env->tty, NULL);
+  trace_free(env->trace);
   completions_free(env->completions);
+  ccache_free(env->ccache);
+  rmodel_free(env->rmodel);
   bbcode_free(env->bbcode);
   term_free(env->term);
   tty_free(env->tty);
@@ -525,42 +719,39 @@ static ic_env_t* ic_env_create( ic_malloc_fun_t* _malloc, ic_realloc_fun_t* _rea
   }
   env->mem = mem;
 
-  // Initialize
-  env->tty         = tty_new(env->mem, -1);  // can return NULL
-  env->term        = term_new(env->mem, env->tty, false, false, -1 );  
+  // Initialize (the tty is created on first use, see `ic_env_get_tty`, 
+  // and the default styles are builtin to bbcode)
+  env->term        = term_new(env->mem, NULL, false, false, -1 );  
   env->history     = history_new(env->mem);
   env->completions = completions_new(env->mem);
+  env->ccache      = ccache_new(env->mem);
   env->bbcode      = bbcode_new(env->mem, env->term);
   env->hint_delay  = 400;   
+  env->highlight_budget = 25;
   
-  if (env->tty == NULL || env->term==NULL ||
-      env->completions == NULL || env->history == NULL || env->bbcode == NULL ||
-      !term_is_interactive(env->term)) 
-  {
+  if (env->term==NULL || env->completions == NULL || env->history == NULL || env->bbcode == NULL) {
     env->noedit = true;
   }
   env->multiline_eol = '\\';
   
-  bbcode_style_def(env->bbcode, "ic-prompt",    "ansi-green" );
-  bbcode_style_def(env->bbcode, "ic-info",      "ansi-darkgray" );
-  bbcode_style_def(env->bbcode, "ic-diminish",  "ansi-lightgray" );
-  bbcode_style_def(env->bbcode, "ic-emphasis",  "#ffffd7" );
-  bbcode_style_def(env->bbcode, "ic-hint",      "ansi-darkgray" );
-  bbcode_style_def(env->bbcode, "ic-error",     "#d70000" );
-  bbcode_style_def(env->bbcode, "ic-bracematch","ansi-white"); //  color = #F7DC6F" );
-
-  bbcode_style_def(env->bbcode, "keyword",  "#569cd6" );
-  bbcode_style_def(env->bbcode, "control",  "#c586c0" );
-  bbcode_style_def(env->bbcode, "number",   "#b5cea8" );
-  bbcode_style_def(env->bbcode, "string",   "#ce9178" );
-  bbcode_style_def(env->bbcode, "comment",  "#6A9955" );
-  bbcode_style_def(env->bbcode, "type",     "darkcyan" );
-  bbcode_style_def(env->bbcode, "constant", "#569cd6" );
-
   set_prompt_marker(env, NULL, NULL);
   return env;
 }
 
+// The tty is created on first use so programs that only print output do not
+// switch the locale, install signal handlers, or query the terminal mode.
+ic_private tty_t* ic_env_get_tty(ic_env_t* env) {
+  if (!env->tty_init) {
+    env->tty_init = true;
+    env->tty = tty_new(env->mem, -1);  // can return NULL
+    if (env->term != NULL) { term_set_tty(env->term, env->tty); }
+    if (env->tty == NULL || env->term == NULL || !term_is_interactive(env->term)) {
+      env->noedit = true;
+    }
+  }
+  return env->tty;
+}
+
 static ic_env_t* rpenv;
 
 static void ic_atexit(void) {
@@ -0,0 +1,133 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2021, Daan Leijen
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+-----------------------------------------------------------------------------*/
+#include <string.h>
+
+#include "common.h"
+#include "lz.h"
+
+//-------------------------------------------------------------
+// The compressed data is a sequence of:
+//   token       : high nibble the literal count, low nibble the match length - 4
+//                 (a nibble of 15 is followed by extra length bytes; each 255 continues)
+//   literals    : copied as is
+//   offset      : 2 bytes (little endian) distance back to the match
+//   match length: extra length bytes
+// The final sequence only contains literals (and no offset).
+//-------------------------------------------------------------
+
+#define LZ_MIN_MATCH   (4)
+#define LZ_MAX_OFFSET  (0xFFFF)
+#define LZ_HASH_BITS   (12)
+
+static uint32_t lz_read32(const char* p) {
+  uint32_t x;
+  memcpy(&x, p, sizeof(x));
+  return x;
+}
+
+static ssize_t lz_hash(uint32_t x) {
+  return (ssize_t)((x * 2654435761U) >> (32 - LZ_HASH_BITS));
+}
+
+static char* lz_put_len(char* out, ssize_t n) {
+  while (n >= 255) { *out++ = (char)255; n -= 255; }
+  *out++ = (char)n;
+  return out;
+}
+
+static char* lz_put_seq(char* out, const char* lits, ssize_t nlits, ssize_t offset, ssize_t mlen) {
+  const ssize_t m = (offset > 0 ? mlen - LZ_MIN_MATCH : 0);
+  *out++ = (char)(((nlits < 15 ? nlits : 15) << 4) | (m < 15 ? m : 15));
+  if (nlits >= 15) { out = lz_put_len(out, nlits - 15); }
+  ic_memcpy(out, lits, nlits);
+  out += nlits;
+  if (offset > 0) {
+    *out++ = (char)(offset & 0xFF);
+    *out++ = (char)(offset >> 8);
+    if (m >= 15) { out = lz_put_len(out, m - 15); }
+  }
+  return out;
+}
+
+ic_private char* lz_compress(alloc_t* mem, const char* src, ssize_t len, ssize_t* clen) {
+  *clen = 0;
+  if (len < 0) return NULL;
+  char* const dst = mem_malloc_tp_n(mem, char, len + (len/255) + 16);  // worst case
+  if (dst == NULL) return NULL;
+  int32_t table[1 << LZ_HASH_BITS];
+  for (ssize_t i = 0; i < (1 << LZ_HASH_BITS); i++) { table[i] = -1; }
+  char* out = dst;
+  ssize_t anchor = 0;
+  ssize_t i = 0;
+  while (i + LZ_MIN_MATCH <= len) {
+    const uint32_t x = lz_read32(src + i);
+    const ssize_t h = lz_hash(x);
+    const ssize_t ref = table[h];
+    table[h] = (int32_t)i;
+    if (ref >= 0 && i - ref <= LZ_MAX_OFFSET && lz_read32(src + ref) == x) {
+      ssize_t mlen = LZ_MIN_MATCH;
+      while (i + mlen < len && src[ref + mlen] == src[i + mlen]) { mlen++; }
+      out = lz_put_seq(out, src + anchor, i - anchor, i - ref, mlen);
+      i += mlen;
+      anchor = i;
+    }
+    else {
+      i++;
+    }
+  }
+  out = lz_put_seq(out, src + anchor, len - anchor, 0, 0);
+  *clen = (ssize_t)(out - dst);
+  // and shrink to fit
+  char* p = (char*)mem_realloc(mem, dst, *clen);
+  return (p != NULL ? p : dst);
+}
+
+static bool lz_get_len(const uint8_t** pin, const uint8_t* end, ssize_t* n) {
+  const uint8_t* in = *pin;
+  uint8_t b;
+  do {
+    if (in >= end) return false;
+    b = *in++;
+    *n += b;
+  } while (b == 255);
+  *pin = in;
+  return true;
+}
+
+ic_private bool lz_decompress(const char* src, ssize_t clen, char* dst, ssize_t len) {
+  const uint8_t* in  = (const uint8_t*)src;
+  const uint8_t* end = in + clen;
+  ssize_t o = 0;
+  while (in < end) {
+    const uint8_t token = *in++;
+    // literals
+    ssize_t nlits = (token >> 4);
+    if (nlits == 15 && !lz_get_len(&in, end, &nlits)) return false;
+    if (nlits > (ssize_t)(end - in) || nlits > len - o) return false;
+    ic_memcpy(dst + o, in, nlits);
+    in += nlits;
+    o  += nlits;
+    if (in == end) break;  // final sequence
+    // match
+    if (end - in < 2) return false;
+    const ssize_t offset = (ssize_t)in[0] | ((ssize_t)in[1] << 8);
+    in += 2;
+    ssize_t mlen = (token & 0x0F);
+    if (mlen == 15 && !lz_get_len(&in, end, &mlen)) return false;
+    mlen += LZ_MIN_MATCH;
+    if (offset == 0 || offset > o || mlen > len - o) return false;
+    const char* ref = dst + o - offset;
+    if (offset >= mlen) {
+      ic_memcpy(dst + o, ref, mlen);
+    }
+    else {
+      for (ssize_t i = 0; i < mlen; i++) { dst[o + i] = ref[i]; }  // overlapping
+    }
+    o += mlen;
+  }
+  return (o == len);
+}
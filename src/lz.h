@@ -0,0 +1,25 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2021, Daan Leijen
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+-----------------------------------------------------------------------------*/
+#pragma once
+#ifndef IC_LZ_H
+#define IC_LZ_H
+
+#include "common.h"
+
+//-------------------------------------------------------------
+// A small LZ77 style compressor (similar to LZ4) used for
+// blocks of old history entries.
+//-------------------------------------------------------------
+
+// Compress `len` bytes at `src`; returns the allocated compressed data of `*clen` bytes (or NULL).
+ic_private char* lz_compress(alloc_t* mem, const char* src, ssize_t len, ssize_t* clen);
+
+// Decompress `clen` bytes at `src` into `dst` which must hold exactly `len` bytes.
+// Returns false if the compressed data is corrupt.
+ic_private bool  lz_decompress(const char* src, ssize_t clen, char* dst, ssize_t len);
+
+#endif // IC_LZ_H
@@ -0,0 +1,703 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2021, Daan Leijen
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+-----------------------------------------------------------------------------*/
+#include <string.h>
+
+#include "common.h"
+#include "regex.h"
+
+//-------------------------------------------------------------
+// A pattern is parsed into a Thompson NFA over bytes, and
+// matched by a DFA whose states (sets of NFA states) are only
+// constructed when a transition is first taken. At most
+// `IC_RX_DFA_MAX` DFA states are cached; when the cache is full
+// it is flushed and rebuilt as needed. No backtracking is ever
+// done: a search takes one scan to find whether (and where the
+// earliest) match ends, and one more to find the leftmost start,
+// so it is linear in the input (unless the DFA cache overflows
+// during the second scan, in which case each start is tried).
+//
+// Supported syntax: literals, `.`, `[...]` and `[^...]` classes
+// (with ranges), `\d`, `\w`, `\s` (and `\D`, `\W`, `\S`),
+// grouping `(...)`, alternation `|`, the `*`, `+`, and `?`
+// operators, and the `^` and `$` anchors. Any other escaped
+// character is taken literally. Matching is on UTF-8 characters
+// but classes only contain ASCII ranges (and single unicode characters).
+//-------------------------------------------------------------
+
+#define IC_RX_DFA_MAX   (128)
+#define RX_UNKNOWN      (-1)
+
+typedef enum rx_op_e {
+  RX_SET,       // consume a byte in a set
+  RX_SPLIT,     // epsilon to `out` and `out2`
+  RX_EMPTY,     // epsilon to `out`
+  RX_BOL,       // epsilon at the start of the input
+  RX_EOL,       // epsilon at the end of the input
+  RX_MATCH      // accept
+} rx_op_t;
+
+typedef struct rx_state_s {
+  rx_op_t  op;
+  int32_t  out;
+  int32_t  out2;
+  int32_t  set;    // index of the byte set (for RX_SET)
+} rx_state_t;
+
+typedef struct rx_frag_s {
+  int32_t  start;
+  int32_t  end;    // an RX_EMPTY state with an unpatched `out`
+} rx_frag_t;
+
+typedef struct rx_dstate_s {
+  int32_t  next[256];    // transitions (or RX_UNKNOWN)
+  ssize_t  nfa;          // offset of the sorted NFA states in `dnfa`
+  ssize_t  nfa_count;    // 0 for a dead state
+  uint32_t hash;
+  bool     unanchored;   // is the start state added at each step?
+  bool     accept;       // contains the match state
+  bool     accept_eol;   // accepts at the end of the input
+} rx_dstate_t;
+
+struct rx_s {
+  alloc_t*     mem;
+  char*        pattern;       // the compiled pattern
+  bool         compiled;      // is `pattern` valid?
+  const char*  p;             // parse position
+  // NFA
+  rx_state_t*  states;
+  ssize_t      count;
+  ssize_t      size;
+  uint8_t*     sets;          // 32 bytes per set
+  ssize_t      set_count;
+  ssize_t      set_size;
+  int32_t      start;
+  // DFA cache
+  rx_dstate_t* dstates;       // IC_RX_DFA_MAX states
+  ssize_t      dcount;
+  int32_t*     dnfa;          // NFA state sets of the DFA states
+  ssize_t      dnfa_count;
+  ssize_t      dnfa_size;
+  int32_t      dstart[3];     // start states: unanchored, anchored at the start, anchored
+  ssize_t      flushes;
+  // workspace for epsilon closures
+  int32_t*     work;
+  ssize_t      work_count;
+  int32_t*     stack;
+  uint32_t*    mark;
+  uint32_t     gen;
+  ssize_t      work_size;
+};
+
+
+ic_private rx_t* rx_new(alloc_t* mem) {
+  rx_t* rx = mem_zalloc_tp(mem, rx_t);
+  if (rx == NULL) return NULL;
+  rx->mem = mem;
+  return rx;
+}
+
+ic_private void rx_free(rx_t* rx) {
+  if (rx == NULL) return;
+  mem_free(rx->mem, rx->pattern);
+  mem_free(rx->mem, rx->states);
+  mem_free(rx->mem, rx->sets);
+  mem_free(rx->mem, rx->dstates);
+  mem_free(rx->mem, rx->dnfa);
+  mem_free(rx->mem, rx->work);
+  mem_free(rx->mem, rx->stack);
+  mem_free(rx->mem, rx->mark);
+  mem_free(rx->mem, rx);
+}
+
+
+//-------------------------------------------------------------
+// NFA construction
+//-------------------------------------------------------------
+
+static int32_t rx_add(rx_t* rx, rx_op_t op, int32_t out, int32_t out2, int32_t set) {
+  if (rx->count >= rx->size) {
+    ssize_t newsize = (rx->size == 0 ? 32 : 2*rx->size);
+    rx_state_t* newstates = mem_realloc_tp(rx->mem, rx_state_t, rx->states, newsize);
+    if (newstates == NULL) return -1;
+    rx->states = newstates;
+    rx->size = newsize;
+  }
+  rx_state_t* st = &rx->states[rx->count];
+  st->op   = op;
+  st->out  = out;
+  st->out2 = out2;
+  st->set  = set;
+  return (int32_t)(rx->count++);
+}
+
+static int32_t rx_new_set(rx_t* rx) {
+  if (rx->set_count >= rx->set_size) {
+    ssize_t newsize = (rx->set_size == 0 ? 16 : 2*rx->set_size);
+    uint8_t* newsets = mem_realloc_tp(rx->mem, uint8_t, rx->sets, 32*newsize);
+    if (newsets == NULL) return -1;
+    rx->sets = newsets;
+    rx->set_size = newsize;
+  }
+  memset(rx->sets + 32*rx->set_count, 0, 32);
+  return (int32_t)(rx->set_count++);
+}
+
+static void rx_set_add(rx_t* rx, int32_t set, uint8_t lo, uint8_t hi) {
+  uint8_t* bits = rx->sets + 32*set;
+  for (unsigned b = lo; b <= hi; b++) {
+    bits[b >> 3] |= (uint8_t)(1 << (b & 7));
+  }
+}
+
+static bool rx_set_has(const rx_t* rx, int32_t set, uint8_t b) {
+  return ((rx->sets[32*set + (b >> 3)] & (1 << (b & 7))) != 0);
+}
+
+// add the ASCII characters of `\d`, `\w`, or `\s` (or their complement if `negate`)
+static void rx_set_add_class(rx_t* rx, int32_t set, char cls, bool negate) {
+  for (unsigned b = 0; b < 0x80; b++) {
+    const char c = (char)b;
+    bool in;
+    if (cls == 'd')      { in = (c >= '0' && c <= '9'); }
+    else if (cls == 'w') { in = ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_'); }
+    else                 { in = (c == ' ' || (c >= '\t' && c <= '\r')); }
+    if (in != negate) { rx_set_add(rx, set, (uint8_t)b, (uint8_t)b); }
+  }
+}
+
+static bool rx_frag_op(rx_t* rx, rx_op_t op, int32_t set, rx_frag_t* f) {
+  const int32_t e = rx_add(rx, RX_EMPTY, -1, -1, -1);
+  if (e < 0) return false;
+  if (op == RX_EMPTY) {
+    f->start = f->end = e;
+    return true;
+  }
+  const int32_t s = rx_add(rx, op, e, -1, set);
+  if (s < 0) return false;
+  f->start = s;
+  f->end = e;
+  return true;
+}
+
+static bool rx_frag_set(rx_t* rx, int32_t set, rx_frag_t* f) {
+  return (set >= 0 && rx_frag_op(rx, RX_SET, set, f));
+}
+
+static bool rx_frag_byte(rx_t* rx, uint8_t lo, uint8_t hi, rx_frag_t* f) {
+  const int32_t set = rx_new_set(rx);
+  if (set < 0) return false;
+  rx_set_add(rx, set, lo, hi);
+  return rx_frag_set(rx, set, f);
+}
+
+static void rx_frag_concat(rx_t* rx, rx_frag_t* f, const rx_frag_t* g) {
+  rx->states[f->end].out = g->start;
+  f->end = g->end;
+}
+
+static bool rx_frag_alt(rx_t* rx, rx_frag_t* f, const rx_frag_t* g) {
+  const int32_t e = rx_add(rx, RX_EMPTY, -1, -1, -1);
+  const int32_t s = rx_add(rx, RX_SPLIT, f->start, g->start, -1);
+  if (e < 0 || s < 0) return false;
+  rx->states[f->end].out = e;
+  rx->states[g->end].out = e;
+  f->start = s;
+  f->end = e;
+  return true;
+}
+
+static bool rx_frag_repeat(rx_t* rx, rx_frag_t* f, char op) {
+  const int32_t e = rx_add(rx, RX_EMPTY, -1, -1, -1);
+  const int32_t s = rx_add(rx, RX_SPLIT, f->start, e, -1);
+  if (e < 0 || s < 0) return false;
+  if (op == '?') {
+    rx->states[f->end].out = e;
+    f->start = s;
+  }
+  else {
+    rx->states[f->end].out = s;  // loop back
+    if (op == '*') { f->start = s; }
+  }
+  f->end = e;
+  return true;
+}
+
+// a literal (UTF-8) character sequence of `n` bytes
+static bool rx_frag_literal(rx_t* rx, const char* s, ssize_t n, rx_frag_t* f) {
+  if (!rx_frag_byte(rx, (uint8_t)s[0], (uint8_t)s[0], f)) return false;
+  for (ssize_t i = 1; i < n; i++) {
+    rx_frag_t g;
+    if (!rx_frag_byte(rx, (uint8_t)s[i], (uint8_t)s[i], &g)) return false;
+    rx_frag_concat(rx, f, &g);
+  }
+  return true;
+}
+
+// any multi-byte UTF-8 character
+static bool rx_frag_utf8_multi(rx_t* rx, rx_frag_t* f) {
+  static const uint8_t leads[3][2] = { { 0xC0, 0xDF }, { 0xE0, 0xEF }, { 0xF0, 0xF7 } };
+  for (int i = 0; i < 3; i++) {
+    rx_frag_t g;
+    if (!rx_frag_byte(rx, leads[i][0], leads[i][1], &g)) return false;
+    for (int j = 0; j <= i; j++) {
+      rx_frag_t h;
+      if (!rx_frag_byte(rx, 0x80, 0xBF, &h)) return false;
+      rx_frag_concat(rx, &g, &h);
+    }
+    if (i == 0) { *f = g; }
+    else if (!rx_frag_alt(rx, f, &g)) return false;
+  }
+  return true;
+}
+
+// an ASCII set, or any non-ASCII character
+static bool rx_frag_set_or_multi(rx_t* rx, int32_t set, rx_frag_t* f) {
+  rx_frag_t g;
+  return (rx_frag_set(rx, set, f) && rx_frag_utf8_multi(rx, &g) && rx_frag_alt(rx, f, &g));
+}
+
+static ssize_t rx_char_len(const char* s) {
+  const uint8_t c = (uint8_t)s[0];
+  ssize_t n = (c >= 0xF0 ? 4 : (c >= 0xE0 ? 3 : (c >= 0xC0 ? 2 : 1)));
+  for (ssize_t i = 1; i < n; i++) {
+    if (s[i] == 0) return i;
+  }
+  return n;
+}
+
+
+//-------------------------------------------------------------
+// Parsing
+//-------------------------------------------------------------
+
+static bool rx_parse_alt(rx_t* rx, rx_frag_t* f);
+
+static bool rx_parse_class(rx_t* rx, rx_frag_t* f) {
+  // we are just after the `[`
+  const bool negate = (*rx->p == '^');
+  if (negate) rx->p++;
+  const int32_t set = rx_new_set(rx);
+  if (set < 0) return false;
+  rx_frag_t ext;         // non-ASCII characters
+  bool has_ext = false;
+  bool first = true;
+  while (*rx->p != ']' || first) {
+    first = false;
+    char c = *rx->p;
+    if (c == 0) return false;
+    if (c == '\\') {
+      c = rx->p[1];
+      if (c == 0) return false;
+      rx->p += 2;
+      if (c == 'd' || c == 'w' || c == 's') { rx_set_add_class(rx, set, c, false); continue; }
+      if (c == 'D' || c == 'W' || c == 'S') { rx_set_add_class(rx, set, (char)(c - 'A' + 'a'), true); continue; }
+      if (c == 'n') { c = '\n'; }
+      else if (c == 't') { c = '\t'; }
+    }
+    else if ((uint8_t)c >= 0x80) {
+      const ssize_t n = rx_char_len(rx->p);
+      if (!negate) {   // we cannot exclude non-ASCII characters
+        rx_frag_t g;
+        if (!rx_frag_literal(rx, rx->p, n, &g)) return false;
+        if (!has_ext) { ext = g; has_ext = true; }
+        else if (!rx_frag_alt(rx, &ext, &g)) return false;
+      }
+      rx->p += n;
+      continue;
+    }
+    else {
+      rx->p++;
+    }
+    // range?
+    if (rx->p[0] == '-' && rx->p[1] != ']' && rx->p[1] != 0) {
+      const char hi = rx->p[1];
+      if ((uint8_t)hi >= 0x80 || hi == '\\' || (uint8_t)hi < (uint8_t)c) return false;
+      rx_set_add(rx, set, (uint8_t)c, (uint8_t)hi);
+      rx->p += 2;
+    }
+    else {
+      rx_set_add(rx, set, (uint8_t)c, (uint8_t)c);
+    }
+  }
+  rx->p++;  // skip `]`
+  if (negate) {
+    // complement within ASCII
+    uint8_t* bits = rx->sets + 32*set;
+    for (int i = 0; i < 16; i++) { bits[i] = (uint8_t)~bits[i]; }
+    return rx_frag_set_or_multi(rx, set, f);
+  }
+  if (!rx_frag_set(rx, set, f)) return false;
+  return (!has_ext || rx_frag_alt(rx, f, &ext));
+}
+
+static bool rx_parse_atom(rx_t* rx, rx_frag_t* f) {
+  const char c = *rx->p;
+  if (c == '(') {
+    rx->p++;
+    if (!rx_parse_alt(rx, f) || *rx->p != ')') return false;
+    rx->p++;
+    return true;
+  }
+  else if (c == '[') {
+    rx->p++;
+    return rx_parse_class(rx, f);
+  }
+  else if (c == '.') {
+    rx->p++;
+    const int32_t set = rx_new_set(rx);
+    if (set < 0) return false;
+    rx_set_add(rx, set, 0, '\n' - 1);
+    rx_set_add(rx, set, '\n' + 1, 0x7F);
+    return rx_frag_set_or_multi(rx, set, f);
+  }
+  else if (c == '^' || c == '$') {
+    rx->p++;
+    return rx_frag_op(rx, (c == '^' ? RX_BOL : RX_EOL), -1, f);
+  }
+  else if (c == '*' || c == '+' || c == '?' || c == 0) {
+    return false;  // nothing to repeat
+  }
+  else if (c == '\\') {
+    const char e = rx->p[1];
+    if (e == 0) return false;
+    rx->p += 2;
+    if (e == 'd' || e == 'w' || e == 's' || e == 'D' || e == 'W' || e == 'S') {
+      const int32_t set = rx_new_set(rx);
+      if (set < 0) return false;
+      const bool negate = (e >= 'A' && e <= 'Z');
+      rx_set_add_class(rx, set, (negate ? (char)(e - 'A' + 'a') : e), negate);
+      return (negate ? rx_frag_set_or_multi(rx, set, f) : rx_frag_set(rx, set, f));
+    }
+    const char lit = (e == 'n' ? '\n' : (e == 't' ? '\t' : e));
+    return rx_frag_byte(rx, (uint8_t)lit, (uint8_t)lit, f);
+  }
+  else {
+    const ssize_t n = rx_char_len(rx->p);
+    if (!rx_frag_literal(rx, rx->p, n, f)) return false;
+    rx->p += n;
+    return true;
+  }
+}
+
+static bool rx_parse_repeat(rx_t* rx, rx_frag_t* f) {
+  if (!rx_parse_atom(rx, f)) return false;
+  while (*rx->p == '*' || *rx->p == '+' || *rx->p == '?') {
+    if (!rx_frag_repeat(rx, f, *rx->p)) return false;
+    rx->p++;
+  }
+  return true;
+}
+
+static bool rx_parse_concat(rx_t* rx, rx_frag_t* f) {
+  if (!rx_frag_op(rx, RX_EMPTY, -1, f)) return false;
+  while (*rx->p != 0 && *rx->p != '|' && *rx->p != ')') {
+    rx_frag_t g;
+    if (!rx_parse_repeat(rx, &g)) return false;
+    rx_frag_concat(rx, f, &g);
+  }
+  return true;
+}
+
+static bool rx_parse_alt(rx_t* rx, rx_frag_t* f) {
+  if (!rx_parse_concat(rx, f)) return false;
+  while (*rx->p == '|') {
+    rx->p++;
+    rx_frag_t g;
+    if (!rx_parse_concat(rx, &g)) return false;
+    if (!rx_frag_alt(rx, f, &g)) return false;
+  }
+  return true;
+}
+
+static void rx_flush(rx_t* rx) {
+  rx->dcount = 0;
+  rx->dnfa_count = 0;
+  rx->dstart[0] = rx->dstart[1] = rx->dstart[2] = RX_UNKNOWN;
+  rx->flushes++;
+}
+
+ic_private bool rx_compile(rx_t* rx, const char* pattern) {
+  if (rx == NULL || pattern == NULL) return false;
+  if (rx->pattern != NULL && strcmp(rx->pattern, pattern) == 0) return rx->compiled;
+  mem_free(rx->mem, rx->pattern);
+  rx->pattern = mem_strdup(rx->mem, pattern);
+  rx->compiled = false;
+  rx->count = 0;
+  rx->set_count = 0;
+  rx_flush(rx);
+  if (rx->pattern == NULL) return false;
+  // parse
+  rx->p = rx->pattern;
+  rx_frag_t f;
+  if (!rx_parse_alt(rx, &f) || *rx->p != 0) return false;  // syntax error or unbalanced `)`
+  const int32_t m = rx_add(rx, RX_MATCH, -1, -1, -1);
+  if (m < 0) return false;
+  rx->states[f.end].out = m;
+  rx->start = f.start;
+  // allocate the workspace and the DFA cache
+  if (rx->count > rx->work_size) {
+    mem_free(rx->mem, rx->work);
+    mem_free(rx->mem, rx->stack);
+    mem_free(rx->mem, rx->mark);
+    rx->work  = mem_malloc_tp_n(rx->mem, int32_t, rx->count);
+    rx->stack = mem_malloc_tp_n(rx->mem, int32_t, 3*rx->count + 1);  // each state pushes at most 2 (and 1 initially)
+    rx->mark  = mem_zalloc_tp_n(rx->mem, uint32_t, rx->count);
+    rx->work_size = (rx->work == NULL || rx->stack == NULL || rx->mark == NULL ? 0 : rx->count);
+    if (rx->work_size == 0) return false;
+  }
+  else {
+    memset(rx->mark, 0, to_size_t(rx->count) * sizeof(uint32_t));
+  }
+  rx->gen = 0;
+  if (rx->dstates == NULL) {
+    rx->dstates = mem_malloc_tp_n(rx->mem, rx_dstate_t, IC_RX_DFA_MAX);
+    if (rx->dstates == NULL) return false;
+  }
+  rx->compiled = true;
+  return true;
+}
+
+
+//-------------------------------------------------------------
+// DFA construction
+//-------------------------------------------------------------
+
+// add the epsilon closure of `s` to the work set
+static void rx_closure(rx_t* rx, int32_t s, bool at_start) {
+  ssize_t sp = 0;
+  rx->stack[sp++] = s;
+  while (sp > 0) {
+    const int32_t i = rx->stack[--sp];
+    if (i < 0 || rx->mark[i] == rx->gen) continue;
+    rx->mark[i] = rx->gen;
+    const rx_state_t* st = &rx->states[i];
+    switch (st->op) {
+      case RX_SPLIT: rx->stack[sp++] = st->out2; rx->stack[sp++] = st->out; break;
+      case RX_EMPTY: rx->stack[sp++] = st->out; break;
+      case RX_BOL:   if (at_start) { rx->stack[sp++] = st->out; } break;
+      default:       rx->work[rx->work_count++] = i; break;   // RX_SET, RX_EOL, and RX_MATCH
+    }
+  }
+}
+
+// can we reach the match state by only passing end-of-input assertions?
+static bool rx_accepts_at_eol(rx_t* rx, const int32_t* set, ssize_t n) {
+  rx->gen++;
+  ssize_t sp = 0;
+  for (ssize_t k = 0; k < n; k++) {
+    if (rx->states[set[k]].op == RX_EOL) { rx->stack[sp++] = rx->states[set[k]].out; }
+  }
+  while (sp > 0) {
+    const int32_t i = rx->stack[--sp];
+    if (i < 0 || rx->mark[i] == rx->gen) continue;
+    rx->mark[i] = rx->gen;
+    const rx_state_t* st = &rx->states[i];
+    switch (st->op) {
+      case RX_MATCH: return true;
+      case RX_SPLIT: rx->stack[sp++] = st->out2; rx->stack[sp++] = st->out; break;
+      case RX_EMPTY:
+      case RX_EOL:   rx->stack[sp++] = st->out; break;
+      default:       break;
+    }
+  }
+  return false;
+}
+
+// find or add the DFA state for the current work set
+static int32_t rx_dstate_of_work(rx_t* rx, bool unanchored) {
+  // sort the work set (it is usually tiny)
+  int32_t* w = rx->work;
+  const ssize_t n = rx->work_count;
+  for (ssize_t i = 1; i < n; i++) {
+    const int32_t x = w[i];
+    ssize_t j = i;
+    while (j > 0 && w[j-1] > x) { w[j] = w[j-1]; j--; }
+    w[j] = x;
+  }
+  uint32_t hash = (unanchored ? 1 : 0);
+  for (ssize_t i = 0; i < n; i++) { hash = (hash ^ (uint32_t)w[i]) * 16777619U; }
+  // existing state?
+  for (ssize_t d = 0; d < rx->dcount; d++) {
+    const rx_dstate_t* ds = &rx->dstates[d];
+    if (ds->hash == hash && ds->nfa_count == n && ds->unanchored == unanchored &&
+        (n == 0 || memcmp(rx->dnfa + ds->nfa, w, to_size_t(n) * sizeof(int32_t)) == 0)) {
+      return (int32_t)d;
+    }
+  }
+  // add a new state; flush the cache if it is full
+  if (rx->dcount >= IC_RX_DFA_MAX) { rx_flush(rx); }
+  if (rx->dnfa_count + n > rx->dnfa_size) {
+    ssize_t newsize = 2*rx->dnfa_size + n + 64;
+    int32_t* newdnfa = mem_realloc_tp(rx->mem, int32_t, rx->dnfa, newsize);
+    if (newdnfa == NULL) return RX_UNKNOWN;
+    rx->dnfa = newdnfa;
+    rx->dnfa_size = newsize;
+  }
+  rx_dstate_t* ds = &rx->dstates[rx->dcount];
+  for (int b = 0; b < 256; b++) { ds->next[b] = RX_UNKNOWN; }
+  ds->nfa = rx->dnfa_count;
+  ds->nfa_count = n;
+  ds->hash = hash;
+  ds->unanchored = unanchored;
+  ds->accept = false;
+  if (n > 0) { ic_memcpy(rx->dnfa + ds->nfa, w, n * ssizeof(int32_t)); }
+  rx->dnfa_count += n;
+  for (ssize_t i = 0; i < n; i++) {
+    if (rx->states[w[i]].op == RX_MATCH) { ds->accept = true; }
+  }
+  ds->accept_eol = (ds->accept || rx_accepts_at_eol(rx, w, n));
+  return (int32_t)(rx->dcount++);
+}
+
+// the start state: 0 = unanchored, 1 = anchored at the start of the input, 2 = anchored.
+static int32_t rx_start_state(rx_t* rx, int kind) {
+  if (rx->dstart[kind] != RX_UNKNOWN) return rx->dstart[kind];
+  rx->gen++;
+  rx->work_count = 0;
+  rx_closure(rx, rx->start, kind != 2);
+  const int32_t d = rx_dstate_of_work(rx, kind == 0);
+  rx->dstart[kind] = d;
+  return d;
+}
+
+static int32_t rx_step(rx_t* rx, int32_t d, uint8_t b) {
+  const int32_t next = rx->dstates[d].next[b];
+  if (next != RX_UNKNOWN) return next;
+  rx->gen++;
+  rx->work_count = 0;
+  const rx_dstate_t* ds = &rx->dstates[d];
+  for (ssize_t k = 0; k < ds->nfa_count; k++) {
+    const rx_state_t* st = &rx->states[rx->dnfa[ds->nfa + k]];
+    if (st->op == RX_SET && rx_set_has(rx, st->set, b)) {
+      rx_closure(rx, st->out, false);
+    }
+  }
+  const bool unanchored = ds->unanchored;
+  if (unanchored) { rx_closure(rx, rx->start, false); }
+  const ssize_t flushes = rx->flushes;
+  const int32_t n = rx_dstate_of_work(rx, unanchored);
+  if (n != RX_UNKNOWN && flushes == rx->flushes) {
+    rx->dstates[d].next[b] = n;  // `d` is still valid
+  }
+  return n;
+}
+
+// the length of the longest match starting at `start` (or -1)
+static ssize_t rx_match_at(rx_t* rx, const char* s, ssize_t len, ssize_t start) {
+  int32_t d = rx_start_state(rx, (start == 0 ? 1 : 2));
+  if (d == RX_UNKNOWN) return -1;
+  ssize_t longest = (rx->dstates[d].accept ? 0 : -1);
+  ssize_t i;
+  for (i = start; i < len && rx->dstates[d].nfa_count > 0; i++) {
+    d = rx_step(rx, d, (uint8_t)s[i]);
+    if (d == RX_UNKNOWN) return longest;
+    if (rx->dstates[d].accept) { longest = i + 1 - start; }
+  }
+  if (i >= len && rx->dstates[d].accept_eol) { longest = len - start; }
+  return longest;
+}
+
+// Find the leftmost (and then longest) match with a start at or before `end`. The anchored DFA is
+// run from all start positions at once where entries that reach the same DFA state are merged
+// into the one with the earliest start (as they match the same continuations). There are thus
+// at most `IC_RX_DFA_MAX` entries at each position. Returns false if the DFA cache was flushed
+// meanwhile (as the entries are no longer valid then).
+static bool rx_search_leftmost(rx_t* rx, const char* s, ssize_t len, ssize_t end, ssize_t* mpos, ssize_t* mlen) {
+  int32_t ds[IC_RX_DFA_MAX];      // alive DFA states in order of their start
+  ssize_t starts[IC_RX_DFA_MAX];
+  ssize_t seen[IC_RX_DFA_MAX];    // position + 1 at which a DFA state was last added
+  memset(seen, 0, sizeof(seen));
+  const ssize_t flushes = rx->flushes;
+  ssize_t n = 0;
+  ssize_t best = -1;              // the leftmost start with a match
+  ssize_t longest = -1;
+  for (ssize_t i = 0; i <= len; i++) {
+    // step all entries over the previous byte
+    if (i > 0) {
+      ssize_t m = 0;
+      for (ssize_t k = 0; k < n; k++) {
+        const int32_t d = rx_step(rx, ds[k], (uint8_t)s[i-1]);
+        if (d == RX_UNKNOWN || flushes != rx->flushes) return false;
+        if (rx->dstates[d].nfa_count == 0 || seen[d] == i + 1) continue;  // dead or merged
+        seen[d] = i + 1;
+        ds[m] = d;
+        starts[m] = starts[k];
+        m++;
+      }
+      n = m;
+    }
+    // add a start at the next character
+    if (best < 0 && i <= end && (i == len || ((uint8_t)s[i] & 0xC0) != 0x80)) {
+      const int32_t d = rx_start_state(rx, (i == 0 ? 1 : 2));
+      if (d == RX_UNKNOWN || flushes != rx->flushes) return false;
+      if (seen[d] != i + 1) {
+        seen[d] = i + 1;
+        ds[n] = d;
+        starts[n] = i;
+        n++;
+      }
+    }
+    // check for matches and drop the entries that start after the best one
+    ssize_t m = 0;
+    for (ssize_t k = 0; k < n; k++) {
+      const rx_dstate_t* dst = &rx->dstates[ds[k]];
+      if (dst->accept || (i == len && dst->accept_eol)) {
+        if (best < 0 || starts[k] <= best) {
+          best = starts[k];
+          longest = i - best;
+        }
+      }
+      if (best < 0 || starts[k] <= best) {
+        ds[m] = ds[k];
+        starts[m] = starts[k];
+        m++;
+      }
+    }
+    n = m;
+    if (n == 0 && (best >= 0 || i >= end)) break;
+  }
+  if (best < 0) {
+    best = end;
+    longest = 0;
+  }
+  if (mpos != NULL) *mpos = best;
+  if (mlen != NULL) *mlen = longest;
+  return true;
+}
+
+ic_private bool rx_search(rx_t* rx, const char* s, ssize_t len, ssize_t* mpos, ssize_t* mlen) {
+  if (rx == NULL || !rx->compiled || s == NULL) return false;
+  // find the end of the earliest match in a single scan
+  int32_t d = rx_start_state(rx, 0);
+  if (d == RX_UNKNOWN) return false;
+  ssize_t end = (rx->dstates[d].accept ? 0 : -1);
+  for (ssize_t i = 0; end < 0 && i < len; i++) {
+    d = rx_step(rx, d, (uint8_t)s[i]);
+    if (d == RX_UNKNOWN) return false;
+    if (rx->dstates[d].accept) { end = i + 1; }
+  }
+  if (end < 0) {
+    if (!rx->dstates[d].accept_eol) return false;
+    end = len;
+  }
+  if (mpos == NULL && mlen == NULL) return true;
+  // the leftmost match starts at or before `end`
+  if (rx_search_leftmost(rx, s, len, end, mpos, mlen)) return true;
+  // the DFA cache overflowed: try each start separately
+  for (ssize_t start = 0; start <= end; start++) {
+    if (start < len && ((uint8_t)s[start] & 0xC0) == 0x80) continue;  // not at a character start
+    const ssize_t n = rx_match_at(rx, s, len, start);
+    if (n >= 0) {
+      if (mpos != NULL) *mpos = start;
+      if (mlen != NULL) *mlen = n;
+      return true;
+    }
+  }
+  if (mpos != NULL) *mpos = end;
+  if (mlen != NULL) *mlen = 0;
+  return true;
+}
@@ -0,0 +1,31 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2021, Daan Leijen
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+-----------------------------------------------------------------------------*/
+#pragma once
+#ifndef IC_REGEX_H
+#define IC_REGEX_H
+
+#include "common.h"
+
+//-------------------------------------------------------------
+// Small regular expressions that run in linear time using
+// a lazily constructed DFA (used for history search).
+//-------------------------------------------------------------
+
+struct rx_s;
+typedef struct rx_s rx_t;
+
+ic_private rx_t* rx_new(alloc_t* mem);
+ic_private void  rx_free(rx_t* rx);
+
+// Compile a pattern; returns false if it is invalid (or incomplete).
+// Compiling the same pattern again keeps the current automaton.
+ic_private bool  rx_compile(rx_t* rx, const char* pattern);
+
+// Find the leftmost-longest match in `s`; `mpos` and `mlen` can be NULL.
+ic_private bool  rx_search(rx_t* rx, const char* s, ssize_t len, ssize_t* mpos, ssize_t* mlen);
+
+#endif // IC_REGEX_H
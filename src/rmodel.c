@@ -0,0 +1,292 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2021, Daan Leijen
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+-----------------------------------------------------------------------------*/
+#include <string.h>
+
+#include "common.h"
+#include "stringbuf.h"
+#include "attr.h"
+#include "rmodel.h"
+
+//-------------------------------------------------------------
+// A model is a frame of rows into a single text and attribute
+// buffer. We keep the previous frame so only changed rows
+// are serialized; rows are compared by hash first.
+//-------------------------------------------------------------
+
+typedef struct rrow_s {
+  ssize_t   start;    // offset in the frame text
+  ssize_t   len;
+  uint32_t  hash;
+} rrow_t;
+
+typedef struct rframe_s {
+  stringbuf_t* text;
+  attrbuf_t*   attrs;
+  rrow_t*      rows;
+  ssize_t      count;
+  ssize_t      capacity;
+  ssize_t      cursor_row;
+  ssize_t      cursor_col;
+} rframe_t;
+
+struct rmodel_s {
+  alloc_t*     mem;
+  rframe_t     frames[2];
+  rframe_t*    cur;       // the model being built
+  rframe_t*    prev;      // the model that was sent last
+  bool         valid;     // is `prev` known by the front-end?
+  ssize_t      row_start; // start of the current row in the text
+  stringbuf_t* out;       // the serialized difference
+};
+
+ic_private rmodel_t* rmodel_new(alloc_t* mem) {
+  rmodel_t* rm = mem_zalloc_tp(mem, rmodel_t);
+  if (rm == NULL) return NULL;
+  rm->mem = mem;
+  for (int i = 0; i < 2; i++) {
+    rm->frames[i].text  = sbuf_new(mem);
+    rm->frames[i].attrs = attrbuf_new(mem);
+  }
+  rm->out = sbuf_new(mem);
+  rm->cur = &rm->frames[0];
+  rm->prev = &rm->frames[1];
+  if (rm->frames[0].text == NULL || rm->frames[1].text == NULL ||
+      rm->frames[0].attrs == NULL || rm->frames[1].attrs == NULL || rm->out == NULL) {
+    rmodel_free(rm);
+    return NULL;
+  }
+  return rm;
+}
+
+ic_private void rmodel_free(rmodel_t* rm) {
+  if (rm == NULL) return;
+  for (int i = 0; i < 2; i++) {
+    sbuf_free(rm->frames[i].text);
+    attrbuf_free(rm->frames[i].attrs);
+    mem_free(rm->mem, rm->frames[i].rows);
+  }
+  sbuf_free(rm->out);
+  mem_free(rm->mem, rm);
+}
+
+ic_private void rmodel_reset(rmodel_t* rm) {
+  if (rm == NULL) return;
+  rm->valid = false;
+}
+
+ic_private void rmodel_begin(rmodel_t* rm) {
+  if (rm == NULL) return;
+  rframe_t* f = rm->cur;
+  sbuf_clear(f->text);
+  attrbuf_clear(f->attrs);
+  f->count = 0;
+  rm->row_start = 0;
+}
+
+ic_private void rmodel_append(rmodel_t* rm, const char* s, const attr_t* attrs, ssize_t len) {
+  if (rm == NULL || s == NULL || len <= 0) return;
+  if (attrs == NULL) {
+    attrbuf_append_n(rm->cur->text, rm->cur->attrs, s, len, attr_none());
+  }
+  else {
+    attrbuf_append_attrs_n(rm->cur->text, rm->cur->attrs, s, attrs, len);
+  }
+}
+
+static uint32_t rmodel_hash(uint32_t h, const void* p, ssize_t n) {
+  const uint8_t* b = (const uint8_t*)p;
+  for (ssize_t i = 0; i < n; i++) {
+    h = (h ^ b[i]) * 16777619U;  // FNV-1a
+  }
+  return h;
+}
+
+ic_private void rmodel_end_row(rmodel_t* rm) {
+  if (rm == NULL) return;
+  rframe_t* f = rm->cur;
+  if (f->count >= f->capacity) {
+    ssize_t newcap = (f->capacity == 0 ? 16 : 2*f->capacity);
+    rrow_t* newrows = mem_realloc_tp(rm->mem, rrow_t, f->rows, newcap);
+    if (newrows == NULL) return;
+    f->rows = newrows;
+    f->capacity = newcap;
+  }
+  const ssize_t len = sbuf_len(f->text);
+  rrow_t* row = &f->rows[f->count++];
+  row->start = rm->row_start;
+  row->len   = len - rm->row_start;
+  row->hash  = rmodel_hash(2166136261U, sbuf_string(f->text) + row->start, row->len);
+  row->hash  = rmodel_hash(row->hash, attrbuf_attrs(f->attrs, len) + row->start, row->len * ssizeof(attr_t));
+  rm->row_start = len;
+}
+
+// The length of the common prefix (in bytes, at a character boundary) of row `i` with
+// the same row in the previous model, or -1 if there is no such row.
+static ssize_t rmodel_row_common(rmodel_t* rm, ssize_t i) {
+  if (!rm->valid || i >= rm->prev->count) return -1;
+  const rrow_t* r = &rm->cur->rows[i];
+  const rrow_t* q = &rm->prev->rows[i];
+  const char* s = sbuf_string(rm->cur->text) + r->start;
+  const char* t = sbuf_string(rm->prev->text) + q->start;
+  if (r->hash == q->hash && r->len == q->len && memcmp(s, t, to_size_t(r->len)) == 0) {
+    return r->len;  // attributes are compared by the hash only
+  }
+  const attr_t* sa = attrbuf_attrs(rm->cur->attrs, sbuf_len(rm->cur->text)) + r->start;
+  const attr_t* ta = attrbuf_attrs(rm->prev->attrs, sbuf_len(rm->prev->text)) + q->start;
+  ssize_t n = 0;
+  while (n < r->len && n < q->len && s[n] == t[n] && attr_is_eq(sa[n], ta[n])) { n++; }
+  while (n > 0 && n < r->len && ((uint8_t)s[n] & 0xC0) == 0x80) { n--; }  // do not split a character
+  return n;
+}
+
+//-------------------------------------------------------------
+// Serialize as JSON:
+//   {"rows":N,"cursor":[row,col],"set":[[row,keep,[span,...]],...]}
+// where "rows" and "cursor" are only present if they changed, and
+// only the rows that changed are in "set": these keep the first
+// `keep` characters of the previous row (which is left out if 0),
+// followed by the spans, each ["text"] or ["text",{attributes}].
+//-------------------------------------------------------------
+
+static void rmodel_write_string(stringbuf_t* out, const char* s, ssize_t len) {
+  sbuf_append_char(out, '"');
+  ssize_t i = 0;
+  while (i < len) {
+    ssize_t n = 0;
+    while (i + n < len && (uint8_t)s[i+n] >= ' ' && s[i+n] != '"' && s[i+n] != '\\' && s[i+n] != 0x7F) { n++; }
+    if (n > 0) { sbuf_append_n(out, s + i, n); i += n; }
+    if (i >= len) break;
+    const uint8_t c = (uint8_t)s[i++];
+    if (c == '"' || c == '\\') { sbuf_append_char(out, '\\'); sbuf_append_char(out, (char)c); }
+    else { sbuf_appendf(out, "\\u%04x", c); }
+  }
+  sbuf_append_char(out, '"');
+}
+
+static void rmodel_write_field(stringbuf_t* out, ssize_t fields, const char* name) {
+  if (sbuf_len(out) > fields) { sbuf_append_char(out, ','); }
+  sbuf_appendf(out, "\"%s\":", name);
+}
+
+// a palette index (0-15) for ANSI colors, or "#rrggbb" (nothing for the default color)
+static void rmodel_write_color(stringbuf_t* out, ssize_t fields, const char* name, ic_color_t color) {
+  if (color >= IC_RGB(0)) {
+    rmodel_write_field(out, fields, name);
+    sbuf_appendf(out, "\"#%06x\"", (unsigned)(color & 0xFFFFFF));
+  }
+  else if (color >= IC_ANSI_BLACK && color <= IC_ANSI_SILVER) {
+    rmodel_write_field(out, fields, name);
+    sbuf_appendf(out, "%u", (unsigned)(color - IC_ANSI_BLACK));
+  }
+  else if (color >= IC_ANSI_GRAY && color <= IC_ANSI_WHITE) {
+    rmodel_write_field(out, fields, name);
+    sbuf_appendf(out, "%u", (unsigned)(color - IC_ANSI_GRAY + 8));
+  }
+}
+
+static void rmodel_write_flag(stringbuf_t* out, ssize_t fields, const char* name, int flag) {
+  if (flag != IC_ON) return;
+  rmodel_write_field(out, fields, name);
+  sbuf_append_char(out, '1');
+}
+
+static void rmodel_write_attr(stringbuf_t* out, attr_t attr) {
+  const ssize_t start = sbuf_len(out);
+  sbuf_append(out, ",{");
+  const ssize_t fields = sbuf_len(out);
+  rmodel_write_color(out, fields, "fg", attr.x.color);
+  rmodel_write_color(out, fields, "bg", attr.x.bgcolor);
+  rmodel_write_flag(out, fields, "b", attr.x.bold);
+  rmodel_write_flag(out, fields, "i", attr.x.italic);
+  rmodel_write_flag(out, fields, "u", attr.x.underline);
+  rmodel_write_flag(out, fields, "r", attr.x.reverse);
+  if (sbuf_len(out) == fields) {
+    sbuf_delete_from(out, start);  // default attributes
+  }
+  else {
+    sbuf_append_char(out, '}');
+  }
+}
+
+static void rmodel_write_row(rmodel_t* rm, ssize_t i, ssize_t keep) {
+  const rframe_t* f = rm->cur;
+  const rrow_t* r = &f->rows[i];
+  const char* s = sbuf_string(f->text) + r->start;
+  const attr_t* attrs = attrbuf_attrs(f->attrs, sbuf_len(f->text)) + r->start;
+  if (keep <= 0) {
+    sbuf_appendf(rm->out, "[%zd,[", i);
+  }
+  else {
+    ssize_t chars = 0;
+    for (ssize_t j = 0; j < keep; j++) {
+      if (((uint8_t)s[j] & 0xC0) != 0x80) { chars++; }
+    }
+    sbuf_appendf(rm->out, "[%zd,%zd,[", i, chars);
+  }
+  ssize_t j = (keep > 0 ? keep : 0);
+  while (j < r->len) {
+    ssize_t n = 1;
+    while (j + n < r->len && attr_is_eq(attrs[j], attrs[j+n])) { n++; }
+    if (j > keep && j > 0) { sbuf_append_char(rm->out, ','); }
+    sbuf_append_char(rm->out, '[');
+    rmodel_write_string(rm->out, s + j, n);
+    rmodel_write_attr(rm->out, attrs[j]);
+    sbuf_append_char(rm->out, ']');
+    j += n;
+  }
+  sbuf_append(rm->out, "]]");
+}
+
+ic_private const char* rmodel_end(rmodel_t* rm, ssize_t cursor_row, ssize_t cursor_col, ssize_t* len) {
+  if (len != NULL) { *len = 0; }
+  if (rm == NULL) return NULL;
+  if (rm->row_start < sbuf_len(rm->cur->text)) { rmodel_end_row(rm); }
+  rframe_t* f = rm->cur;
+  f->cursor_row = cursor_row;
+  f->cursor_col = cursor_col;
+
+  // serialize what changed
+  sbuf_replace(rm->out, "{");
+  const ssize_t fields = sbuf_len(rm->out);
+  if (!rm->valid || f->count != rm->prev->count) {
+    rmodel_write_field(rm->out, fields, "rows");
+    sbuf_appendf(rm->out, "%zd", f->count);
+  }
+  if (!rm->valid || cursor_row != rm->prev->cursor_row || cursor_col != rm->prev->cursor_col) {
+    rmodel_write_field(rm->out, fields, "cursor");
+    sbuf_appendf(rm->out, "[%zd,%zd]", cursor_row, cursor_col);
+  }
+  bool first = true;
+  for (ssize_t i = 0; i < f->count; i++) {
+    const ssize_t keep = rmodel_row_common(rm, i);
+    if (keep == f->rows[i].len && keep == rm->prev->rows[i].len) continue;  // unchanged
+    if (first) { rmodel_write_field(rm->out, fields, "set"); sbuf_append_char(rm->out, '['); }
+          else { sbuf_append_char(rm->out, ','); }
+    rmodel_write_row(rm, i, keep);
+    first = false;
+  }
+  if (!first) { sbuf_append_char(rm->out, ']'); }
+  sbuf_append_char(rm->out, '}');
+  const bool changed = (sbuf_len(rm->out) > fields + 1);
+
+  // the new model becomes the previous one
+  rm->cur = rm->prev;
+  rm->prev = f;
+  rm->valid = true;
+  if (!changed) return NULL;
+  if (len != NULL) { *len = sbuf_len(rm->out); }
+  return sbuf_string(rm->out);
+}
+
+ic_private const char* rmodel_done(rmodel_t* rm, ssize_t* len) {
+  if (len != NULL) { *len = 0; }
+  if (rm == NULL) return NULL;
+  rm->valid = false;
+  sbuf_replace(rm->out, "{\"done\":true}");
+  if (len != NULL) { *len = sbuf_len(rm->out); }
+  return sbuf_string(rm->out);
+}
@@ -0,0 +1,39 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2021, Daan Leijen
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+-----------------------------------------------------------------------------*/
+#pragma once
+#ifndef IC_RMODEL_H
+#define IC_RMODEL_H
+
+#include "common.h"
+#include "attr.h"
+
+//-------------------------------------------------------------
+// Render model: the rows of the edit area as (text,attribute)
+// spans, serialized as a compact JSON diff against the
+// previously sent model (for GUI and web front-ends).
+//-------------------------------------------------------------
+
+struct rmodel_s;
+typedef struct rmodel_s rmodel_t;
+
+ic_private rmodel_t* rmodel_new(alloc_t* mem);
+ic_private void      rmodel_free(rmodel_t* rm);
+ic_private void      rmodel_reset(rmodel_t* rm);    // forget the previous model so the next one is sent in full
+
+// Build a new model row by row; `attrs` can be NULL for default attributes.
+ic_private void      rmodel_begin(rmodel_t* rm);
+ic_private void      rmodel_append(rmodel_t* rm, const char* s, const attr_t* attrs, ssize_t len);
+ic_private void      rmodel_end_row(rmodel_t* rm);
+
+// Finish the model and return its difference with the previous one, or NULL if nothing changed.
+// The result is valid until the next `rmodel_end` or `rmodel_done`.
+ic_private const char* rmodel_end(rmodel_t* rm, ssize_t cursor_row, ssize_t cursor_col, ssize_t* len);
+
+// The edit is done: the front-end keeps the last model as plain output, and the next model is sent in full.
+ic_private const char* rmodel_done(rmodel_t* rm, ssize_t* len);
+
+#endif // IC_RMODEL_H
@@ -302,23 +302,43 @@ static ssize_t str_find_line_end( const char* s, ssize_t len, ssize_t pos) {
   return (end < 0 ? len : end);
 }
 
+// Word motions scan the character class table byte-wise (see `char_class_table`).
+// This is equivalent to `str_find_backward/forward` with the corresponding 
+// character class function and skipping immediate matches.
+static ssize_t str_find_class_backward( const char* s, ssize_t len, ssize_t pos, int classes ) {
+  if (pos > len) pos = len;
+  if (pos < 0) pos = 0;
+  ssize_t i = str_scan_back_while(s, pos, classes, false);  // skip immediate matches
+  i = str_scan_back_while(s, i, classes, true);               // and find the next match
+  return (i > 0 ? i : -1);
+}
+
+static ssize_t str_find_class_forward( const char* s, ssize_t len, ssize_t pos, int classes ) {
+  if (s == NULL || len < 0) return -1;
+  if (pos > len) pos = len;
+  if (pos < 0) pos = 0;  
+  ssize_t i = str_scan_while(s, len, pos, classes, false);  // skip immediate matches
+  i = str_scan_while(s, len, i, classes, true);             // and find the next match
+  return (i < len ? i : -1);
+}
+
 static ssize_t str_find_word_start( const char* s, ssize_t len, ssize_t pos) {
-  ssize_t start = str_find_backward(s,len,pos, &ic_char_is_idletter,true /* skip immediate matches */);
+  ssize_t start = str_find_class_backward(s,len,pos,IC_CHAR_IDLETTER);
   return (start < 0 ? 0 : start); 
 }
 
 static ssize_t str_find_word_end( const char* s, ssize_t len, ssize_t pos) {
-  ssize_t end = str_find_forward(s,len,pos,&ic_char_is_idletter,true /* skip immediate matches */);
+  ssize_t end = str_find_class_forward(s,len,pos,IC_CHAR_IDLETTER);
   return (end < 0 ? len : end); 
 }
 
 static ssize_t str_find_ws_word_start( const char* s, ssize_t len, ssize_t pos) {
-  ssize_t start = str_find_backward(s,len,pos,&ic_char_is_white,true /* skip immediate matches */);
+  ssize_t start = str_find_class_backward(s,len,pos,IC_CHAR_WHITE);
   return (start < 0 ? 0 : start); 
 }
 
 static ssize_t str_find_ws_word_end( const char* s, ssize_t len, ssize_t pos) {
-  ssize_t end = str_find_forward(s,len,pos,&ic_char_is_white,true /* skip immediate matches */);
+  ssize_t end = str_find_class_forward(s,len,pos,IC_CHAR_WHITE);
   return (end < 0 ? len : end); 
 }
 
@@ -926,11 +946,41 @@ ic_private bool ic_atou32(const char* s, uint32_t* pu) {
 }
 
 
+//-------------------------------------------------------------
+// Character classes
+// All classes are determined by the first byte of a character, and 
+// every byte of a multi-byte utf-8 character is in the same classes 
+// (letter, id-letter, and filename letter). This means we can scan for 
+// character classes byte-by-byte with a single table lookup per byte 
+// without decoding utf-8.
+//-------------------------------------------------------------
+
+static const uint8_t char_class_table[256] = {
+  0x00, 0x40, 0x40, 0x40, 0x40, 0x40, 0x40, 0x40, 0x40, 0x03, 0x03, 0x40, 0x40, 0x03, 0x40, 0x40,
+  0x40, 0x40, 0x40, 0x40, 0x40, 0x40, 0x40, 0x40, 0x40, 0x40, 0x40, 0x40, 0x40, 0x40, 0x40, 0x40,
+  0x03, 0x40, 0x40, 0x40, 0x00, 0x40, 0x00, 0x40, 0x02, 0x02, 0x40, 0x40, 0x42, 0x60, 0x42, 0x42,
+  0x78, 0x78, 0x78, 0x78, 0x78, 0x78, 0x78, 0x78, 0x78, 0x78, 0x42, 0x02, 0x00, 0x00, 0x00, 0x40,
+  0x00, 0x74, 0x74, 0x74, 0x74, 0x74, 0x74, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64,
+  0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x02, 0x42, 0x02, 0x40, 0x60,
+  0x00, 0x74, 0x74, 0x74, 0x74, 0x74, 0x74, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64,
+  0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x02, 0x00, 0x02, 0x40, 0x40,
+  0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64,
+  0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64,
+  0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64,
+  0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64,
+  0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64,
+  0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64,
+  0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64,
+  0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64,
+};
+
+static inline bool char_in_class(char c, int classes) {
+  return ((char_class_table[(uint8_t)c] & classes) != 0);
+}
+
 // Convenience: character class for whitespace `[ \t\r\n]`.
 ic_public bool ic_char_is_white(const char* s, long len) {
-  if (s == NULL || len != 1) return false;
-  const char c = *s;
-  return (c==' ' || c == '\t' || c == '\n' || c == '\r');
+  return (s != NULL && len == 1 && char_in_class(*s, IC_CHAR_WHITE));
 }
 
 // Convenience: character class for non-whitespace `[^ \t\r\n]`.
@@ -940,9 +990,7 @@ ic_public bool ic_char_is_nonwhite(const char* s, long len) {
 
 // Convenience: character class for separators `[ \t\r\n,.;:/\\\(\)\{\}\[\]]`.
 ic_public bool ic_char_is_separator(const char* s, long len) {
-  if (s == NULL || len != 1) return false;
-  const char c = *s;
-  return (strchr(" \t\r\n,.;:/\\(){}[]", c) != NULL);
+  return (s != NULL && len == 1 && char_in_class(*s, IC_CHAR_SEPARATOR));
 }
 
 // Convenience: character class for non-separators.
@@ -953,37 +1001,80 @@ ic_public bool ic_char_is_nonseparator(const char* s, long len) {
 
 // Convenience: character class for digits (`[0-9]`).
 ic_public bool ic_char_is_digit(const char* s, long len) {
-  if (s == NULL || len != 1) return false;
-  const char c = *s;
-  return (c >= '0' && c <= '9');
+  return (s != NULL && len == 1 && char_in_class(*s, IC_CHAR_DIGIT));
 }
 
 // Convenience: character class for hexadecimal digits (`[A-Fa-f0-9]`).
 ic_public bool ic_char_is_hexdigit(const char* s, long len) {
-  if (s == NULL || len != 1) return false;
-  const char c = *s;
-  return ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F'));
+  return (s != NULL && len == 1 && char_in_class(*s, IC_CHAR_HEXDIGIT));
 }
 
 // Convenience: character class for letters (`[A-Za-z]` and any unicode > 0x80).
 ic_public bool ic_char_is_letter(const char* s, long len) {
-  if (s == NULL || len <= 0) return false;
-  const char c = *s;
-  return ((uint8_t)c >= 0x80 || (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z'));
+  return (s != NULL && len > 0 && char_in_class(*s, IC_CHAR_LETTER));
 }
 
 // Convenience: character class for identifier letters (`[A-Za-z0-9_-]` and any unicode > 0x80).
 ic_public bool ic_char_is_idletter(const char* s, long len) {
-  if (s == NULL || len <= 0) return false;
-  const char c = *s;
-  return ((uint8_t)c >= 0x80 || (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || (c == '_') || (c == '-'));
+  return (s != NULL && len > 0 && char_in_class(*s, IC_CHAR_IDLETTER));
 }
 
 // Convenience: character class for filename letters (`[^ \t\r\n`@$><=;|&{(]`).
 ic_public bool ic_char_is_filename_letter(const char* s, long len) {
-  if (s == NULL || len <= 0) return false;
-  const char c = *s;
-  return ((uint8_t)c >= 0x80 || (strchr(" \t\r\n`@$><=;|&{}()[]", c) == NULL));
+  return (s != NULL && len > 0 && char_in_class(*s, IC_CHAR_FILENAME_LETTER));
+}
+
+// Return the class mask for the builtin character class functions so we can scan 
+// with table lookups instead of calling `fun` for each character. 
+// For the negated classes, `negate` is set to true.
+ic_private bool ic_char_class_of(ic_is_char_class_fun_t* fun, int* classes, bool* negate) {
+  *negate = false;
+  if (fun == &ic_char_is_white)                { *classes = IC_CHAR_WHITE; }
+  else if (fun == &ic_char_is_nonwhite)        { *classes = IC_CHAR_WHITE; *negate = true; }
+  else if (fun == &ic_char_is_separator)       { *classes = IC_CHAR_SEPARATOR; }
+  else if (fun == &ic_char_is_nonseparator)    { *classes = IC_CHAR_SEPARATOR; *negate = true; }
+  else if (fun == &ic_char_is_letter)          { *classes = IC_CHAR_LETTER; }
+  else if (fun == &ic_char_is_idletter)        { *classes = IC_CHAR_IDLETTER; }
+  else if (fun == &ic_char_is_filename_letter) { *classes = IC_CHAR_FILENAME_LETTER; }
+  // digits are ascii so the bytes of a multi-byte character are never in the class (as with `len == 1` in the functions)
+  else if (fun == &ic_char_is_digit)           { *classes = IC_CHAR_DIGIT; }
+  else if (fun == &ic_char_is_hexdigit)        { *classes = IC_CHAR_HEXDIGIT; }
+  else return false;
+  return true;
+}
+
+// Scan forward while the characters are (or with `negate`, are not) in `classes`; returns the end position.
+ic_private ssize_t str_scan_while(const char* s, ssize_t len, ssize_t pos, int classes, bool negate) {
+  if (s == NULL || pos < 0) return pos;
+  ssize_t i = pos;
+  if (!negate) { while (i < len && char_in_class(s[i], classes)) { i++; } }
+          else { while (i < len && !char_in_class(s[i], classes)) { i++; } }
+  return i;
+}
+
+// Scan backward while the characters before `pos` are (or with `negate`, are not) in `classes`; returns the start position.
+ic_private ssize_t str_scan_back_while(const char* s, ssize_t pos, int classes, bool negate) {
+  if (s == NULL) return pos;
+  ssize_t i = pos;
+  if (!negate) { while (i > 0 && char_in_class(s[i-1], classes)) { i--; } }
+          else { while (i > 0 && !char_in_class(s[i-1], classes)) { i--; } }
+  return i;
+}
+
+// Scan forward from `pos` while the characters are in any of the given `classes`.
+ic_public long ic_scan_while(const char* s, long pos, int classes) {
+  if (s == NULL || pos < 0) return pos;
+  ssize_t i = pos;
+  while (s[i] != 0 && char_in_class(s[i], classes)) { i++; }
+  return (long)i;
+}
+
+// Scan forward from `pos` until a character is in any of the given `classes`.
+ic_public long ic_scan_until(const char* s, long pos, int classes) {
+  if (s == NULL || pos < 0) return pos;
+  ssize_t i = pos;
+  while (s[i] != 0 && !char_in_class(s[i], classes)) { i++; }
+  return (long)i;
 }
 
 // Convenience: If this is a token start, returns the length (or <= 0 if not found).
@@ -992,6 +1083,11 @@ ic_public long ic_is_token(const char* s, long pos, ic_is_char_class_fun_t* is_t
   ssize_t len = ic_strlen(s);
   if (pos >= len) return -1;
   if (pos > 0 && is_token_char(s + pos -1, 1)) return -1; // token start?
+  int classes;
+  bool negate;
+  if (ic_char_class_of(is_token_char, &classes, &negate)) {
+    return (long)(str_scan_while(s, len, pos, classes, negate) - pos);
+  }
   ssize_t i = pos;
   while ( i < len ) {
     ssize_t next = str_next_ofs(s, len, i, NULL);
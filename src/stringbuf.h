@@ -9,6 +9,7 @@
 #define IC_STRINGBUF_H
 
 #include <stdarg.h>
+#include "../include/isocline.h"
 #include "common.h"
 
 //-------------------------------------------------------------
@@ -112,6 +113,9 @@ ic_private ssize_t sbuf_for_each_row( stringbuf_t* sbuf, ssize_t termw, ssize_t
 // skip a single CSI sequence (ESC [ ...)
 ic_private bool    skip_csi_esc( const char* s, ssize_t len, ssize_t* esclen ); // used in term.c
 
+ic_private ssize_t str_scan_while( const char* s, ssize_t len, ssize_t pos, int classes, bool negate );
+ic_private ssize_t str_scan_back_while( const char* s, ssize_t pos, int classes, bool negate );
+ic_private bool    ic_char_class_of( ic_is_char_class_fun_t* fun, int* classes, bool* negate );
 ic_private ssize_t str_column_width( const char* s );
 ic_private ssize_t str_prev_ofs( const char* s, ssize_t pos, ssize_t* cwidth );
 ic_private ssize_t str_next_ofs( const char* s, ssize_t len, ssize_t pos, ssize_t* cwidth );
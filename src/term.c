@@ -22,6 +22,7 @@
 #include <unistd.h>
 #include <errno.h>
 #include <sys/ioctl.h>
+#include <sys/stat.h>
 #if defined(__linux__)
 #include <linux/kd.h>
 #endif
@@ -38,6 +39,19 @@ typedef enum palette_e {
   ANSIRGB      // direct rgb colors supported (ESC[38;2;<r>;<g>;<b>m)
 } palette_t;
 
+// A parsed SGR sequence in the cache
+#define IC_SGR_CACHE      (16)
+#define IC_SGR_CACHE_LEN  (23)
+
+// In passthrough mode, pending SGR sequences are applied once they exceed this many bytes
+#define IC_SGR_PENDING_MAX  (256)
+
+typedef struct sgr_entry_s {
+  attr_t  attr;                     // the parsed attribute
+  uint8_t len;                      // length of the sequence (0 if the entry is unused)
+  char    seq[IC_SGR_CACHE_LEN];    // the full escape sequence
+} sgr_entry_t;
+
 // The terminal screen
 struct term_s {
   int           fd_out;             // output handle
@@ -48,9 +62,23 @@ struct term_s {
   bool          silent;             // enable beep?
   bool          is_utf8;            // utf-8 output? determined by the tty
   attr_t   attr;               // current text attributes
+  ssize_t       passthrough;        // are SGR sequences passed through untracked? counted by start/end pairs
+  stringbuf_t*  sgr_pending;        // SGR sequences passed through since the last reset (not yet applied to `attr`)
+  sgr_entry_t   sgr_cache[IC_SGR_CACHE]; // recently parsed SGR sequences
   palette_t     palette;            // color support
+  bool          can_scroll;         // supports scroll margins (DECSTBM) with SU/SD?
+  bool          no_scroll;          // do not use scroll margins even if supported?
+  bool          out_is_file;        // output is redirected to a regular file? (then we do not flush on newlines)
   buffer_mode_t bufmode;            // buffer mode
   stringbuf_t*  buf;                // buffer for buffered output
+  stringbuf_t*  capture;            // if not NULL, all output is captured here (headless mode)
+  ssize_t       written;            // total bytes written to the terminal (or capture)
+  bool          adaptive;           // degrade the rendering when the output is slow?
+  long          write_cost;         // estimated write cost in micro-seconds per KiB (moving average)
+  int64_t       write_usecs;        // time spent in writes since the last sample
+  ssize_t       write_bytes;        // bytes written since the last sample
+  int64_t       write_last;         // time of the last sample
+  ssize_t       backlog;            // bytes still queued for output after the last write (if known)
   tty_t*        tty;                // used on posix to get the cursor position
   alloc_t*      mem;                // allocator
   #ifdef _WIN32
@@ -66,6 +94,7 @@ struct term_s {
 
 static bool term_write_direct(term_t* term, const char* s, ssize_t n );
 static void term_append_buf(term_t* term, const char* s, ssize_t n);
+static void term_sgr_sync(term_t* term);
 
 //-------------------------------------------------------------
 // Colors
@@ -109,6 +138,31 @@ ic_private void term_start_of_line(term_t* term) {
   term_write( term, "\r" );
 }
 
+ic_private bool term_can_scroll(const term_t* term) {
+  return (term != NULL && term->can_scroll && !term->no_scroll);
+}
+
+ic_private bool term_enable_scroll(term_t* term, bool enable) {
+  bool prev = !term->no_scroll;
+  term->no_scroll = !enable;
+  return prev;
+}
+
+// Scroll screen rows `top` to `bottom` (0-based, inclusive) up by `n` rows (or down if `n` is negative).
+// Uses scroll margins (DECSTBM) so rows outside the region are not touched.
+// Afterwards, the cursor is at the top-left of the screen.
+ic_private void term_scroll_region(term_t* term, ssize_t top, ssize_t bottom, ssize_t n) {
+  if (n == 0 || top < 0 || bottom <= top) return;
+  term_writef(term, IC_CSI "%zd;%zdr", top + 1, bottom + 1);  // set margins
+  if (n > 0) {
+    term_writef(term, IC_CSI "%zdS", n);   // scroll up
+  }
+  else {
+    term_writef(term, IC_CSI "%zdT", -n);  // scroll down
+  }
+  term_write(term, IC_CSI "r");            // reset margins (and move the cursor home)
+}
+
 ic_private ssize_t term_get_width(term_t* term) {
   return term->width;
 }
@@ -117,6 +171,37 @@ ic_private ssize_t term_get_height(term_t* term) {
   return term->height;
 }
 
+ic_private ssize_t term_get_written(const term_t* term) {
+  return term->written;
+}
+
+ic_private bool term_enable_adaptive(term_t* term, bool enable) {
+  bool prev = term->adaptive;
+  term->adaptive = enable;
+  if (!enable) { term->write_cost = 0; term->write_usecs = 0; term->write_bytes = 0; term->write_last = 0; term->backlog = 0; }
+  return prev;
+}
+
+ic_private long term_get_bandwidth(const term_t* term) {
+  return (term->write_cost <= 0 ? 0 : (long)((1024L * 1000000L) / term->write_cost));
+}
+
+// Determine how much rendering should be degraded from the estimated
+// write cost and the output backlog: a local terminal costs well under
+// 1ms per KiB, while a 9600 baud serial line costs about 1s per KiB.
+ic_private int term_get_render_level(const term_t* term) {
+  if (!term->adaptive) return 0;
+  int level = 0;
+  if (term->write_cost >= 700000)     level = 3;   // < ~1.5 KiB/s
+  else if (term->write_cost >= 200000) level = 2;  // < ~5 KiB/s
+  else if (term->write_cost >= 50000) level = 1;   // < ~20 KiB/s
+  int blevel = 0;
+  if (term->backlog >= 16*1024)      blevel = 3;
+  else if (term->backlog >= 4*1024)  blevel = 2;
+  else if (term->backlog >= 1024)    blevel = 1;
+  return (blevel > level ? blevel : level);
+}
+
 ic_private void term_attr_reset(term_t* term) {
   term_write(term, IC_CSI "m" );
 }
@@ -149,12 +234,20 @@ ic_private void term_write_char(term_t* term, char c) {
   term_write_n(term, buf, 1 );
 }
 
-ic_private attr_t term_get_attr( const term_t* term ) {
+ic_private attr_t term_get_attr( term_t* term ) {
+  term_sgr_sync(term);
   return term->attr;
 }
 
 ic_private void term_set_attr( term_t* term, attr_t attr ) {
   if (term->nocolor) return;
+  term_sgr_sync(term);
+  if (term_get_render_level(term) >= 2) {
+    // on a slow link we only keep the (short) monochrome attributes; but reset
+    // a color that is still set as the level may have risen during a refresh
+    attr.x.color   = (term->attr.x.color != IC_COLOR_NONE ? IC_ANSI_DEFAULT : IC_COLOR_NONE);
+    attr.x.bgcolor = (term->attr.x.bgcolor != IC_COLOR_NONE ? IC_ANSI_DEFAULT : IC_COLOR_NONE);
+  }
   if (attr.x.color != term->attr.x.color && attr.x.color != IC_COLOR_NONE) {
     term_color(term,attr.x.color);
     if (term->palette < ANSIRGB && color_is_rgb(attr.x.color)) {
@@ -262,6 +355,11 @@ ic_private void term_write_formatted_n( term_t* term, const char* s, const attr_
 
 ic_private void term_beep(term_t* term) {
   if (term->silent) return;
+  if (term->capture != NULL) {
+    term_flush(term);
+    sbuf_append_char(term->capture, '\x7');
+    return;
+  }
   fprintf(stderr,"\x7");
   fflush(stderr);
 }
@@ -314,7 +412,7 @@ ic_private buffer_mode_t term_set_buffer_mode(term_t* term, buffer_mode_t mode)
 static void term_check_flush(term_t* term, bool contains_nl) {
   if (term->bufmode == UNBUFFERED || 
       sbuf_len(term->buf) > 4000 ||
-      (term->bufmode == LINEBUFFERED && contains_nl)) 
+      (term->bufmode == LINEBUFFERED && contains_nl && !term->out_is_file)) 
   {
     term_flush(term);
   }  
@@ -343,6 +441,13 @@ ic_private term_t* term_new(alloc_t* mem, tty_t* tty, bool nocolor, bool silent,
   term->buf     = sbuf_new(mem);  
   term->bufmode = LINEBUFFERED;
   term->attr    = attr_default();
+  term->adaptive = true;
+
+  #if !defined(_WIN32)
+  // logging to a file is buffered fully (like `stdio`); it is flushed on readline and at exit.
+  struct stat st;
+  term->out_is_file = (fstat(term->fd_out, &st) == 0 && S_ISREG(st.st_mode));
+  #endif
 
   // respect NO_COLOR
   if (getenv("NO_COLOR") != NULL) {
@@ -395,11 +500,63 @@ ic_private term_t* term_new(alloc_t* mem, tty_t* tty, bool nocolor, bool silent,
   // initialize raw terminal output and terminal dimensions
   term_init_raw(term);
   term_update_dim(term);
+
+  // scroll margins with SU/SD are supported by virtually all terminal emulators
+  // but not by the linux console or dumb terminals. (on windows this is set in `term_start_raw`)
+  #if !defined(_WIN32)
+  { const char* eterm = getenv("TERM");
+    term->can_scroll = !(eterm == NULL || eterm[0] == 0 || strcmp(eterm,"linux") == 0 || 
+                         ic_contains(eterm,"dumb") || ic_starts_with(eterm,"vt52") || ic_starts_with(eterm,"vt100"));
+  }
+  #endif
+  debug_msg("term: scroll regions: %s\n", term->can_scroll ? "true" : "false");
   term_attr_reset(term);  // ensure we are at default settings
 
   return term;
 }
 
+// Set the tty once it is created (used for terminal queries)
+ic_private void term_set_tty(term_t* term, tty_t* tty) {
+  term->tty = tty;
+  term->is_utf8 = tty_is_utf8(tty);
+}
+
+// In headless mode all output is captured and the terminal has fixed dimensions and
+// capabilities (true color, and scroll regions only if enabled) so the output is deterministic.
+ic_private bool term_set_headless(term_t* term, tty_t* tty, ssize_t width, ssize_t height) {
+  if (term->capture == NULL) {
+    term_flush(term);
+    term_end_raw(term, true);
+    term->capture = sbuf_new(term->mem);
+    if (term->capture == NULL) return false;
+  }
+  term->tty        = tty;
+  term->width      = (width <= 0 ? 80 : width);
+  term->height     = (height <= 0 ? 25 : height);
+  term->is_utf8    = true;
+  term->nocolor    = false;
+  term->palette    = ANSIRGB;
+  term->can_scroll = true;
+  term->no_scroll  = true;
+  return true;
+}
+
+ic_private const char* term_get_capture(term_t* term, ssize_t* len) {
+  if (term->capture == NULL) {
+    if (len != NULL) *len = 0;
+    return NULL;
+  }
+  term_flush(term);
+  if (len != NULL) *len = sbuf_len(term->capture);
+  return sbuf_string(term->capture);
+}
+
+ic_private void term_clear_capture(term_t* term) {
+  if (term->capture == NULL) return;
+  term_flush(term);
+  sbuf_clear(term->capture);
+}
+
 ic_private bool term_is_interactive(const term_t* term) {
   ic_unused(term);
   // check dimensions (0 is used for debuggers)
@@ -416,6 +573,11 @@ ic_private bool term_is_interactive(const term_t* term) {
   return true;
 }
 
+// Are text attributes ignored? (no color or redirected output)
+ic_private bool term_is_plain(const term_t* term) {
+  return term->nocolor;
+}
+
 ic_private bool term_enable_beep(term_t* term, bool enable) {
   bool prev = term->silent;
   term->silent = !enable;
@@ -433,6 +595,8 @@ ic_private void term_free(term_t* term) {
   term_flush(term);
   term_end_raw(term, true);
   sbuf_free(term->buf); term->buf = NULL;
+  sbuf_free(term->capture); term->capture = NULL;
+  sbuf_free(term->sgr_pending); term->sgr_pending = NULL;
   mem_free(term->mem, term);
 }
 
@@ -443,11 +607,68 @@ ic_private void term_free(term_t* term) {
 // is needed for bracketed styles etc.
 //-------------------------------------------------------------
 
+// Parse an SGR sequence; short sequences are cached as applications tend to use just a few.
+static attr_t term_sgr_parse(term_t* term, const char* s, ssize_t len) {
+  if (len > IC_SGR_CACHE_LEN) return attr_from_esc_sgr(s,len);
+  size_t h = (size_t)len;
+  for (ssize_t i = 2; i < len - 1; i++) { h = (h * 31) + (uint8_t)s[i]; }
+  sgr_entry_t* e = &term->sgr_cache[h % IC_SGR_CACHE];
+  if (e->len != len || memcmp(e->seq, s, to_size_t(len)) != 0) {
+    e->attr = attr_from_esc_sgr(s,len);
+    e->len  = (uint8_t)len;
+    ic_memcpy(e->seq, s, len);
+  }
+  return e->attr;
+}
+
+// Apply the SGR sequences that were passed through to the current attribute.
+static void term_sgr_sync(term_t* term) {
+  if (term->sgr_pending == NULL || sbuf_len(term->sgr_pending) == 0) return;
+  const char* s = sbuf_string(term->sgr_pending);
+  const ssize_t len = sbuf_len(term->sgr_pending);
+  ssize_t i = 0;
+  while (i < len) {
+    // each sequence starts with ESC and ends with `m`
+    const char* m = (const char*)memchr(s + i, 'm', to_size_t(len - i));
+    ssize_t n = (m == NULL ? len : (ssize_t)(m - s) + 1) - i;
+    term->attr = attr_update_with(term->attr, term_sgr_parse(term, s + i, n));
+    i += n;
+  }
+  sbuf_clear(term->sgr_pending);
+}
+
+ic_private void term_start_passthrough(term_t* term) {
+  term->passthrough++;
+}
+
+ic_private void term_end_passthrough(term_t* term) {
+  if (term->passthrough <= 0) return;
+  term->passthrough--;
+  if (term->passthrough == 0) { term_sgr_sync(term); }
+}
+
 static void term_append_esc(term_t* term, const char* const s, ssize_t len) {
   if (s[1]=='[' && s[len-1] == 'm') {    
     // it is a CSI SGR sequence: ESC[ ... m
     if (term->nocolor) return;       // ignore escape sequences if nocolor is set
-    term->attr = attr_update_with(term->attr, attr_from_esc_sgr(s,len));
+    if (term->passthrough > 0) {
+      // only remember the sequences since the last reset; they are applied at the end
+      if (len == 3 || (len == 4 && s[2] == '0')) {
+        if (term->sgr_pending != NULL) { sbuf_clear(term->sgr_pending); }
+        term->attr = attr_default();
+      }
+      else {
+        if (term->sgr_pending == NULL) { term->sgr_pending = sbuf_new(term->mem); }
+        if (term->sgr_pending != NULL) {
+          sbuf_append_n(term->sgr_pending, s, len);
+          // fold the pending sequences into `attr` once they grow (if there are no resets)
+          if (sbuf_len(term->sgr_pending) > IC_SGR_PENDING_MAX) { term_sgr_sync(term); }
+        }
+      }
+    }
+    else {
+      term->attr = attr_update_with(term->attr, term_sgr_parse(term,s,len));
+    }
   }
   // and write out the escape sequence as-is
   sbuf_append_n(term->buf, s, len);
@@ -481,16 +702,14 @@ static void term_append_buf( term_t* term, const char* s, ssize_t len ) {
   while (pos < len) {
     // handle ascii sequences in bulk
     ssize_t ascii = 0;
-    ssize_t next;
-    while ((next = str_next_ofs(s, len, pos+ascii, NULL)) > 0 && 
-            (uint8_t)s[pos + ascii] > '\x1B' && (uint8_t)s[pos + ascii] <= 0x7F ) 
-    {
-      ascii += next;      
+    while (pos + ascii < len && (uint8_t)s[pos + ascii] > '\x1B' && (uint8_t)s[pos + ascii] <= 0x7F) {
+      ascii++;
     }
     if (ascii > 0) {
       sbuf_append_n(term->buf, s+pos, ascii);
       pos += ascii;
     }
+    const ssize_t next = str_next_ofs(s, len, pos, NULL);
     if (next <= 0) break;
 
     const uint8_t c = (uint8_t)s[pos];
@@ -521,8 +740,46 @@ static void term_append_buf( term_t* term, const char* s, ssize_t len ) {
 
 #if !defined(_WIN32)
 
+// Update the bandwidth estimate after a write of `n` bytes took `usecs`.
+// A write only blocks once the kernel buffer is full, so we also use the
+// number of bytes still queued (if the platform can tell us) as a signal.
+// The estimate rises quickly but decays slowly: writes into a draining
+// buffer are fast even though the link itself may still be slow. A single
+// sample can at most raise it about 4 times though (so one stalled write does
+// not degrade the rendering for long), and it also decays with the time between
+// samples, halving after a second (so it recovers once the link is fast again).
+static void term_update_cost(term_t* term, int64_t usecs, ssize_t n) {
+  #ifdef TIOCOUTQ
+  int queued = 0;
+  if (!term->out_is_file && ioctl(term->fd_out, TIOCOUTQ, &queued) == 0) {
+    term->backlog = (queued > 0 ? queued : 0);
+  }
+  #endif
+  term->write_usecs += (usecs > 0 ? usecs : 0);
+  term->write_bytes += n;
+  if (term->write_bytes < 256) return;  // too little to say much
+  int64_t sample = (term->write_usecs * 1024) / term->write_bytes;
+  if (sample > 10000000) sample = 10000000;  // cap at 10s per KiB
+  const int64_t now = ic_time_usecs();
+  int64_t cost = term->write_cost;
+  if (term->write_last > 0 && now > term->write_last) {
+    cost = (cost * 1000000) / (1000000 + (now - term->write_last));
+  }
+  term->write_last = now;
+  if (sample > 4*cost + 50000) sample = 4*cost + 50000;
+  term->write_cost  = (long)(sample > cost ? (cost + 3*sample)/4 : (15*cost + sample)/16);
+  term->write_usecs = 0;
+  term->write_bytes = 0;
+}
+
 // write to the console without further processing
 static bool term_write_direct(term_t* term, const char* s, ssize_t n) {
+  term->written += n;
+  if (term->capture != NULL) {
+    sbuf_append_n(term->capture, s, n);
+    return true;
+  }
+  const int64_t start = (term->adaptive ? ic_time_usecs() : 0);
   ssize_t count = 0; 
   while( count < n ) {
     ssize_t nwritten = write(term->fd_out, s + count, to_size_t(n - count));
@@ -534,6 +791,9 @@ static bool term_write_direct(term_t* term, const char* s, ssize_t n) {
       return false;
     }
   }
+  if (term->adaptive) {
+    term_update_cost(term, ic_time_usecs() - start, n);
+  }
   return true;
 }
 
@@ -810,6 +1070,11 @@ static void term_write_esc( term_t* term, const char* s, ssize_t len ) {
 }
 
 static bool term_write_direct(term_t* term, const char* s, ssize_t len ) {
+  term->written += len;
+  if (term->capture != NULL) {
+    sbuf_append_n(term->capture, s, len);
+    return true;
+  }
   term_cursor_visible(term,false); // reduce flicker
   ssize_t pos = 0;    
   if ((term->hcon_mode & ENABLE_VIRTUAL_TERMINAL_PROCESSING) != 0) {
@@ -871,6 +1136,7 @@ static bool term_esc_query_raw( term_t* term, const char* query, char* buf, ssiz
 {
   if (buf==NULL || buflen <= 0 || query[0] == 0) return false;
   bool osc = (query[1] == ']');
+  tty_thread_stop(term->tty);  // the response is read directly
   if (!term_write_direct(term, query, ic_strlen(query))) return false;
   debug_msg("term: read tty query response to: ESC %s\n", query + 1);  
   return tty_read_esc_response( term->tty, query[1], osc, buf, buflen );
@@ -899,6 +1165,7 @@ static void term_set_cursor_pos( term_t* term, ssize_t row, ssize_t col ) {
 }
 
 ic_private bool term_update_dim(term_t* term) {  
+  if (term->capture != NULL) return false;  // fixed in headless mode
   ssize_t cols = 0;
   ssize_t rows = 0;
   struct winsize ws;
@@ -941,6 +1208,7 @@ ic_private bool term_update_dim(term_t* term) {
 #else
 
 ic_private bool term_update_dim(term_t* term) {
+  if (term->capture != NULL) return false;  // fixed in headless mode
   if (term->hcon == 0) {
     term->hcon = GetConsoleWindow();
   }
@@ -1052,6 +1320,7 @@ static void term_init_raw(term_t* term) {
 
 ic_private void term_start_raw(term_t* term) {
   if (term->raw_enabled++ > 0) return;  
+  if (term->capture != NULL) return;
   CONSOLE_SCREEN_BUFFER_INFO info;
   if (GetConsoleScreenBufferInfo(term->hcon, &info)) {
     term->hcon_orig_attr = info.wAttributes;
@@ -1066,6 +1335,7 @@ ic_private void term_start_raw(term_t* term) {
     // but it still fails to render correctly; so we require the palette be large enough (like in Windows Terminal)
     if (term->palette >= ANSI256 && SetConsoleMode(term->hcon, mode | ENABLE_VIRTUAL_TERMINAL_PROCESSING)) {
       term->hcon_mode = mode | ENABLE_VIRTUAL_TERMINAL_PROCESSING;
+      term->can_scroll = true;
       debug_msg("term: console mode: virtual terminal processing enabled\n");
     }
     // no virtual terminal processing, emulate instead
@@ -1088,6 +1358,7 @@ ic_private void term_end_raw(term_t* term, bool force) {
   }
   else {
     term->raw_enabled = 0;
+    if (term->capture != NULL) return;
     SetConsoleMode(term->hcon, term->hcon_orig_mode);
     SetConsoleOutputCP(term->hcon_orig_cp);
     SetConsoleTextAttribute(term->hcon, term->hcon_orig_attr);
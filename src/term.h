@@ -27,6 +27,11 @@ ic_private term_t* term_new(alloc_t* mem, tty_t* tty, bool nocolor, bool silent,
 ic_private void term_free(term_t* term);
 
 ic_private bool term_is_interactive(const term_t* term);
+ic_private bool term_is_plain(const term_t* term);
+ic_private void term_set_tty(term_t* term, tty_t* tty);
+ic_private bool term_set_headless(term_t* term, tty_t* tty, ssize_t width, ssize_t height);
+ic_private const char* term_get_capture(term_t* term, ssize_t* len);  // captured output in headless mode
+ic_private void term_clear_capture(term_t* term);
 ic_private void term_start_raw(term_t* term);
 ic_private void term_end_raw(term_t* term, bool force);
 
@@ -48,6 +53,10 @@ ic_private bool term_update_dim(term_t* term);
 
 ic_private ssize_t term_get_width(term_t* term);
 ic_private ssize_t term_get_height(term_t* term);
+ic_private ssize_t term_get_written(const term_t* term);  // total bytes written so far
+ic_private int  term_get_render_level(const term_t* term);  // 0: full, 1: no hints, 2: no colors, 3: minimal
+ic_private long term_get_bandwidth(const term_t* term);     // estimated bytes per second (or 0 if unknown)
+ic_private bool term_enable_adaptive(term_t* term, bool enable);
 ic_private int  term_get_color_bits(term_t* term);
 
 // Helpers
@@ -61,6 +70,9 @@ ic_private void term_down(term_t* term, ssize_t n);
 ic_private void term_start_of_line(term_t* term );
 ic_private void term_clear_line(term_t* term);
 ic_private void term_clear_to_end_of_line(term_t* term);
+ic_private bool term_can_scroll(const term_t* term);
+ic_private bool term_enable_scroll(term_t* term, bool enable);
+ic_private void term_scroll_region(term_t* term, ssize_t top, ssize_t bottom, ssize_t n);
 // ic_private void term_clear_lines_to_end(term_t* term);
 
 
@@ -75,8 +87,10 @@ ic_private void term_bgcolor(term_t* term, ic_color_t color);
 
 // Formatted output
 
-ic_private attr_t term_get_attr( const term_t* term );
+ic_private attr_t term_get_attr( term_t* term );
 ic_private void   term_set_attr( term_t* term, attr_t attr );
+ic_private void   term_start_passthrough( term_t* term );  // pass SGR sequences through without tracking the attributes
+ic_private void   term_end_passthrough( term_t* term );    // and recompute the attributes once at the end
 ic_private void   term_write_formatted( term_t* term, const char* s, const attr_t* attrs );
 ic_private void   term_write_formatted_n( term_t* term, const char* s, const attr_t* attrs, ssize_t n );
 
@@ -0,0 +1,360 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2021, Daan Leijen
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+-----------------------------------------------------------------------------*/
+#include <string.h>
+#include <stdlib.h>
+
+#include "../include/isocline.h"
+#include "common.h"
+#include "stringbuf.h"
+#include "tindex.h"
+
+//-------------------------------------------------------------
+// Tokens are maximal runs of filename letters (without surrounding
+// quotes). Each distinct token is stored once in a string pool and
+// found through a hash table when entries are added. For prefix
+// lookup the tokens are kept in a table sorted on their text;
+// new tokens are sorted and merged into it on the next lookup.
+//-------------------------------------------------------------
+
+#define IC_TOKEN_MIN  (2)     // shorter tokens are not worth completing
+#define IC_TOKEN_MAX  (256)   // longer tokens are most likely data
+
+typedef struct token_s {
+  ssize_t  ofs;       // offset of the (0 terminated) token in the pool
+  ssize_t  len;
+  ssize_t  count;     // number of entries that contain this token (0 if they were all removed)
+  ssize_t  last;      // the newest entry that contained this token
+  ssize_t  mark;      // the last add or remove that visited this token (to count each entry once)
+} token_t;
+
+struct tindex_s {
+  token_t* tokens;
+  ssize_t  count;
+  ssize_t  len;
+  char*    pool;      // token strings
+  ssize_t  pool_count;
+  ssize_t  pool_len;
+  ssize_t* table;     // hash table of token indices (-1 if empty); the size is a power of 2
+  ssize_t  table_len;
+  ssize_t* sorted;    // token indices sorted on their text (of size `len`)
+  ssize_t  sorted_count; // tokens from here on are not yet in `sorted`
+  ssize_t  seq;       // sequence number of the newest entry
+  ssize_t  seq_old;   // sequence number of the oldest entry (older entries are added last)
+  ssize_t  marks;     // number of add and remove calls
+  alloc_t* mem;
+};
+
+ic_private tindex_t* tindex_new(alloc_t* mem) {
+  tindex_t* ti = mem_zalloc_tp(mem, tindex_t);
+  if (ti == NULL) return NULL;
+  ti->mem = mem;
+  return ti;
+}
+
+ic_private void tindex_free(tindex_t* ti) {
+  if (ti == NULL) return;
+  mem_free(ti->mem, ti->tokens);
+  mem_free(ti->mem, ti->pool);
+  mem_free(ti->mem, ti->table);
+  mem_free(ti->mem, ti->sorted);
+  mem_free(ti->mem, ti);
+}
+
+
+//-------------------------------------------------------------
+// Adding tokens
+//-------------------------------------------------------------
+
+// FNV-1a
+static uint32_t tindex_hash(const char* s, ssize_t len) {
+  uint32_t h = 2166136261U;
+  for (ssize_t i = 0; i < len; i++) {
+    h ^= (uint8_t)s[i];
+    h *= 16777619U;
+  }
+  return h;
+}
+
+static bool tindex_table_grow(tindex_t* ti) {
+  const ssize_t newlen = (ti->table_len <= 0 ? 1024 : 2*ti->table_len);
+  ssize_t* table = mem_malloc_tp_n(ti->mem, ssize_t, newlen);
+  if (table == NULL) return false;
+  for (ssize_t i = 0; i < newlen; i++) { table[i] = -1; }
+  for (ssize_t t = 0; t < ti->count; t++) {
+    const token_t* tok = &ti->tokens[t];
+    ssize_t i = (ssize_t)(tindex_hash(ti->pool + tok->ofs, tok->len) & (uint32_t)(newlen - 1));
+    while (table[i] >= 0) { i = (i + 1) & (newlen - 1); }
+    table[i] = t;
+  }
+  mem_free(ti->mem, ti->table);
+  ti->table = table;
+  ti->table_len = newlen;
+  return true;
+}
+
+static bool tindex_reserve(tindex_t* ti, ssize_t tlen) {
+  if (ti->count >= ti->len) {
+    const ssize_t newlen = (ti->len <= 0 ? 256 : 2*ti->len);
+    token_t* tokens = mem_realloc_tp(ti->mem, token_t, ti->tokens, newlen);
+    if (tokens == NULL) return false;
+    ti->tokens = tokens;
+    ssize_t* sorted = mem_realloc_tp(ti->mem, ssize_t, ti->sorted, newlen);
+    if (sorted == NULL) return false;
+    ti->sorted = sorted;
+    ti->len = newlen;
+  }
+  if (ti->pool_count + tlen + 1 > ti->pool_len) {
+    ssize_t newlen = (ti->pool_len <= 0 ? 4096 : 2*ti->pool_len);
+    while (ti->pool_count + tlen + 1 > newlen) { newlen *= 2; }
+    char* pool = mem_realloc_tp(ti->mem, char, ti->pool, newlen);
+    if (pool == NULL) return false;
+    ti->pool = pool;
+    ti->pool_len = newlen;
+  }
+  if (2*(ti->count + 1) > ti->table_len) {
+    return tindex_table_grow(ti);
+  }
+  return true;
+}
+
+// Find a token, or return -1 with in `slot` the free hash table entry for it.
+static ssize_t tindex_find(const tindex_t* ti, const char* s, ssize_t len, ssize_t* slot) {
+  const ssize_t mask = ti->table_len - 1;
+  ssize_t i = (ssize_t)(tindex_hash(s, len) & (uint32_t)mask);
+  while (ti->table[i] >= 0) {
+    const token_t* tok = &ti->tokens[ti->table[i]];
+    if (tok->len == len && memcmp(ti->pool + tok->ofs, s, to_size_t(len)) == 0) return ti->table[i];
+    i = (i + 1) & mask;
+  }
+  if (slot != NULL) *slot = i;
+  return -1;
+}
+
+static void tindex_add_token(tindex_t* ti, const char* s, ssize_t len, ssize_t seq) {
+  if (!tindex_reserve(ti, len)) return;
+  ssize_t i;
+  const ssize_t t = tindex_find(ti, s, len, &i);
+  if (t >= 0) {
+    token_t* tok = &ti->tokens[t];
+    if (tok->mark != ti->marks) {  // count each entry once
+      tok->mark = ti->marks;
+      tok->count++;
+      if (seq > tok->last) tok->last = seq;
+    }
+    return;
+  }
+  // a new token
+  token_t* tok = &ti->tokens[ti->count];
+  tok->ofs   = ti->pool_count;
+  tok->len   = len;
+  tok->count = 1;
+  tok->last  = seq;
+  tok->mark  = ti->marks;
+  ic_memcpy(ti->pool + ti->pool_count, s, len);
+  ti->pool[ti->pool_count + len] = 0;
+  ti->pool_count += len + 1;
+  ti->table[i] = ti->count;
+  ti->count++;
+}
+
+static void tindex_remove_token(tindex_t* ti, const char* s, ssize_t len) {
+  if (ti->table_len <= 0) return;
+  const ssize_t t = tindex_find(ti, s, len, NULL);
+  if (t < 0) return;
+  token_t* tok = &ti->tokens[t];
+  if (tok->mark != ti->marks && tok->count > 0) {
+    tok->mark = ti->marks;
+    tok->count--;
+  }
+}
+
+static bool tindex_is_quote(char c) {
+  return (c == '\'' || c == '"');
+}
+
+// Find the next token in `entry` from `*i` on.
+static bool tindex_next(const char* entry, ssize_t len, ssize_t* i, ssize_t* start, ssize_t* end) {
+  while (*i < len) {
+    ssize_t s = str_scan_while(entry, len, *i, IC_CHAR_FILENAME_LETTER, true);
+    ssize_t e = str_scan_while(entry, len, s, IC_CHAR_FILENAME_LETTER, false);
+    *i = e;
+    while (s < e && tindex_is_quote(entry[s])) { s++; }
+    while (e > s && (tindex_is_quote(entry[e-1]) || entry[e-1] == ',' || entry[e-1] == ':')) { e--; }
+    if (e - s >= IC_TOKEN_MIN && e - s <= IC_TOKEN_MAX) {
+      *start = s;
+      *end = e;
+      return true;
+    }
+  }
+  return false;
+}
+
+ic_private void tindex_add(tindex_t* ti, const char* entry, ssize_t len, bool older) {
+  if (ti == NULL || entry == NULL) return;
+  ti->marks++;
+  const ssize_t seq = (older ? --ti->seq_old : ++ti->seq);
+  ssize_t i = 0;
+  ssize_t start, end;
+  while (tindex_next(entry, len, &i, &start, &end)) {
+    tindex_add_token(ti, entry + start, end - start, seq);
+  }
+}
+
+ic_private void tindex_remove(tindex_t* ti, const char* entry, ssize_t len) {
+  if (ti == NULL || entry == NULL) return;
+  ti->marks++;
+  ssize_t i = 0;
+  ssize_t start, end;
+  while (tindex_next(entry, len, &i, &start, &end)) {
+    tindex_remove_token(ti, entry + start, end - start);
+  }
+}
+
+
+//-------------------------------------------------------------
+// Prefix lookup
+//-------------------------------------------------------------
+
+static int tindex_compare(const tindex_t* ti, ssize_t t1, ssize_t t2) {
+  return strcmp(ti->pool + ti->tokens[t1].ofs, ti->pool + ti->tokens[t2].ofs);
+}
+
+// merge the sorted runs `ids[lo,mid)` and `ids[mid,hi)` using `tmp`
+static void tindex_merge(const tindex_t* ti, ssize_t* ids, ssize_t lo, ssize_t mid, ssize_t hi, ssize_t* tmp) {
+  ssize_t i = lo;
+  ssize_t j = mid;
+  ssize_t k = 0;
+  while (i < mid && j < hi) {
+    tmp[k++] = (tindex_compare(ti, ids[j], ids[i]) < 0 ? ids[j++] : ids[i++]);
+  }
+  while (i < mid) { tmp[k++] = ids[i++]; }
+  while (j < hi)  { tmp[k++] = ids[j++]; }
+  ic_memcpy(ids + lo, tmp, k * ssizeof(ssize_t));
+}
+
+static void tindex_sort(const tindex_t* ti, ssize_t* ids, ssize_t lo, ssize_t hi, ssize_t* tmp) {
+  if (hi - lo <= 1) return;
+  const ssize_t mid = lo + (hi - lo)/2;
+  tindex_sort(ti, ids, lo, mid, tmp);
+  tindex_sort(ti, ids, mid, hi, tmp);
+  tindex_merge(ti, ids, lo, mid, hi, tmp);
+}
+
+// Sort the new tokens and merge them into the sorted table. Usually there are only a few
+// new ones, so we merge from the back with a binary search for each, moving every old entry once.
+static bool tindex_update_sorted(tindex_t* ti) {
+  const ssize_t n = ti->count - ti->sorted_count;
+  if (n <= 0) return true;
+  ssize_t* ids = mem_malloc_tp_n(ti->mem, ssize_t, 2*n);
+  if (ids == NULL) return false;
+  for (ssize_t i = 0; i < n; i++) { ids[i] = ti->sorted_count + i; }
+  tindex_sort(ti, ids, 0, n, ids + n);
+  ssize_t end = ti->sorted_count;  // the old entries before `end` are not yet moved
+  for (ssize_t j = n - 1; j >= 0; j--) {
+    ssize_t lo = 0;
+    ssize_t hi = end;
+    while (lo < hi) {
+      const ssize_t mid = lo + (hi - lo)/2;
+      if (tindex_compare(ti, ti->sorted[mid], ids[j]) <= 0) { lo = mid + 1; }
+                                                        else { hi = mid; }
+    }
+    ic_memmove(ti->sorted + lo + j + 1, ti->sorted + lo, (end - lo) * ssizeof(ssize_t));
+    ti->sorted[lo + j] = ids[j];
+    end = lo;
+  }
+  mem_free(ti->mem, ids);
+  ti->sorted_count = ti->count;
+  return true;
+}
+
+typedef struct tmatch_s {
+  double   score;
+  ssize_t  last;
+  ssize_t  token;
+} tmatch_t;
+
+static bool tmatch_better(const tmatch_t* m1, const tmatch_t* m2) {
+  return (m1->score > m2->score || (m1->score == m2->score && m1->last > m2->last));
+}
+
+static int tmatch_compare(const void* p1, const void* p2) {
+  const tmatch_t* m1 = (const tmatch_t*)p1;
+  const tmatch_t* m2 = (const tmatch_t*)p2;
+  return (tmatch_better(m1, m2) ? -1 : (tmatch_better(m2, m1) ? 1 : 0));
+}
+
+// restore the heap (with the worst match at the top) from position `i` down
+static void tmatch_sift_down(tmatch_t* heap, ssize_t n, ssize_t i) {
+  while (true) {
+    ssize_t worst = i;
+    const ssize_t l = 2*i + 1;
+    const ssize_t r = l + 1;
+    if (l < n && tmatch_better(&heap[worst], &heap[l])) worst = l;
+    if (r < n && tmatch_better(&heap[worst], &heap[r])) worst = r;
+    if (worst == i) return;
+    const tmatch_t m = heap[i];
+    heap[i] = heap[worst];
+    heap[worst] = m;
+    i = worst;
+  }
+}
+
+// frequency weighted by how recently a token was used
+static double tindex_score(const tindex_t* ti, const token_t* tok) {
+  const ssize_t age = ti->seq - tok->last;
+  const double weight = (age < 100 ? 4.0 : (age < 1000 ? 2.0 : (age < 10000 ? 1.0 : 0.5)));
+  return weight * (double)tok->count;
+}
+
+ic_private void tindex_update(tindex_t* ti) {
+  if (ti != NULL) { tindex_update_sorted(ti); }
+}
+
+ic_private ssize_t tindex_match(tindex_t* ti, const char* prefix, const char** matches, ssize_t max) {
+  if (ti == NULL || prefix == NULL || max <= 0 || ti->count == 0) return 0;
+  if (!tindex_update_sorted(ti)) return 0;
+  const ssize_t plen = ic_strlen(prefix);
+  // binary search for the first token that is not less than the prefix
+  ssize_t lo = 0;
+  ssize_t hi = ti->count;
+  while (lo < hi) {
+    const ssize_t mid = lo + (hi - lo)/2;
+    if (strcmp(ti->pool + ti->tokens[ti->sorted[mid]].ofs, prefix) < 0) { lo = mid + 1; }
+                                                                    else { hi = mid; }
+  }
+  hi = lo;
+  while (hi < ti->count && strncmp(ti->pool + ti->tokens[ti->sorted[hi]].ofs, prefix, to_size_t(plen)) == 0) { hi++; }
+  if (hi <= lo) return 0;
+  // keep the best `max` candidates in a heap
+  tmatch_t* cands = mem_malloc_tp_n(ti->mem, tmatch_t, (hi - lo < max ? hi - lo : max));
+  if (cands == NULL) return 0;
+  ssize_t n = 0;
+  for (ssize_t i = lo; i < hi; i++) {
+    const token_t* tok = &ti->tokens[ti->sorted[i]];
+    if (tok->len == plen || tok->count == 0) continue;  // nothing to complete, or removed
+    tmatch_t m;
+    m.score = tindex_score(ti, tok);
+    m.last  = tok->last;
+    m.token = ti->sorted[i];
+    if (n < max) {
+      cands[n++] = m;
+      if (n == max) {
+        for (ssize_t j = n/2 - 1; j >= 0; j--) { tmatch_sift_down(cands, n, j); }
+      }
+    }
+    else if (tmatch_better(&m, &cands[0])) {
+      cands[0] = m;
+      tmatch_sift_down(cands, n, 0);
+    }
+  }
+  qsort(cands, to_size_t(n), sizeof(cands[0]), &tmatch_compare);
+  for (ssize_t i = 0; i < n; i++) {
+    matches[i] = ti->pool + ti->tokens[cands[i].token].ofs;
+  }
+  mem_free(ti->mem, cands);
+  return n;
+}
@@ -0,0 +1,38 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2021, Daan Leijen
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+-----------------------------------------------------------------------------*/
+#pragma once
+#ifndef IC_TINDEX_H
+#define IC_TINDEX_H
+
+#include "common.h"
+
+//-------------------------------------------------------------
+// Token index: the words (like host names or file paths) of
+// history entries with their frequency and recency, in a
+// sorted table for fast prefix lookup (used for completion).
+//-------------------------------------------------------------
+
+struct tindex_s;
+typedef struct tindex_s tindex_t;
+
+ic_private tindex_t* tindex_new(alloc_t* mem);
+ic_private void      tindex_free(tindex_t* ti);
+
+// Add the tokens of a new entry, or of an entry that is `older` than all added ones.
+ic_private void      tindex_add(tindex_t* ti, const char* entry, ssize_t len, bool older);
+
+// Remove the tokens of an added entry (tokens stay in the index with a zero count).
+ic_private void      tindex_remove(tindex_t* ti, const char* entry, ssize_t len);
+
+// Sort the new tokens into the lookup table (otherwise done on the next `tindex_match`).
+ic_private void      tindex_update(tindex_t* ti);
+
+// Find at most `max` tokens that start with `prefix` (but are longer), the most relevant first.
+// The returned tokens are valid until the next `tindex_add`.
+ic_private ssize_t   tindex_match(tindex_t* ti, const char* prefix, const char** matches, ssize_t max);
+
+#endif // IC_TINDEX_H
@@ -0,0 +1,181 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2021, Daan Leijen
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+-----------------------------------------------------------------------------*/
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "common.h"
+#include "trace.h"
+
+//-------------------------------------------------------------
+// A trace file starts with the `IC_TRACE_MAGIC` bytes followed by records.
+// Each record is a tag byte and the micro-seconds since the previous
+// record, followed by the record fields. All numbers are unsigned LEB128.
+//   s <dt> <width> <height>          start of an edit
+//   i <dt> <byte>                    a raw input byte
+//   k <dt> <key> <usecs> <bytes>     a processed key: processing time and output bytes
+// The file is flushed at the end of each edit.
+//-------------------------------------------------------------
+
+#define IC_TRACE_MAGIC  "ictrace1"
+
+struct trace_s {
+  FILE*     f;          // trace file
+  int64_t   last;       // time of the last record
+  alloc_t*  mem;
+};
+
+ic_private trace_t* trace_new(alloc_t* mem, const char* fname) {
+  if (fname == NULL) return NULL;
+  trace_t* t = mem_zalloc_tp(mem, trace_t);
+  if (t == NULL) return NULL;
+  t->mem = mem;
+  t->f = fopen(fname, "wb");
+  if (t->f == NULL) {
+    debug_msg("trace: unable to open: %s\n", fname);
+    mem_free(mem, t);
+    return NULL;
+  }
+  #ifndef _WIN32
+  chmod(fname, S_IRUSR|S_IWUSR);  // it contains everything that is typed
+  #endif
+  fwrite(IC_TRACE_MAGIC, 1, strlen(IC_TRACE_MAGIC), t->f);
+  t->last = ic_time_usecs();
+  return t;
+}
+
+ic_private void trace_free(trace_t* t) {
+  if (t == NULL) return;
+  fclose(t->f);
+  mem_free(t->mem, t);
+}
+
+
+//-------------------------------------------------------------
+// Recording
+//-------------------------------------------------------------
+
+static void trace_put_num(trace_t* t, uint64_t x) {
+  uint8_t buf[10];
+  ssize_t n = 0;
+  do {
+    uint8_t b = (uint8_t)(x & 0x7F);
+    x >>= 7;
+    buf[n++] = (x != 0 ? (b | 0x80) : b);
+  } while (x != 0);
+  fwrite(buf, 1, to_size_t(n), t->f);
+}
+
+static void trace_put_tag(trace_t* t, char tag) {
+  const int64_t now = ic_time_usecs();
+  fputc(tag, t->f);
+  trace_put_num(t, (uint64_t)(now > t->last ? now - t->last : 0));
+  t->last = now;
+}
+
+ic_private void trace_edit_start(trace_t* t, ssize_t width, ssize_t height) {
+  if (t == NULL) return;
+  trace_put_tag(t, 's');
+  trace_put_num(t, (uint64_t)(width > 0 ? width : 0));
+  trace_put_num(t, (uint64_t)(height > 0 ? height : 0));
+}
+
+ic_private void trace_edit_done(trace_t* t) {
+  if (t == NULL) return;
+  fflush(t->f);
+}
+
+ic_private void trace_input(trace_t* t, uint8_t c) {
+  if (t == NULL) return;
+  trace_put_tag(t, 'i');
+  fputc(c, t->f);
+}
+
+ic_private void trace_key(trace_t* t, uint32_t key, int64_t usecs, ssize_t out_bytes) {
+  if (t == NULL) return;
+  trace_put_tag(t, 'k');
+  trace_put_num(t, key);
+  trace_put_num(t, (uint64_t)(usecs > 0 ? usecs : 0));
+  trace_put_num(t, (uint64_t)(out_bytes > 0 ? out_bytes : 0));
+}
+
+
+//-------------------------------------------------------------
+// Loading the input for a replay
+//-------------------------------------------------------------
+
+static bool trace_get_num(FILE* f, uint64_t* x) {
+  *x = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    int c = fgetc(f);
+    if (c == EOF) return false;
+    *x |= ((uint64_t)(c & 0x7F) << shift);
+    if ((c & 0x80) == 0) return true;
+  }
+  return false;
+}
+
+ic_private bool trace_load_input(alloc_t* mem, const char* fname, uint8_t** input, int64_t** times, ssize_t* count, ssize_t* width, ssize_t* height) {
+  *input = NULL;
+  *times = NULL;
+  *count = 0;
+  *width = 0;
+  *height = 0;
+  if (fname == NULL) return false;
+  FILE* f = fopen(fname, "rb");
+  if (f == NULL) return false;
+  char magic[sizeof(IC_TRACE_MAGIC)];
+  if (fread(magic, 1, strlen(IC_TRACE_MAGIC), f) != strlen(IC_TRACE_MAGIC) || memcmp(magic, IC_TRACE_MAGIC, strlen(IC_TRACE_MAGIC)) != 0) {
+    fclose(f);
+    return false;
+  }
+  ssize_t len = 0;
+  int64_t now = 0;
+  int64_t first = -1;
+  bool ok = true;
+  int tag;
+  while (ok && (tag = fgetc(f)) != EOF) {
+    uint64_t dt, x, y, z;
+    if (!trace_get_num(f, &dt)) { ok = false; break; }
+    now += (int64_t)dt;
+    if (tag == 's') {
+      ok = trace_get_num(f, &x) && trace_get_num(f, &y);
+      if (ok && *width == 0) {
+        *width  = (ssize_t)x;
+        *height = (ssize_t)y;
+      }
+    }
+    else if (tag == 'k') {
+      ok = trace_get_num(f, &x) && trace_get_num(f, &y) && trace_get_num(f, &z);
+    }
+    else if (tag == 'i') {
+      const int c = fgetc(f);
+      if (c == EOF) { ok = false; break; }
+      if (*count >= len) {
+        const ssize_t newlen = (len < 64 ? 64 : 2*len);
+        uint8_t* newinput = mem_realloc_tp(mem, uint8_t, *input, newlen);
+        if (newinput != NULL) { *input = newinput; }
+        int64_t* newtimes = mem_realloc_tp(mem, int64_t, *times, newlen);
+        if (newtimes != NULL) { *times = newtimes; }
+        if (newinput == NULL || newtimes == NULL) { ok = false; break; }
+        len = newlen;
+      }
+      if (first < 0) { first = now; }
+      (*input)[*count] = (uint8_t)c;
+      (*times)[*count] = now - first;
+      (*count)++;
+    }
+    else {
+      ok = false;
+    }
+  }
+  fclose(f);
+  if (!ok) {
+    debug_msg("trace: invalid trace file: %s\n", fname);
+  }
+  return true;  // use all valid records (even if the trace was cut short)
+}
@@ -0,0 +1,35 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2021, Daan Leijen
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+-----------------------------------------------------------------------------*/
+#pragma once
+#ifndef IC_TRACE_H
+#define IC_TRACE_H
+
+#include "common.h"
+
+//-------------------------------------------------------------
+// Keystroke trace: records the raw input with timestamps, and
+// the processing time and output size of each key, so latency
+// reports can be replayed (in headless mode).
+//-------------------------------------------------------------
+
+struct trace_s;
+typedef struct trace_s trace_t;
+
+ic_private trace_t* trace_new(alloc_t* mem, const char* fname);  // start a new trace file
+ic_private void     trace_free(trace_t* t);                       // t can be NULL
+
+// These do nothing if `t` is NULL
+ic_private void     trace_edit_start(trace_t* t, ssize_t width, ssize_t height);
+ic_private void     trace_edit_done(trace_t* t);
+ic_private void     trace_input(trace_t* t, uint8_t c);
+ic_private void     trace_key(trace_t* t, uint32_t key, int64_t usecs, ssize_t out_bytes);
+
+// Load the input of a trace: `*count` bytes with their time (in micro-seconds from the first byte),
+// and the terminal size at the start of the first edit. The caller frees `*input` and `*times`.
+ic_private bool     trace_load_input(alloc_t* mem, const char* fname, uint8_t** input, int64_t** times, ssize_t* count, ssize_t* width, ssize_t* height);
+
+#endif // IC_TRACE_H
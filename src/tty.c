@@ -33,7 +33,15 @@ WINBASEAPI ULONGLONG WINAPI GetTickCount64(VOID);
 #endif
 #endif
 
+// An optional input thread decodes keys into a lock-free ring (needs pthreads and atomic builtins)
+#if !defined(_WIN32) && !defined(IC_NO_THREADS) && defined(__GNUC__)
+#define IC_TTY_THREAD
+#include <pthread.h>
+#include <fcntl.h>
+#endif
+
 #define TTY_PUSH_MAX (32)
+#define TTY_RING_SIZE (256)    // must be a power of 2
 
 struct tty_s {
   int       fd_in;                  // input handle
@@ -48,12 +56,38 @@ struct tty_s {
   ssize_t   cpush_count;
   long      esc_initial_timeout;    // initial ms wait to see if ESC starts an escape sequence
   long      esc_timeout;            // follow up delay for characters in an escape sequence
+  bool      typeahead;              // preserve input typed between readline calls?
+  bool      typeahead_noecho;       // keep echo off between readline calls (when `typeahead` is enabled)
+  bool      headless;               // read from the `feed` buffer instead of a terminal?
+  uint8_t*  feed;                   // fed input bytes (in headless mode)
+  ssize_t   feed_count;             // bytes in `feed`
+  ssize_t   feed_pos;               // next byte to read from `feed`
+  ssize_t   feed_size;              // allocated size of `feed`
+  int64_t*  feed_times;             // if not NULL, the time of each fed byte since `feed_start` (when replaying a trace)
+  int64_t   feed_start;             // start time of a replay
+  trace_t*  trace;                  // if not NULL, all input is recorded here
+  bool      thread_enabled;         // decode keys in a separate input thread?
+  #if defined(IC_TTY_THREAD)
+  pthread_t thread;                 // the input thread (while `thread_running`)
+  bool      thread_running;         // is the input thread running? (read atomically by `tty_async_stop`)
+  bool      thread_closed;          // set by the input thread when the input was closed
+  bool      thread_pipes;           // are the wakeup and stop pipes created?
+  int       wake_in;                // the input thread writes a byte for each key (and `tty_async_stop` an 's')
+  int       wake_out;
+  int       stop_in;                // the editor writes a byte to stop the input thread
+  int       stop_out;
+  uint32_t  ring_head;              // next slot to write (only updated by the input thread)
+  uint32_t  ring_tail;              // next slot to read (only updated by the editor)
+  code_t    ring[TTY_RING_SIZE];    // single-producer/single-consumer ring of decoded keys
+  #endif
   #if defined(_WIN32)               
   HANDLE    hcon;                   // console input handle
   DWORD     hcon_orig_mode;         // original console mode
   #else
   struct termios  orig_ios;         // original terminal settings
   struct termios  raw_ios;          // raw terminal settings
+  struct termios  noecho_ios;       // original terminal settings without echo (used between calls in typeahead mode)
+  bool            noecho_enabled;   // are the `noecho_ios` settings active?
   #endif
 };
 
@@ -143,15 +177,15 @@ static code_t tty_read_utf8( tty_t* tty, uint8_t c0 ) {
 // pop a code from the pushback buffer.
 static bool tty_code_pop(tty_t* tty, code_t* code);
 
+// the input thread (see below)
+static bool tty_ring_pop(tty_t* tty, code_t* code);
+static bool tty_thread_is_running(const tty_t* tty);
+static bool tty_thread_start(tty_t* tty);
+static bool tty_thread_read(tty_t* tty, long timeout_ms, code_t* code);
 
-// read a single char/key 
-ic_private bool tty_read_timeout(tty_t* tty, long timeout_ms, code_t* code) 
+// decode a single char/key from the character stream
+static bool tty_decode(tty_t* tty, long timeout_ms, code_t* code) 
 {
-  // is there a push_count back code?
-  if (tty_code_pop(tty,code)) {
-    return code;
-  }
-
   // read a single char/byte from a character stream
   uint8_t c;
   if (!tty_readc_noblock(tty, &c, timeout_ms)) return false;
@@ -177,6 +211,24 @@ ic_private bool tty_read_timeout(tty_t* tty, long timeout_ms, code_t* code)
   return true;
 }
 
+// read a single char/key 
+ic_private bool tty_read_timeout(tty_t* tty, long timeout_ms, code_t* code) 
+{
+  // is there a push_count back code?
+  if (tty_code_pop(tty,code)) {
+    return code;
+  }
+  // or a key that was decoded by the input thread?
+  if (tty_ring_pop(tty,code)) {
+    return true;
+  }
+  // wait for the input thread, or decode directly
+  if (tty_thread_start(tty)) {
+    return tty_thread_read(tty, timeout_ms, code);
+  }
+  return tty_decode(tty, timeout_ms, code);
+}
+
 // Transform virtual keys to be more portable across platforms
 static code_t modify_code( code_t code ) {
   code_t key  = KEY_NO_MODS(code);
@@ -223,7 +275,10 @@ static code_t modify_code( code_t code ) {
 ic_private code_t tty_read(tty_t* tty)
 {
   code_t code;
-  if (!tty_read_timeout(tty, -1, &code)) return KEY_NONE;
+  if (!tty_read_timeout(tty, -1, &code)) {
+    // a headless tty stops the edit once all fed input is consumed
+    return (tty->headless ? KEY_EVENT_STOP : KEY_NONE);
+  }
   return code;
 }
 
@@ -380,6 +435,7 @@ static void tty_cpush_csi_unicode( tty_t* tty, code_t mods, uint32_t unicode ) {
 
 static bool tty_init_raw(tty_t* tty);
 static void tty_done_raw(tty_t* tty);
+static void tty_thread_done(tty_t* tty);
 
 static bool tty_init_utf8(tty_t* tty) {
   #ifdef _WIN32
@@ -410,13 +466,97 @@ ic_private tty_t* tty_new(alloc_t* mem, int fd_in)
   return tty;
 }
 
+// A headless tty reads only bytes that are fed to it and is not connected to a terminal.
+ic_private tty_t* tty_new_headless(alloc_t* mem) 
+{
+  tty_t* tty = mem_zalloc_tp(mem, tty_t);
+  if (tty == NULL) return NULL;
+  tty->mem = mem;
+  tty->fd_in = -1;
+  tty->headless = true;
+  tty->is_utf8 = true;
+  tty->has_term_resize_event = true;  // never resizes
+  return tty;
+}
+
 ic_private void tty_free(tty_t* tty) {
   if (tty==NULL) return;
-  tty_end_raw(tty);
-  tty_done_raw(tty);
+  if (!tty->headless) {
+    tty_end_raw(tty);
+    tty_done_raw(tty);
+  }
+  tty_thread_done(tty);
+  mem_free(tty->mem,tty->feed);
+  mem_free(tty->mem,tty->feed_times);
   mem_free(tty->mem,tty);
 }
 
+ic_private bool tty_is_headless(const tty_t* tty) {
+  return (tty != NULL && tty->headless);
+}
+
+ic_private bool tty_feed(tty_t* tty, const char* s, ssize_t len) {
+  if (tty == NULL || !tty->headless || s == NULL) return false;
+  if (len <= 0) return true;
+  // fed bytes are available right away (also the ones still left from a replay)
+  mem_free(tty->mem, tty->feed_times);
+  tty->feed_times = NULL;
+  // drop the bytes that were already read
+  if (tty->feed_pos > 0) {
+    ic_memmove(tty->feed, tty->feed + tty->feed_pos, tty->feed_count - tty->feed_pos);
+    tty->feed_count -= tty->feed_pos;
+    tty->feed_pos = 0;
+  }
+  if (tty->feed_count + len > tty->feed_size) {
+    ssize_t newsize = (tty->feed_size < 64 ? 64 : 2*tty->feed_size);
+    if (newsize < tty->feed_count + len) { newsize = tty->feed_count + len; }
+    uint8_t* newfeed = mem_realloc_tp(tty->mem, uint8_t, tty->feed, newsize);
+    if (newfeed == NULL) return false;
+    tty->feed = newfeed;
+    tty->feed_size = newsize;
+  }
+  ic_memcpy(tty->feed + tty->feed_count, s, len);
+  tty->feed_count += len;
+  return true;
+}
+
+// Replace the fed input with `count` bytes that become available at the given `times` (in micro-seconds from now).
+ic_private bool tty_feed_timed(tty_t* tty, const uint8_t* input, const int64_t* times, ssize_t count) {
+  if (tty == NULL || !tty->headless || input == NULL || times == NULL) return false;
+  tty->feed_count = 0;
+  tty->feed_pos = 0;
+  if (!tty_feed(tty, (const char*)input, count)) return false;
+  tty->feed_times = mem_malloc_tp_n(tty->mem, int64_t, count);
+  if (tty->feed_times == NULL) return false;
+  ic_memcpy(tty->feed_times, times, count * ssizeof(int64_t));
+  tty->feed_start = ic_time_usecs();
+  return true;
+}
+
+ic_private void tty_set_trace(tty_t* tty, trace_t* trace) {
+  if (tty == NULL) return;
+  tty->trace = trace;
+}
+
+// in headless mode there is never any waiting: either there is fed input or not;
+// except when replaying a trace where we wait (at most `timeout_ms`) until the next byte is due.
+static bool tty_feed_pop(tty_t* tty, uint8_t* c, long timeout_ms) {
+  if (tty->feed_pos >= tty->feed_count) return false;
+  if (tty->feed_times != NULL) {
+    const int64_t wait = tty->feed_times[tty->feed_pos] - (ic_time_usecs() - tty->feed_start);
+    if (wait > 0) {
+      if (timeout_ms >= 0 && wait > 1000*(int64_t)timeout_ms) {
+        ic_sleep_usecs(1000*(int64_t)timeout_ms);
+        return false;
+      }
+      ic_sleep_usecs(wait);
+    }
+  }
+  *c = tty->feed[tty->feed_pos++];
+  trace_input(tty->trace, *c);
+  return true;
+}
+
 ic_private bool tty_is_utf8(const tty_t* tty) {
   if (tty == NULL) return true;
   return (tty->is_utf8);
@@ -436,6 +576,278 @@ ic_private void tty_set_esc_delay(tty_t* tty, long initial_delay_ms, long follow
   tty->esc_timeout = (followup_delay_ms < 0 ? 0 : (followup_delay_ms > 1000 ? 1000 : followup_delay_ms));
 }
 
+static void tty_restore_echo(tty_t* tty);
+
+ic_private bool tty_set_typeahead(tty_t* tty, bool enable, bool noecho) {
+  if (tty == NULL) return false;
+  bool prev = tty->typeahead;
+  tty->typeahead = enable;
+  tty->typeahead_noecho = (enable && noecho);
+  if (!tty->typeahead_noecho) { tty_restore_echo(tty); }
+  return prev;
+}
+
+ic_private bool tty_has_typeahead(tty_t* tty) {
+  if (tty == NULL || !tty->typeahead) return false;
+  if (tty->push_count > 0) return true;
+  code_t code;
+  if (tty_ring_pop(tty, &code)) {
+    tty_code_pushback(tty, code);
+    return true;
+  }
+  if (tty_thread_is_running(tty)) return false;
+  if (tty->cpush_count > 0) return true;
+  uint8_t c;
+  if (!tty_readc_noblock(tty, &c, 0)) return false;
+  tty_cpush_char(tty, c);
+  return true;
+}
+
+//-------------------------------------------------------------
+// Input thread
+// When enabled, a separate thread reads and decodes the keys 
+// (including waiting for the rest of an escape sequence) and 
+// pushes them into a single-producer/single-consumer ring.
+// The editor waits on a wakeup pipe for complete keys and is
+// never blocked on partial input. The thread only runs while
+// in raw mode and is started lazily on the first read.
+//-------------------------------------------------------------
+
+#if defined(IC_TTY_THREAD)
+
+static bool tty_thread_is_running(const tty_t* tty) {
+  return __atomic_load_n(&tty->thread_running, __ATOMIC_ACQUIRE);
+}
+
+// the input thread stops waiting for the rest of an escape sequence when this becomes readable
+static int tty_thread_stop_fd(const tty_t* tty) {
+  return (tty_thread_is_running(tty) ? tty->stop_in : -1);
+}
+
+// wait at most `timeout_ms` (or forever if negative) for `fd` to be readable
+static bool tty_wait_fd(int fd, long timeout_ms) {
+  fd_set readset;
+  struct timeval time;
+  FD_ZERO(&readset);
+  FD_SET(fd, &readset);
+  time.tv_sec  = (timeout_ms > 0 ? timeout_ms / 1000 : 0);
+  time.tv_usec = (timeout_ms > 0 ? 1000*(timeout_ms % 1000) : 0);
+  return (select(fd + 1, &readset, NULL, NULL, (timeout_ms < 0 ? NULL : &time)) == 1);
+}
+
+static void tty_fd_signal(int fd, char c) {
+  // the write end is non-blocking: if the pipe is full the reader is signaled already
+  if (write(fd, &c, 1) < 0) { /* ignore */ }
+}
+
+// drain a pipe; returns true if the character `c` was in it
+static bool tty_fd_drain(int fd, char c) {
+  bool found = false;
+  char buf[64];
+  ssize_t n;
+  while ((n = read(fd, buf, sizeof(buf))) > 0) {
+    if (memchr(buf, c, to_size_t(n)) != NULL) { found = true; }
+  }
+  return found;
+}
+
+static bool tty_pipe_init(int* fd_in, int* fd_out) {
+  int fds[2];
+  if (pipe(fds) != 0) return false;
+  for (int i = 0; i < 2; i++) {
+    const int flags = fcntl(fds[i], F_GETFL, 0);
+    fcntl(fds[i], F_SETFL, (flags < 0 ? 0 : flags) | O_NONBLOCK);
+    fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+  }
+  *fd_in = fds[0];
+  *fd_out = fds[1];
+  return true;
+}
+
+// called by the input thread only
+static bool tty_ring_push(tty_t* tty, code_t code) {
+  const uint32_t head = __atomic_load_n(&tty->ring_head, __ATOMIC_RELAXED);
+  while (head - __atomic_load_n(&tty->ring_tail, __ATOMIC_ACQUIRE) >= TTY_RING_SIZE) {
+    // the ring is full: wait for the editor to catch up (unless we are asked to stop)
+    if (tty_wait_fd(tty->stop_in, 1)) return false;
+  }
+  tty->ring[head & (TTY_RING_SIZE - 1)] = code;
+  __atomic_store_n(&tty->ring_head, head + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+// called by the editor only
+static bool tty_ring_pop(tty_t* tty, code_t* code) {
+  const uint32_t tail = __atomic_load_n(&tty->ring_tail, __ATOMIC_RELAXED);
+  if (__atomic_load_n(&tty->ring_head, __ATOMIC_ACQUIRE) == tail) return false;
+  *code = tty->ring[tail & (TTY_RING_SIZE - 1)];
+  __atomic_store_n(&tty->ring_tail, tail + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+static void* tty_thread_main(void* arg) {
+  tty_t* tty = (tty_t*)arg;
+  while (true) {
+    // bytes pushed back while decoding are processed first
+    if (tty->cpush_count <= 0) {
+      // wait for input or a stop request
+      fd_set readset;
+      FD_ZERO(&readset);
+      FD_SET(tty->fd_in, &readset);
+      FD_SET(tty->stop_in, &readset);
+      const int nfds = (tty->fd_in > tty->stop_in ? tty->fd_in : tty->stop_in) + 1;
+      if (select(nfds, &readset, NULL, NULL, NULL) < 0) {
+        if (errno == EINTR) continue;
+        debug_msg("tty: input thread: select failed: %d\n", errno);
+        break;
+      }
+      if (FD_ISSET(tty->stop_in, &readset)) return NULL;
+    }
+    // decode a complete key (waiting for the rest of an escape sequence)
+    code_t code;
+    if (!tty_decode(tty, -1, &code)) break;  // input was closed
+    if (!tty_ring_push(tty, code)) return NULL;
+    tty_fd_signal(tty->wake_out, 'k');
+  }
+  __atomic_store_n(&tty->thread_closed, true, __ATOMIC_RELEASE);
+  tty_fd_signal(tty->wake_out, 'c');
+  return NULL;
+}
+
+static bool tty_thread_start(tty_t* tty) {
+  if (tty_thread_is_running(tty)) return true;
+  // not while tracing as that records the input and edits on the same trace
+  if (!tty->thread_enabled || !tty->raw_enabled || tty->headless || tty->trace != NULL) return false;
+  if (!tty->thread_pipes) {
+    if (!tty_pipe_init(&tty->wake_in, &tty->wake_out)) return false;
+    if (!tty_pipe_init(&tty->stop_in, &tty->stop_out)) {
+      close(tty->wake_in);
+      close(tty->wake_out);
+      return false;
+    }
+    tty->thread_pipes = true;
+  }
+  tty_fd_drain(tty->wake_in, 0);
+  tty_fd_drain(tty->stop_in, 0);
+  tty->thread_closed = false;
+  // block all signals in the input thread so they are delivered to the editor thread
+  sigset_t all, prev;
+  sigfillset(&all);
+  pthread_sigmask(SIG_SETMASK, &all, &prev);
+  __atomic_store_n(&tty->thread_running, true, __ATOMIC_RELEASE);
+  const int err = pthread_create(&tty->thread, NULL, &tty_thread_main, tty);
+  pthread_sigmask(SIG_SETMASK, &prev, NULL);
+  if (err != 0) {
+    debug_msg("tty: unable to create the input thread: %d\n", err);
+    __atomic_store_n(&tty->thread_running, false, __ATOMIC_RELEASE);
+    tty->thread_enabled = false;
+    return false;
+  }
+  return true;
+}
+
+// Stop the input thread (and wait for it). It is started again on the next read.
+// Keys that were decoded already stay in the ring.
+ic_private void tty_thread_stop(tty_t* tty) {
+  if (tty == NULL || !tty_thread_is_running(tty)) return;
+  tty_fd_signal(tty->stop_out, 's');
+  pthread_join(tty->thread, NULL);
+  __atomic_store_n(&tty->thread_running, false, __ATOMIC_RELEASE);
+}
+
+static void tty_thread_done(tty_t* tty) {
+  tty_thread_stop(tty);
+  if (!tty->thread_pipes) return;
+  close(tty->wake_in);
+  close(tty->wake_out);
+  close(tty->stop_in);
+  close(tty->stop_out);
+  tty->thread_pipes = false;
+}
+
+// wait for a key from the input thread
+static bool tty_thread_read(tty_t* tty, long timeout_ms, code_t* code) {
+  const int64_t deadline = (timeout_ms < 0 ? -1 : ic_time_usecs() + 1000*(int64_t)timeout_ms);
+  while (true) {
+    if (tty_ring_pop(tty, code)) return true;
+    if (__atomic_load_n(&tty->thread_closed, __ATOMIC_ACQUIRE)) return false;
+    long wait = -1;
+    if (deadline >= 0) {
+      const int64_t left = deadline - ic_time_usecs();
+      wait = (left <= 0 ? 0 : (long)((left + 999) / 1000));
+    }
+    if (!tty_wait_fd(tty->wake_in, wait)) {
+      if (wait == 0) return false;  // timed out
+      continue;                     // interrupted by a signal (like a resize)
+    }
+    if (tty_fd_drain(tty->wake_in, 's')) {
+      *code = KEY_EVENT_STOP;       // from `tty_async_stop`
+      return true;
+    }
+  }
+}
+
+// unblock the editor from another thread
+static bool tty_thread_async_stop(const tty_t* tty) {
+  if (!tty_thread_is_running(tty)) return false;
+  tty_fd_signal(tty->wake_out, 's');
+  return true;
+}
+
+static void tty_ring_clear(tty_t* tty) {
+  tty->ring_tail = tty->ring_head;  // only called when the input thread is stopped
+}
+
+#else
+
+static bool tty_thread_is_running(const tty_t* tty) {
+  ic_unused(tty);
+  return false;
+}
+static int tty_thread_stop_fd(const tty_t* tty) {
+  ic_unused(tty);
+  return -1;
+}
+static bool tty_ring_pop(tty_t* tty, code_t* code) {
+  ic_unused(tty); ic_unused(code);
+  return false;
+}
+static bool tty_thread_start(tty_t* tty) {
+  ic_unused(tty);
+  return false;
+}
+ic_private void tty_thread_stop(tty_t* tty) {
+  ic_unused(tty);
+}
+static void tty_thread_done(tty_t* tty) {
+  ic_unused(tty);
+}
+static bool tty_thread_read(tty_t* tty, long timeout_ms, code_t* code) {
+  return tty_decode(tty, timeout_ms, code);
+}
+static bool tty_thread_async_stop(const tty_t* tty) {
+  ic_unused(tty);
+  return false;
+}
+static void tty_ring_clear(tty_t* tty) {
+  ic_unused(tty);
+}
+
+#endif
+
+ic_private bool tty_set_input_thread(tty_t* tty, bool enable) {
+  if (tty == NULL) return false;
+  bool prev = tty->thread_enabled;
+  #if defined(IC_TTY_THREAD)
+  tty->thread_enabled = enable;
+  if (!enable) { tty_thread_stop(tty); }
+  #else
+  ic_unused(enable);
+  #endif
+  return prev;
+}
+
+
 //-------------------------------------------------------------
 // Unix
 //-------------------------------------------------------------
@@ -448,6 +860,7 @@ static bool tty_readc_blocking(tty_t* tty, uint8_t* c) {
   if (nread < 0 && errno == EINTR) {
     // can happen on SIGWINCH signal for terminal resize
   }
+  if (nread == 1) { trace_input(tty->trace, *c); }
   return (nread == 1);
 }
 
@@ -457,6 +870,7 @@ ic_private bool tty_readc_noblock(tty_t* tty, uint8_t* c, long timeout_ms)
 {
   // in our pushback buffer?
   if (tty_cpop(tty, c)) return true;
+  if (tty->headless) return tty_feed_pop(tty, c, timeout_ms);
 
   // blocking read?
   if (timeout_ms < 0) {
@@ -484,9 +898,15 @@ ic_private bool tty_readc_noblock(tty_t* tty, uint8_t* c, long timeout_ms)
     struct timeval time;
     FD_ZERO(&readset);
     FD_SET(tty->fd_in, &readset);
+    int nfds = tty->fd_in + 1;
+    const int stop_fd = tty_thread_stop_fd(tty);
+    if (stop_fd >= 0) {
+      FD_SET(stop_fd, &readset);
+      if (stop_fd >= nfds) { nfds = stop_fd + 1; }
+    }
     time.tv_sec  = (timeout_ms > 0 ? timeout_ms / 1000 : 0);
     time.tv_usec = (timeout_ms > 0 ? 1000*(timeout_ms % 1000) : 0);      
-    if (select(tty->fd_in + 1, &readset, NULL, NULL, &time) == 1) {
+    if (select(nfds, &readset, NULL, NULL, &time) >= 1 && FD_ISSET(tty->fd_in, &readset)) {
       // input available
       return tty_readc_blocking(tty, c);
     }    
@@ -531,13 +951,14 @@ ic_private bool tty_readc_noblock(tty_t* tty, uint8_t* c, long timeout_ms)
 
 #if defined(TIOCSTI) 
 ic_private bool tty_async_stop(const tty_t* tty) {
+  if (tty_thread_async_stop(tty)) return true;
   // insert ^C in the input stream
   char c = KEY_CTRL_C;
   return (ioctl(tty->fd_in, TIOCSTI, &c) >= 0);
 }
 #else
 ic_private bool tty_async_stop(const tty_t* tty) {
-  return false;
+  return tty_thread_async_stop(tty);
 }
 #endif
 
@@ -587,9 +1008,10 @@ static void sig_handler(int signum, siginfo_t* siginfo, void* uap ) {
   }
   else {
     // the rest are termination signals; restore the terminal mode. (`tcsetattr` is signal-safe)
-    if (sig_tty != NULL && sig_tty->raw_enabled) {
+    if (sig_tty != NULL && (sig_tty->raw_enabled || sig_tty->noecho_enabled)) {
       tcsetattr(sig_tty->fd_in, TCSAFLUSH, &sig_tty->orig_ios);
       sig_tty->raw_enabled = false;
+      sig_tty->noecho_enabled = false;
     }
   }
   // call previous handler
@@ -646,22 +1068,49 @@ static void signals_restore(void) {
 
 #endif
 
+// In typeahead mode we switch with `TCSADRAIN` so any input typed while the 
+// application was busy is kept (instead of discarded with `TCSAFLUSH`).
+static int tty_switch_action(const tty_t* tty) {
+  return (tty->typeahead ? TCSADRAIN : TCSAFLUSH);
+}
+
 ic_private bool tty_start_raw(tty_t* tty) {
   if (tty == NULL) return false;
   if (tty->raw_enabled) return true;
-  if (tcsetattr(tty->fd_in,TCSAFLUSH,&tty->raw_ios) < 0) return false;  
+  if (!tty->headless && tcsetattr(tty->fd_in,tty_switch_action(tty),&tty->raw_ios) < 0) return false;  
   tty->raw_enabled = true;
+  tty->noecho_enabled = false;
   return true;
 }
 
 ic_private void tty_end_raw(tty_t* tty) {
   if (tty == NULL) return;
   if (!tty->raw_enabled) return;
-  tty->cpush_count = 0;
-  if (tcsetattr(tty->fd_in,TCSAFLUSH,&tty->orig_ios) < 0) return;
+  tty_thread_stop(tty);
+  if (!tty->typeahead) {   // keep bytes and keys that were read ahead
+    tty->cpush_count = 0; 
+    tty_ring_clear(tty);
+  }
+  if (tty->headless) {
+    // nothing to restore
+  }
+  else if (tty->typeahead_noecho) {
+    // stay quiet between calls so early keystrokes are not echoed by the terminal
+    if (tcsetattr(tty->fd_in,TCSADRAIN,&tty->noecho_ios) < 0) return;
+    tty->noecho_enabled = true;
+  }
+  else {
+    if (tcsetattr(tty->fd_in,tty_switch_action(tty),&tty->orig_ios) < 0) return;
+  }
   tty->raw_enabled = false;
 }
 
+static void tty_restore_echo(tty_t* tty) {
+  if (tty == NULL || !tty->noecho_enabled) return;
+  if (tcsetattr(tty->fd_in,TCSADRAIN,&tty->orig_ios) < 0) return;
+  tty->noecho_enabled = false;
+}
+
 static bool tty_init_raw(tty_t* tty) 
 {  
   // Set input to raw mode. See <https://man7.org/linux/man-pages/man3/termios.3.html>.
@@ -676,6 +1125,9 @@ static bool tty_init_raw(tty_t* tty)
   // 1 byte at a time, no delay
   tty->raw_ios.c_cc[VTIME] = 0;
   tty->raw_ios.c_cc[VMIN] = 1;
+  // the original settings without echo (used between calls in typeahead mode)
+  tty->noecho_ios = tty->orig_ios;
+  tty->noecho_ios.c_lflag &= ~(unsigned long)(ECHO);
 
   // store in global so our signal handlers can restore the terminal mode
   signals_install(tty);
@@ -684,7 +1136,7 @@ static bool tty_init_raw(tty_t* tty)
 }
 
 static void tty_done_raw(tty_t* tty) {
-  ic_unused(tty);
+  tty_restore_echo(tty);
   signals_restore();
 }
 
@@ -702,8 +1154,12 @@ static void tty_waitc_console(tty_t* tty, long timeout_ms);
 ic_private bool tty_readc_noblock(tty_t* tty, uint8_t* c, long timeout_ms) {  // don't modify `c` if there is no input
   // in our pushback buffer?
   if (tty_cpop(tty, c)) return true;
+  if (tty->headless) return tty_feed_pop(tty, c, timeout_ms);
   // any events in the input queue?
   tty_waitc_console(tty, timeout_ms);
+  for (ssize_t i = tty->cpush_count - 1; i >= 0; i--) {
+    trace_input(tty->trace, tty->cpushbuf[i]);  // record the input as pushed escape sequences
+  }
   return tty_cpop(tty, c);
 }
 
@@ -857,6 +1313,7 @@ ic_private bool tty_async_stop(const tty_t* tty) {
 
 ic_private bool tty_start_raw(tty_t* tty) {
   if (tty->raw_enabled) return true;
+  if (tty->headless) { tty->raw_enabled = true; return true; }
   GetConsoleMode(tty->hcon,&tty->hcon_orig_mode);
   DWORD mode = ENABLE_QUICK_EDIT_MODE   // cut&paste allowed 
              | ENABLE_WINDOW_INPUT      // to catch resize events 
@@ -870,7 +1327,7 @@ ic_private bool tty_start_raw(tty_t* tty) {
 
 ic_private void tty_end_raw(tty_t* tty) {
   if (!tty->raw_enabled) return;
-  SetConsoleMode(tty->hcon, tty->hcon_orig_mode );
+  if (!tty->headless) { SetConsoleMode(tty->hcon, tty->hcon_orig_mode ); }
   tty->raw_enabled = false;
 }
 
@@ -884,6 +1341,10 @@ static void tty_done_raw(tty_t* tty) {
   ic_unused(tty);
 }
 
+static void tty_restore_echo(tty_t* tty) {
+  ic_unused(tty);  // the console does not echo input that is not read
+}
+
 #endif
 
 
@@ -9,6 +9,7 @@
 #define IC_TTY_H
 
 #include "common.h"
+#include "trace.h"
 
 //-------------------------------------------------------------
 // TTY/Keyboard input 
@@ -23,6 +24,7 @@ typedef struct tty_s tty_t;
 
 
 ic_private tty_t* tty_new(alloc_t* mem, int fd_in);
+ic_private tty_t* tty_new_headless(alloc_t* mem);  // only reads input that is fed with `tty_feed`
 ic_private void   tty_free(tty_t* tty);
 
 ic_private bool   tty_is_utf8(const tty_t* tty);
@@ -39,6 +41,14 @@ ic_private bool   code_is_virt_key(code_t c );
 ic_private bool   tty_term_resize_event(tty_t* tty); // did the terminal resize?
 ic_private bool   tty_async_stop(const tty_t* tty);  // unblock the read asynchronously
 ic_private void   tty_set_esc_delay(tty_t* tty, long initial_delay_ms, long followup_delay_ms);
+ic_private bool   tty_set_typeahead(tty_t* tty, bool enable, bool noecho); // returns previous setting
+ic_private bool   tty_has_typeahead(tty_t* tty);     // is there input pending (in typeahead mode)?
+ic_private bool   tty_set_input_thread(tty_t* tty, bool enable);   // decode keys in a separate thread? returns previous setting
+ic_private void   tty_thread_stop(tty_t* tty);       // stop the input thread until the next read (to read the tty directly)
+ic_private bool   tty_is_headless(const tty_t* tty);
+ic_private bool   tty_feed(tty_t* tty, const char* s, ssize_t len);  // append input (in headless mode)
+ic_private bool   tty_feed_timed(tty_t* tty, const uint8_t* input, const int64_t* times, ssize_t count); // replace input with timed bytes (in headless mode)
+ic_private void   tty_set_trace(tty_t* tty, trace_t* trace);         // record all input to `trace` (if not NULL)
 
 // shared between tty.c and tty_esc.c: low level character push
 ic_private void   tty_cpush_char(tty_t* tty, uint8_t c);
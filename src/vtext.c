@@ -0,0 +1,120 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2021, Daan Leijen
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+-----------------------------------------------------------------------------*/
+#include <string.h>
+
+#include "common.h"
+#include "stringbuf.h"
+#include "attr.h"
+#include "vtext.h"
+
+//-------------------------------------------------------------
+// Virtual text
+// The annotations are kept sorted on their anchor position
+// and their text is stored consecutively in a single buffer.
+//-------------------------------------------------------------
+
+typedef struct vtext_entry_s {
+  ssize_t pos;      // anchor position in the input
+  ssize_t ofs;      // offset of the text in `texts`
+  ssize_t len;      // length of the text
+  attr_t  attr;     // display attribute
+} vtext_entry_t;
+
+struct vtext_s {
+  vtext_entry_t* entries;
+  ssize_t        count;
+  ssize_t        size;
+  stringbuf_t*   texts;
+  alloc_t*       mem;
+};
+
+ic_private vtext_t* vtext_new(alloc_t* mem) {
+  vtext_t* vt = mem_zalloc_tp(mem, vtext_t);
+  if (vt == NULL) return NULL;
+  vt->mem = mem;
+  vt->texts = sbuf_new(mem);
+  if (vt->texts == NULL) {
+    mem_free(mem, vt);
+    return NULL;
+  }
+  return vt;
+}
+
+ic_private void vtext_free(vtext_t* vt) {
+  if (vt == NULL) return;
+  sbuf_free(vt->texts);
+  mem_free(vt->mem, vt->entries);
+  mem_free(vt->mem, vt);
+}
+
+ic_private void vtext_clear(vtext_t* vt) {
+  if (vt == NULL) return;
+  vt->count = 0;
+  sbuf_clear(vt->texts);
+}
+
+ic_private ssize_t vtext_count(const vtext_t* vt) {
+  return (vt == NULL ? 0 : vt->count);
+}
+
+ic_private bool vtext_add(vtext_t* vt, ssize_t pos, const char* text, ssize_t len, attr_t attr, bool front) {
+  if (vt == NULL || text == NULL || pos < 0) return false;
+  if (len < 0) len = ic_strlen(text);
+  if (len == 0) return false;
+  if (vt->count >= vt->size) {
+    const ssize_t newsize = (vt->size == 0 ? 4 : 2*vt->size);
+    vtext_entry_t* entries = mem_realloc_tp(vt->mem, vtext_entry_t, vt->entries, newsize);
+    if (entries == NULL) return false;
+    vt->entries = entries;
+    vt->size = newsize;
+  }
+  // find the insertion point (usually at the end as annotations are mostly added in order)
+  ssize_t i = vt->count;
+  while (i > 0 && (vt->entries[i-1].pos > pos || (front && vt->entries[i-1].pos == pos))) { i--; }
+  if (i < vt->count) {
+    ic_memmove(vt->entries + i + 1, vt->entries + i, (vt->count - i)*ssizeof(vtext_entry_t));
+  }
+  vtext_entry_t* entry = &vt->entries[i];
+  entry->pos  = pos;
+  entry->ofs  = sbuf_len(vt->texts);
+  entry->len  = len;
+  entry->attr = attr;
+  sbuf_append_n(vt->texts, text, len);
+  vt->count++;
+  return true;
+}
+
+ic_private void vtext_compose(const vtext_t* vt, const char* s, ssize_t len, const attr_t* attrs, stringbuf_t* out, attrbuf_t* out_attrs) {
+  ssize_t pos = 0;
+  for (ssize_t i = 0; i < vtext_count(vt); i++) {
+    const vtext_entry_t* entry = &vt->entries[i];
+    const ssize_t anchor = (entry->pos > len ? len : entry->pos);
+    attrbuf_append_attrs_n(out, out_attrs, s + pos, (attrs == NULL ? NULL : attrs + pos), anchor - pos);
+    attrbuf_append_n(out, out_attrs, sbuf_string(vt->texts) + entry->ofs, entry->len, entry->attr);
+    pos = anchor;
+  }
+  attrbuf_append_attrs_n(out, out_attrs, s + pos, (attrs == NULL ? NULL : attrs + pos), len - pos);
+}
+
+ic_private ssize_t vtext_view_pos(const vtext_t* vt, ssize_t pos) {
+  ssize_t vpos = pos;
+  for (ssize_t i = 0; i < vtext_count(vt) && vt->entries[i].pos < pos; i++) {
+    vpos += vt->entries[i].len;
+  }
+  return vpos;
+}
+
+ic_private ssize_t vtext_input_pos(const vtext_t* vt, ssize_t vpos) {
+  ssize_t added = 0;
+  for (ssize_t i = 0; i < vtext_count(vt); i++) {
+    const vtext_entry_t* entry = &vt->entries[i];
+    if (vpos < entry->pos + added) break;
+    if (vpos < entry->pos + added + entry->len) return entry->pos;
+    added += entry->len;
+  }
+  return vpos - added;
+}
@@ -0,0 +1,41 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2021, Daan Leijen
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+-----------------------------------------------------------------------------*/
+#pragma once
+#ifndef IC_VTEXT_H
+#define IC_VTEXT_H
+
+#include "common.h"
+#include "stringbuf.h"
+#include "attr.h"
+
+//-------------------------------------------------------------
+// Virtual text: annotations (like hints) that are displayed
+// inside the input at an anchor position without being part of it.
+//-------------------------------------------------------------
+
+struct vtext_s;
+typedef struct vtext_s vtext_t;
+
+ic_private vtext_t* vtext_new(alloc_t* mem);
+ic_private void     vtext_free(vtext_t* vt);   // vt can be NULL
+ic_private void     vtext_clear(vtext_t* vt);  // vt can be NULL
+ic_private ssize_t  vtext_count(const vtext_t* vt);
+
+// Add an annotation before the input character at `pos`; annotations at the same
+// position are displayed in the order they were added (unless `front` is true).
+ic_private bool     vtext_add(vtext_t* vt, ssize_t pos, const char* text, ssize_t len, attr_t attr, bool front);
+
+// Compose the displayed text of the input `s` (with optional attributes) into `out` (and `out_attrs`).
+ic_private void     vtext_compose(const vtext_t* vt, const char* s, ssize_t len, const attr_t* attrs, stringbuf_t* out, attrbuf_t* out_attrs);
+
+// Map an input position to the composed text; annotations at `pos` are displayed after it.
+ic_private ssize_t  vtext_view_pos(const vtext_t* vt, ssize_t pos);
+
+// Map a position in the composed text back to the input (positions inside an annotation map to its anchor).
+ic_private ssize_t  vtext_input_pos(const vtext_t* vt, ssize_t vpos);
+
+#endif // IC_VTEXT_H
@@ -0,0 +1,253 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2021, Daan Leijen
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  Check that scrolling with scroll regions (DECSTBM) renders the same
+  screen as a full repaint. The same keys are fed twice in headless
+  mode, with and without scroll regions, and the captured output is
+  run through a small VT emulator. The screens are compared at the
+  start of every refresh (marked by the highlighter).
+-----------------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <isocline.h>
+
+#define WIDTH   (40)
+#define HEIGHT  (8)
+#define MARKS   (1024)
+
+//-------------------------------------------------------------
+// A minimal VT screen: just the sequences that isocline emits
+//-------------------------------------------------------------
+
+typedef struct screen_s {
+  unsigned cells[HEIGHT][WIDTH];  // code points (0 is blank)
+  int  row;
+  int  col;
+  int  top;        // scroll margins
+  int  bottom;
+  bool wrapnext;   // pending wrap after writing in the last column
+} screen_t;
+
+static void screen_init(screen_t* sc) {
+  memset(sc, 0, sizeof(*sc));
+  sc->bottom = HEIGHT - 1;
+}
+
+static void screen_scroll(screen_t* sc, int n) {  // n > 0: up, n < 0: down
+  for (; n > 0; n--) {
+    memmove(sc->cells[sc->top], sc->cells[sc->top + 1], sizeof(sc->cells[0]) * (size_t)(sc->bottom - sc->top));
+    memset(sc->cells[sc->bottom], 0, sizeof(sc->cells[0]));
+  }
+  for (; n < 0; n++) {
+    memmove(sc->cells[sc->top + 1], sc->cells[sc->top], sizeof(sc->cells[0]) * (size_t)(sc->bottom - sc->top));
+    memset(sc->cells[sc->top], 0, sizeof(sc->cells[0]));
+  }
+}
+
+static void screen_linefeed(screen_t* sc) {
+  if (sc->row == sc->bottom) { screen_scroll(sc, 1); }
+  else if (sc->row < HEIGHT - 1) { sc->row++; }
+}
+
+static int clamp(int x, int lo, int hi) {
+  return (x < lo ? lo : (x > hi ? hi : x));
+}
+
+// process a CSI sequence; returns the number of bytes consumed after `ESC [`
+static size_t screen_csi(screen_t* sc, const char* s, size_t len) {
+  int params[4] = { 0, 0, 0, 0 };
+  int count = 0;
+  size_t i = 0;
+  if (i < len && s[i] == '?') i++;
+  while (i < len && ((s[i] >= '0' && s[i] <= '9') || s[i] == ';')) {
+    if (s[i] == ';') { if (count < 3) count++; }
+                else { params[count] = 10*params[count] + (s[i] - '0'); }
+    i++;
+  }
+  if (i >= len) return len;
+  const char final = s[i];
+  const int n = (params[0] == 0 ? 1 : params[0]);
+  switch (final) {
+    case 'A': sc->row = clamp(sc->row - n, 0, HEIGHT - 1); break;
+    case 'B': sc->row = clamp(sc->row + n, 0, HEIGHT - 1); break;
+    case 'C': sc->col = clamp(sc->col + n, 0, WIDTH - 1); break;
+    case 'D': sc->col = clamp(sc->col - n, 0, WIDTH - 1); break;
+    case 'H': sc->row = clamp(n - 1, 0, HEIGHT - 1);
+              sc->col = clamp((params[1] == 0 ? 1 : params[1]) - 1, 0, WIDTH - 1); break;
+    case 'K': for (int c = sc->col; c < WIDTH; c++) { sc->cells[sc->row][c] = 0; } break;
+    case 'J': for (int c = sc->col; c < WIDTH; c++) { sc->cells[sc->row][c] = 0; }
+              for (int r = sc->row + 1; r < HEIGHT; r++) { memset(sc->cells[r], 0, sizeof(sc->cells[r])); } break;
+    case 'r': sc->top = (params[0] == 0 ? 0 : params[0] - 1);
+              sc->bottom = (params[1] == 0 ? HEIGHT - 1 : params[1] - 1);
+              sc->row = 0; sc->col = 0; break;
+    case 'S': screen_scroll(sc, n); break;
+    case 'T': screen_scroll(sc, -n); break;
+    default: break;  // attributes and cursor visibility
+  }
+  sc->wrapnext = false;
+  return i + 1;
+}
+
+static void screen_put(screen_t* sc, unsigned c) {
+  if (sc->wrapnext) {
+    sc->col = 0;
+    screen_linefeed(sc);
+    sc->wrapnext = false;
+  }
+  sc->cells[sc->row][sc->col] = c;
+  if (sc->col == WIDTH - 1) { sc->wrapnext = true; }
+                       else { sc->col++; }
+}
+
+static void screen_feed(screen_t* sc, const char* s, size_t len) {
+  size_t i = 0;
+  while (i < len) {
+    const unsigned char c = (unsigned char)s[i++];
+    if (c == '\x1B' && i < len && s[i] == '[') {
+      i++;
+      i += screen_csi(sc, s + i, len - i);
+    }
+    else if (c == '\x1B' && i < len && s[i] == ']') {  // OSC: skip to BEL or ST
+      while (i < len && s[i] != '\x07' && !(s[i] == '\x1B' && i + 1 < len && s[i+1] == '\\')) i++;
+      i += (i < len && s[i] == '\x07' ? 1 : 2);
+    }
+    else if (c == '\r') { sc->col = 0; sc->wrapnext = false; }
+    else if (c == '\n') { sc->col = 0; sc->wrapnext = false; screen_linefeed(sc); }  // with output processing
+    else if (c == '\b') { if (sc->col > 0) sc->col--; sc->wrapnext = false; }
+    else if (c >= 0x80) {  // decode utf-8
+      unsigned u = (c >= 0xF0 ? (c & 0x07u) : (c >= 0xE0 ? (c & 0x0Fu) : (c & 0x1Fu)));
+      while (i < len && ((unsigned char)s[i] & 0xC0) == 0x80) { u = (u << 6) | ((unsigned char)s[i++] & 0x3Fu); }
+      screen_put(sc, u);
+    }
+    else if (c >= ' ') { screen_put(sc, c); }
+  }
+}
+
+static void screen_print(const screen_t* sc) {
+  for (int r = 0; r < HEIGHT; r++) {
+    printf("  |");
+    for (int c = 0; c < WIDTH; c++) {
+      const unsigned u = sc->cells[r][c];
+      putchar(u == 0 ? ' ' : (u < 0x80 ? (int)u : '?'));
+    }
+    printf("|%s\n", (r == sc->row ? " <" : ""));
+  }
+}
+
+
+//-------------------------------------------------------------
+// Capture a headless edit session
+//-------------------------------------------------------------
+
+typedef struct session_s {
+  char*  output;
+  size_t len;
+  long   marks[MARKS];   // output length at the start of each refresh
+  int    count;
+} session_t;
+
+static session_t* current;
+
+static void mark_refresh(ic_highlight_env_t* henv, const char* input, void* arg) {
+  (void)henv; (void)input; (void)arg;
+  long len = 0;
+  ic_headless_output(&len);
+  if (current->count < MARKS) { current->marks[current->count++] = len; }
+}
+
+static void run(session_t* ses, const char* keys, bool scroll) {
+  memset(ses, 0, sizeof(*ses));
+  current = ses;
+  ic_enable_scroll_regions(scroll);
+  ic_headless_clear_output();
+  ic_headless_feed_bytes(keys, (long)strlen(keys));
+  char* input = ic_readline("scroll");
+  free(input);
+  long len = 0;
+  const char* out = ic_headless_output(&len);
+  ses->output = (char*)malloc((size_t)len + 1);
+  if (ses->output == NULL) exit(1);
+  memcpy(ses->output, out, (size_t)len);
+  ses->len = (size_t)len;
+  ses->marks[ses->count < MARKS ? ses->count++ : MARKS - 1] = len;  // and the final screen
+}
+
+// count the scroll sequences (SU and SD) in the output
+static int count_scrolls(const session_t* ses) {
+  int n = 0;
+  for (size_t i = 0; i + 2 < ses->len; i++) {
+    if (ses->output[i] == '\x1B' && ses->output[i+1] == '[') {
+      size_t j = i + 2;
+      while (j < ses->len && ses->output[j] >= '0' && ses->output[j] <= '9') j++;
+      if (j < ses->len && (ses->output[j] == 'S' || ses->output[j] == 'T')) n++;
+    }
+  }
+  return n;
+}
+
+int main(void) {
+  if (!ic_headless_init(WIDTH, HEIGHT)) {
+    printf("unable to initialize headless mode\n");
+    return 1;
+  }
+  ic_enable_hint(false);
+  ic_set_default_highlighter(&mark_refresh, NULL);
+
+  // a tall input (with a wrapped row), then move through it row by row,
+  // edit in the middle of the view, and move back
+  char keys[4096];
+  keys[0] = 0;
+  for (int i = 1; i <= 16; i++) {
+    char line[128];
+    if (i == 7) snprintf(line, sizeof(line), "line %02d is long enough to wrap onto the next row\n", i);
+           else snprintf(line, sizeof(line), "line %02d\n", i);
+    strcat(keys, line);
+  }
+  strcat(keys, "last");
+  for (int i = 0; i < 15; i++) strcat(keys, "\x1B[A");   // up (but stay below the first row)
+  strcat(keys, "xy\x7F");                                  // insert and backspace
+  for (int i = 0; i < 6; i++) strcat(keys, "\x1B[B");    // down
+  strcat(keys, "\n");                                      // split a line
+  for (int i = 0; i < 12; i++) strcat(keys, "\x1B[B");   // down to the end
+  for (int i = 0; i < 4; i++) strcat(keys, "\x1B[A");
+
+  session_t scroll, repaint;
+  run(&scroll, keys, true);
+  run(&repaint, keys, false);
+
+  const int scrolls = count_scrolls(&scroll);
+  if (scrolls == 0 || count_scrolls(&repaint) != 0) {
+    printf("error: expecting scroll sequences only with scroll regions (found %d)\n", scrolls);
+    return 1;
+  }
+  if (scroll.count != repaint.count) {
+    printf("error: different number of refreshes: %d vs. %d\n", scroll.count, repaint.count);
+    return 1;
+  }
+  screen_t s1, s2;
+  screen_init(&s1);
+  screen_init(&s2);
+  long pos1 = 0, pos2 = 0;
+  for (int m = 0; m < scroll.count; m++) {
+    screen_feed(&s1, scroll.output + pos1, (size_t)(scroll.marks[m] - pos1));
+    screen_feed(&s2, repaint.output + pos2, (size_t)(repaint.marks[m] - pos2));
+    pos1 = scroll.marks[m];
+    pos2 = repaint.marks[m];
+    if (memcmp(s1.cells, s2.cells, sizeof(s1.cells)) != 0 || s1.row != s2.row || s1.col != s2.col) {
+      printf("error: screens differ at refresh %d:\nwith scroll regions:\n", m);
+      screen_print(&s1);
+      printf("with a full repaint:\n");
+      screen_print(&s2);
+      return 1;
+    }
+  }
+  printf("ok: %d refreshes render the same (%d scrolled), output %zu vs. %zu bytes\n",
+         scroll.count, scrolls, scroll.len, repaint.len);
+  free(scroll.output);
+  free(repaint.output);
+  return 0;
+}